@@ -0,0 +1,113 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include "gfx.hpp"
+#include "render_targets.hpp"
+
+namespace gfx
+{
+    struct BlurKernel // One side of a symmetric kernel, tap 0 is the centre, offsets in texels
+    {
+        std::vector<float> offsets;
+        std::vector<float> weights;
+    };
+
+    // Normalized Gaussian of the given radius, sigma 0 picks radius / 2. With linear_taps neighbouring
+    // texels are merged into one bilinear fetch between them, halving the taps per side.
+    BlurKernel gaussian_kernel(int radius, float sigma = 0.0f, bool linear_taps = true);
+
+    // Separable Gaussian as a horizontal and a vertical fragment pass through a pooled intermediate
+    class GaussianBlur
+    {
+    public:
+        BlurKernel kernel;
+
+        RenderTargetPool &_pool;
+        Pipeline _pipeline;
+        VertexArray _vertex_array;
+        Uniform _source;
+        Uniform _direction;
+
+        GaussianBlur(RenderTargetPool &pool, int radius, float sigma = 0.0f, bool linear_taps = true);
+
+        void apply(Image &source, int width, int height, Framebuffer &output); // Output is width x height
+    };
+
+    // Dual filter blur: a chain of half-resolution downsamples followed by upsamples back to full size.
+    // Each level costs a quarter of the previous one, so wide blurs stay cheap.
+    class DualFilterBlur
+    {
+    public:
+        int iterations;
+        float offset = 1.0f; // Tap spread in texels, widens the blur without more levels
+
+        RenderTargetPool &_pool;
+        Pipeline _down;
+        Pipeline _up;
+        VertexArray _vertex_array;
+        Uniform _down_source;
+        Uniform _down_offset;
+        Uniform _down_texel;
+        Uniform _up_source;
+        Uniform _up_offset;
+        Uniform _up_texel;
+
+        DualFilterBlur(RenderTargetPool &pool, int iterations = 4);
+
+        void apply(Image &source, int width, int height, Framebuffer &output);
+    };
+
+    // Kawase blur: full resolution passes of four diagonal taps at growing distances
+    class KawaseBlur
+    {
+    public:
+        std::vector<float> distances = {0.0f, 1.0f, 2.0f, 2.0f, 3.0f};
+
+        RenderTargetPool &_pool;
+        Pipeline _pipeline;
+        VertexArray _vertex_array;
+        Uniform _source;
+        Uniform _texel;
+        Uniform _distance;
+
+        KawaseBlur(RenderTargetPool &pool);
+
+        void apply(Image &source, int width, int height, Framebuffer &output);
+    };
+
+    // Separable Gaussian in compute: each work group loads a 256 texel row segment plus its apron into
+    // shared memory once, then every tap reads shared memory instead of the texture
+    class ComputeGaussianBlur
+    {
+    public:
+        int radius;
+
+        Pipeline _pipeline;
+        Uniform _source;
+        uint32_t _output_unit; // Image unit reflection gave u_output
+        Uniform _size;
+        Uniform _horizontal;
+
+        ComputeGaussianBlur(int radius, float sigma = 0.0f); // Constructor, requires a context with compute support
+
+        // All three images are width x height RGBA16F, temporary holds the horizontal pass
+        void apply(Image &source, Image &temporary, Image &output, int width, int height);
+    };
+
+    struct BlurBenchmark
+    {
+        int width;
+        int height;
+        double naive_ms; // Gaussian with one fetch per texel
+        double gaussian_ms;
+        double compute_ms; // 0 without compute support or half float color buffers
+        double dual_ms;
+        double kawase_ms;
+    };
+
+    // Time every filter with GPU timer queries at each resolution, averaged over the iterations.
+    // Results are also logged.
+    std::vector<BlurBenchmark> benchmark_blurs(const std::vector<std::pair<int, int>> &resolutions, int radius = 16, int iterations = 10);
+}
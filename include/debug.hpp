@@ -3,17 +3,25 @@
 #include <iostream>
 #include <format>
 #include <mutex>
+#include <string>
+#include <vector>
 
 namespace debug
 {
     extern std::mutex mtx;
 
+    void record(const std::string &line); // Append to the tail, called with mtx held
+
+    std::vector<std::string> tail(); // The most recent log lines, oldest first
+
     template <typename... Args>
     void log(std::format_string<Args...> fmt, Args &&...args)
     {
         std::scoped_lock lock(mtx);
         const char *prefix = "[LOG] ";
-        std::cout << std::format("{}{}", prefix, std::format(fmt, std::forward<Args>(args)...)) << std::endl;
+        std::string line = std::format("{}{}", prefix, std::format(fmt, std::forward<Args>(args)...));
+        record(line);
+        std::cout << line << std::endl;
     }
 
     template <typename... Args>
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "gfx.hpp"
+
+namespace gfx
+{
+    struct DebugVertex
+    {
+        float x, y, z;
+        uint32_t color; // RGBA8, red in the lowest byte
+    };
+
+    // Immediate-mode debug shapes callable from any thread. Every thread appends to its own buffer,
+    // render merges them into one upload and issues one Lines draw per depth-test mode. Shapes with a
+    // duration stay visible for that many seconds, the others for a single frame. Points are 3 floats.
+    class DebugDraw
+    {
+    public:
+        struct PersistentLine
+        {
+            DebugVertex a;
+            DebugVertex b;
+            float remaining;
+            bool depth_test;
+        };
+
+        struct ThreadBuffer
+        {
+            std::mutex mutex;
+            std::vector<DebugVertex> lines[2]; // Overlay, depth tested
+            std::vector<PersistentLine> persistent;
+            bool exited = false; // The thread ended, render drops the buffer once merged
+        };
+
+        uint64_t _instance;
+        std::mutex _registry_mutex;
+        std::vector<std::shared_ptr<ThreadBuffer>> _threads; // Threads keep weak references, which expire with the instance, pruned by render once their thread ends
+        std::vector<PersistentLine> _persistent;
+        std::vector<DebugVertex> _merged[2];
+
+        Buffer _buffer;
+        VertexArray _vertex_array;
+        Pipeline _pipeline;
+        Uniform _view_projection;
+
+        size_t draw_calls = 0; // Draw calls issued by the last render
+        size_t line_count = 0; // Lines drawn by the last render
+
+        DebugDraw(); // Constructor, requires an initialized context
+
+        void line(const float *a, const float *b, uint32_t color, float duration = 0.0f, bool depth_test = true);
+
+        void aabb(const float *min, const float *max, uint32_t color, float duration = 0.0f, bool depth_test = true);
+
+        // Oriented box, rotation is a column-major 3x3 matrix
+        void obb(const float *center, const float *half_extents, const float *rotation, uint32_t color, float duration = 0.0f, bool depth_test = true);
+
+        void sphere(const float *center, float radius, uint32_t color, float duration = 0.0f, bool depth_test = true, int segments = 24);
+
+        // Frustum given by the inverse of its view projection matrix
+        void frustum(const float *inverse_view_projection, uint32_t color, float duration = 0.0f, bool depth_test = true);
+
+        void arrow(const float *from, const float *to, uint32_t color, float head_size = 0.1f, float duration = 0.0f, bool depth_test = true);
+
+        // Grid on the XZ plane around center
+        void grid(const float *center, float size, int divisions, uint32_t color, float duration = 0.0f, bool depth_test = true);
+
+        void render(float *view_projection, float delta_time); // Merge every thread buffer and draw, call once per frame
+
+        ThreadBuffer &_thread_buffer();
+        static void _push(ThreadBuffer &buffer, const float *a, const float *b, uint32_t color, float duration, bool depth_test);
+    };
+}
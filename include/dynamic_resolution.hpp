@@ -0,0 +1,54 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "gfx.hpp"
+#include "render_targets.hpp"
+
+namespace gfx
+{
+    // Scales the main render target to hold a GPU frame time budget. The scene renders into a pooled
+    // target at the current scale, composite upscales it to the display, and timer queries read a few
+    // frames late adjust the scale without ever stalling on the GPU. Without timer queries the scale
+    // stays where it is set. The target format comes from RenderTargetPool, so it is RGBA16F only where
+    // the context can render half floats.
+    class DynamicResolution
+    {
+    public:
+        float target_ms = 16.0f; // GPU time budget of the scene
+        float min_scale = 0.5f;
+        float max_scale = 1.0f;
+        float step = 1.0f / 32.0f; // Scales are quantized so small jitter doesn't reallocate targets
+        float scale = 1.0f; // Current per-axis scale
+        float gpu_ms = 0.0f; // Smoothed scene time
+
+        RenderTargetPool &_pool;
+        int _width;
+        int _height;
+        RenderTarget *_target = nullptr;
+        std::vector<std::unique_ptr<Query>> _queries;
+        std::vector<bool> _pending;
+        std::vector<uint64_t> _disjoint; // timer_disjoint_count when each query began
+        size_t _frame = 0;
+        bool _in_frame = false;
+
+        DynamicResolution(RenderTargetPool &pool, int width, int height, size_t latency = 4);
+        ~DynamicResolution();
+
+        void resize(int width, int height); // Display size
+
+        // Adjust the scale from finished queries, then bind a target at the scaled size and start timing
+        RenderTarget &begin_frame();
+
+        void end_frame(); // Stop timing, call once the scene is drawn
+
+        // Upscale the last frame to the display size, nullptr targets the default framebuffer
+        void composite(Framebuffer *target = nullptr, SamplerFilter filter = SamplerFilter::Linear);
+
+        int render_width();
+        int render_height();
+
+        void _update_scale(float frame_ms);
+    };
+}
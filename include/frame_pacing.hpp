@@ -0,0 +1,80 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "gfx.hpp"
+
+struct SDL_Window;
+
+namespace gfx
+{
+    // Frame times over a rolling window, bucketed so percentiles are a walk over the buckets
+    class FrameTimeHistogram
+    {
+    public:
+        static constexpr float bucket_ms = 0.25f;
+        static constexpr size_t bucket_count = 400; // Up to 100 ms, slower frames land in the last bucket
+
+        std::vector<uint32_t> _buckets;
+        std::vector<float> _samples; // Ring of the window, to retire the oldest sample
+        size_t _next = 0;
+        size_t _count = 0;
+
+        FrameTimeHistogram(size_t window = 600);
+
+        void add(float ms);
+
+        float percentile(float p); // Upper edge of the bucket holding the p-th percentile, 0 when empty
+
+        float p50() { return percentile(0.50f); }
+        float p95() { return percentile(0.95f); }
+        float p99() { return percentile(0.99f); }
+
+        size_t count() { return _count; }
+
+        void clear();
+    };
+
+    // Frame pacing for presentation: measures CPU frame, GPU frame and present intervals, caps the
+    // frames the CPU may run ahead with fences, and with late_input delays the start of a frame so input
+    // sampled right after begin_frame is as fresh as the CPU time of a frame allows.
+    class FramePacer
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        size_t max_frames_in_flight = 2;
+        bool late_input = false;
+        float safety_margin_ms = 2.0f; // Slack left before the expected present when delaying input
+
+        FrameTimeHistogram cpu_frame; // begin_frame to end_frame, excluding the pacing waits
+        FrameTimeHistogram gpu_frame; // Timestamps around the frame's commands, empty without timer queries
+        FrameTimeHistogram present_interval; // Interval between consecutive presents
+
+        std::vector<Fence> _fences;
+        std::vector<std::unique_ptr<Query>> _starts; // Timestamp at begin_frame per slot
+        std::vector<std::unique_ptr<Query>> _ends; // Timestamp at end_frame per slot
+        std::vector<uint64_t> _disjoint; // timer_disjoint_count when each start was recorded
+        std::vector<bool> _pending;
+        bool _began = false; // The current frame recorded a start timestamp
+        size_t _frame = 0;
+        Clock::time_point _frame_start;
+        Clock::time_point _last_present;
+        bool _presented = false;
+
+        FramePacer(size_t max_frames_in_flight = 2);
+
+        void begin_frame(); // Blocks until a frame slot is free and, with late_input, until the input deadline
+
+        void end_frame(); // Call after the last draw of the frame, before present
+
+        void present(SDL_Window *window); // Swap and record the present interval
+
+        void log_stats(); // Log p50/p95/p99 of every histogram
+
+        void _read_queries();
+    };
+}
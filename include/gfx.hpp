@@ -2,6 +2,8 @@
 
 #include <cstdint>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 typedef uint32_t glid;
 typedef void *id;
@@ -32,24 +34,137 @@ namespace gfx
         TriangleFan = 0x0006
     };
 
+    enum class Api : uint32_t
+    {
+        OpenGL,
+        OpenGLES
+    };
+
+    // Request a context before the window is created. GFX_FORCE_GLES=1 in the environment overrides the
+    // request with GLES 3.2, which exercises the GLES paths on desktop drivers such as Mesa.
+    void configure_context(Api api, int major, int minor);
+
+    struct Capabilities // Filled by init, each feature picks its fastest path from these
+    {
+        Api api = Api::OpenGL;
+        int major = 0;
+        int minor = 0;
+        std::string vendor;
+        std::string renderer;
+        bool direct_state_access = false; // Named buffer updates without binding
+        bool buffer_storage = false; // Persistently mapped streaming instead of map/orphan
+        bool compute = false; // Compute shaders and storage blocks, transform feedback otherwise
+        bool geometry_shader = false;
+        bool layered_framebuffer = false; // glFramebufferTexture
+        bool vertex_layer = false; // gl_Layer from the vertex stage
+        bool timer_query = false;
+        bool indirect_draw = false;
+        bool program_interface_query = false; // Pipeline reflection through program resources, active uniform queries otherwise
+        bool separate_programs = false; // ProgramPipeline and separable pipelines
+        bool transform_feedback_objects = false; // Capture bindings kept in an object, rebound on every begin otherwise
+        bool conditional_render = false; // GLES has none, occlusion results are read back a frame late instead
+        bool float_blend = false; // Blending into R32F targets, R16F otherwise
+        bool color_buffer_half_float = false; // Rendering into RGBA16F and R16F targets
+        bool color_buffer_float = false; // Rendering into R32F and R11FG11FB10F targets
+    };
+
+    const Capabilities &capabilities();
+
+    enum class SimulationBackend : uint32_t
+    {
+        Compute,
+        TransformFeedback // GLES 3.0 class hardware, vertex shaders write the new state with rasterizer discard
+    };
+
+    SimulationBackend simulation_backend(); // Compute when the context supports it
+
     void init();
 
+    // Render on demand: gfx tracks uploads, uniform and fixed-function state values, sampler and attachment
+    // changes and the draw stream, so frames that would reproduce the last presented image can be skipped.
+    // Outside a frame any change damages the next one, inside a frame it only decides whether the frame
+    // has to be presented.
+    void set_render_on_demand(bool enable);
+
+    void mark_damaged(); // Something gfx cannot see changed the output, such as a resize or an animation
+
+    bool begin_frame(); // False when the whole frame can be skipped, always true unless rendering on demand
+
+    bool end_frame(); // True when the frame differs from the last presented one and has to be presented
+
     void clear_color(float r, float g, float b, float a); // Set the clear color
 
     void clear();
 
+    void finish(); // Block until every submitted command has completed
+
+    struct RenderStats // Counted by gfx since the last reset_render_stats
+    {
+        uint64_t draw_calls = 0;
+        uint64_t dispatches = 0;
+        uint64_t buffer_upload_bytes = 0;
+        uint64_t texture_uploads = 0;
+        uint64_t shader_compiles = 0;
+        uint64_t pipeline_links = 0;
+    };
+
+    const RenderStats &render_stats();
+
+    void reset_render_stats(); // Zero every counter, e.g. at the start of a frame
+
     void draw(size_t vertex_count, size_t instance_count = 1, size_t first_vertex = 0, size_t first_instance = 0, PrimitiveType primitive_type = PrimitiveType::Triangles);
 
     void draw_instanced(size_t vertex_count, size_t instance_count = 1, size_t first_vertex = 0, size_t first_instance = 0, PrimitiveType primitive_type = PrimitiveType::Triangles);
 
     void viewport(float x, float y, float width, float height);
 
+    enum class Barrier : uint32_t
+    {
+        VertexAttribArray = 0x00000001,
+        ElementArray = 0x00000002,
+        Uniform = 0x00000004,
+        TextureFetch = 0x00000008,
+        ShaderImageAccess = 0x00000020,
+        Command = 0x00000040,
+        PixelBuffer = 0x00000080,
+        TextureUpdate = 0x00000100,
+        BufferUpdate = 0x00000200,
+        Framebuffer = 0x00000400,
+        ShaderStorage = 0x00002000,
+        All = 0xFFFFFFFF
+    };
+
+    inline Barrier operator|(Barrier a, Barrier b)
+    {
+        return (Barrier)((uint32_t)a | (uint32_t)b);
+    }
+
+    void memory_barrier(Barrier barriers); // Make shader writes visible to the given kinds of later reads
+
+    void dispatch(uint32_t groups_x, uint32_t groups_y = 1, uint32_t groups_z = 1); // Run the compute pipeline in use
+
     void enable_depth_test(bool enable);
 
     void enable_backface_culling(bool enable);
 
+    bool backface_culling_enabled(); // Current culling state, for passes that restore it
+
     void enable_blending(bool enable);
 
+    void enable_color_write(bool enable);
+
+    void enable_scissor_test(bool enable);
+
+    void enable_rasterizer_discard(bool enable); // Stop primitives after the vertex stage, for transform feedback passes
+
+    void scissor(int x, int y, int width, int height); // Window coordinates, origin at the bottom left
+
+    void enable_depth_write(bool enable);
+
+    bool has_extension(const char *name); // Whether the context exposes an extension, e.g. GL_ARB_shader_viewport_layer_array
+
+    void depth_bias(float factor, float units); // Polygon offset for filled primitives, zero for both disables it
+
     void unbind_framebuffer();
 
     enum class ShaderType : uint32_t
@@ -66,7 +181,12 @@ namespace gfx
     {
         Float = 0x1406,
         Int = 0x1404,
-        UnsignedInt = 0x1405
+        UnsignedInt = 0x1405,
+        Byte = 0x1400,
+        UnsignedByte = 0x1401,
+        Short = 0x1402,
+        UnsignedShort = 0x1403,
+        HalfFloat = 0x140B
     };
 
     class ShaderModule // Shader module
@@ -104,6 +224,8 @@ namespace gfx
 
         void set_int(int value);
 
+        void set_uint(uint32_t value);
+
         void set_vec2(float x, float y);
 
         void set_vec3(float x, float y, float z);
@@ -115,12 +237,75 @@ namespace gfx
         void set_mat3(float *value);
 
         void set_mat4(float *value);
+
+        void set_mat4_array(const float *values, size_t count); // Consecutive column-major matrices of a mat4 array
+    };
+
+    enum class ResourceKind : uint32_t
+    {
+        UniformBlock = 0,
+        StorageBlock = 1,
+        Sampler = 2,
+        Image = 3
+    };
+
+    struct BlockMember
+    {
+        std::string name;
+        uint32_t type; // GL type enum
+        uint32_t offset;
+        uint32_t array_size;
+        uint32_t array_stride;
+        uint32_t matrix_stride;
     };
 
+    struct ShaderResource
+    {
+        std::string name;
+        ResourceKind kind;
+        uint32_t binding; // Binding point, texture unit or image unit
+        uint32_t count = 1; // Number of consecutive bindings used by arrays
+        uint32_t data_size = 0; // Size in bytes of uniform and storage blocks
+        std::vector<BlockMember> members; // Members of uniform and storage blocks
+    };
+
+    struct UniformInfo
+    {
+        std::string name;
+        uint32_t type; // GL type enum
+        uint32_t location;
+        uint32_t array_size;
+    };
+
+    struct PipelineReflection
+    {
+        std::vector<ShaderResource> resources;
+        std::vector<UniformInfo> uniforms; // Default block uniforms, samplers and images excluded
+
+        const ShaderResource *find_resource(const std::string &name) const;
+        const UniformInfo *find_uniform(const std::string &name) const;
+    };
+
+    // Resources are bound by name: the same name gets the same binding point in every pipeline, so
+    // shared blocks such as per-frame constants are bound once per frame rather than per pipeline. A
+    // binding point returns to the pool when the last pipeline using it is destroyed, and running out
+    // of binding points is fatal rather than aliasing two names.
+    void reserve_binding(ResourceKind kind, const std::string &name, uint32_t binding); // Pin a resource name to a binding point
+
+    uint32_t get_binding(ResourceKind kind, const std::string &name); // UINT32_MAX when no live pipeline or reservation holds the name
+
     class Pipeline // Pipeline
     {
     public:
         glid id = 0; // Pipeline id
+        PipelineReflection reflection; // Filled by link
+        glid _override_program = 0; // Variant linked with the fragment override, 0 when it failed to link
+        glid _override_shader = 0; // Fragment override the variant was linked with
+        std::unordered_map<glid, glid> _override_locations; // Uniform locations of the variant
+        std::unordered_map<glid, std::vector<uint8_t>> _uniform_values; // Last values, tracked when rendering on demand
+        bool _stage_only = false; // Separable without separate programs, only linked as part of a ProgramPipeline
+        std::vector<std::string> _uniform_names; // Of a stage-only pipeline, get_uniform returns the index
+        std::vector<std::string> _attribute_names; // Of a stage-only pipeline, get_attribute returns the index
 
         Pipeline(); // Constructor
 
@@ -132,13 +317,70 @@ namespace gfx
 
         Uniform get_uniform(const char *name); // Get the location of a uniform
 
+        void set_separable(bool separable); // Link into a separable program usable as stages of a ProgramPipeline, call before link
+
+        void set_feedback_varyings(const std::vector<std::string> &varyings); // Capture vertex outputs interleaved into one buffer, call before link
+
         void link(); // Link the pipeline
 
         void use(); // Use the pipeline
 
         ~Pipeline(); // Destructor
+
+        void _link_override();
+        void _reflect();
     };
 
+    enum class ShaderStage : uint32_t
+    {
+        Vertex = 0x00000001,
+        Fragment = 0x00000002,
+        Geometry = 0x00000004,
+        TessControl = 0x00000008,
+        TessEvaluation = 0x00000010,
+        Compute = 0x00000020,
+        All = 0xFFFFFFFF
+    };
+
+    inline ShaderStage operator|(ShaderStage a, ShaderStage b)
+    {
+        return (ShaderStage)((uint32_t)a | (uint32_t)b);
+    }
+
+    // Combines separable pipelines at bind time, so N vertex and M fragment variants need N + M links
+    // instead of N x M. Vertex stages declared with #version 410 or later must redeclare gl_PerVertex.
+    // Without separate programs the stages are linked into one program at the first bind after a change,
+    // and uniforms set after set_active reach it through the locations the stage pipeline handed out.
+    class ProgramPipeline
+    {
+    public:
+        glid id = 0; // 0 without separate programs
+        std::vector<std::pair<uint32_t, const Pipeline *>> _stages; // Stage bits taken from each pipeline, without separate programs
+        glid _combined = 0; // Program linked from _stages
+        bool _linked = false;
+        PipelineReflection _reflection; // Of _combined
+        std::unordered_map<const Pipeline *, std::vector<int32_t>> _locations; // Per stage pipeline, the locations of its uniform names in _combined
+        const Pipeline *_active = nullptr;
+
+        ProgramPipeline(); // Constructor
+        ~ProgramPipeline(); // Destructor
+
+        void use_stages(ShaderStage stages, const Pipeline &pipeline); // Take the given stages from a separable pipeline
+
+        void set_active(const Pipeline &pipeline); // Route Uniform::set_* calls to one of the stage pipelines
+
+        void bind(); // Bind the program pipeline, replaces any Pipeline::use
+
+        void unbind();
+
+        void _link();
+        void _unlink();
+    };
+
+    // Debug: replace the fragment stage of every pipeline used from now on, nullptr restores them.
+    // While set, blending is forced to additive so each shaded fragment accumulates into the target.
+    void set_fragment_override(const ShaderModule *shader);
+
     enum class BufferType : uint32_t
     {
         Array = 0x8892,
@@ -175,6 +417,71 @@ namespace gfx
 
         void map();
         void unmap();
+
+        void copy_from(Buffer &source, size_t size, size_t source_offset = 0, size_t offset = 0); // GPU-side copy
+
+        void bind_base(uint32_t binding); // Bind to an indexed uniform or storage binding point
+        void bind_range(uint32_t binding, size_t offset, size_t size);
+    };
+
+    void bind_buffer(const std::string &name, Buffer &buffer); // Bind a uniform or storage block by name for every pipeline
+
+    // Draw with {count, instance_count, first, base_instance} read from a buffer, usually written by a compute pass
+    void draw_indirect(Buffer &buffer, size_t offset = 0, PrimitiveType primitive_type = PrimitiveType::Triangles);
+
+    void dispatch_indirect(Buffer &buffer, size_t offset = 0); // Dispatch with {x, y, z} group counts read from a buffer
+
+    // Transform feedback object. Captures the varyings declared with Pipeline::set_feedback_varyings into
+    // the attached buffers, the GPU simulation path on contexts without compute shaders.
+    class TransformFeedback
+    {
+    public:
+        glid id = 0;
+        std::vector<glid> _buffers; // Capture targets by index, without transform feedback objects
+
+        TransformFeedback();
+        ~TransformFeedback();
+
+        void attach(uint32_t index, Buffer &buffer); // Capture target, call while no capture is active
+
+        void begin(PrimitiveType primitive_type = PrimitiveType::Points); // Bind and start capturing draws
+        void end();
+    };
+
+    class Fence
+    {
+    public:
+        id sync = nullptr;
+
+        ~Fence();
+
+        void insert(); // Signal once every command submitted so far has completed
+
+        bool wait(uint64_t timeout_ns = UINT64_MAX); // True once signaled, also true when nothing was inserted
+
+        bool is_signaled();
+    };
+
+    // Streaming buffer split into one region per frame in flight. Writes are unsynchronized, a region is
+    // only reused after the fence of the frame that last wrote it has signaled.
+    class RingBuffer
+    {
+    public:
+        Buffer buffer;
+        size_t _region_size;
+        size_t _head = 0;
+        size_t _frame = 0;
+        std::vector<Fence> _fences;
+        void *_mapped = nullptr; // Persistent coherent mapping when buffer storage is available
+
+        RingBuffer(BufferType type, size_t region_size, size_t frames_in_flight = 3);
+
+        void begin_frame(); // Move to the next region, waiting for the GPU if it still reads it
+
+        void end_frame(); // Fence the writes of this frame
+
+        // Copy data into the current region, returns its offset in the buffer or SIZE_MAX when the region is full
+        size_t write(const void *data, size_t size, size_t alignment = 16);
     };
 
     class VertexArray
@@ -188,7 +495,7 @@ namespace gfx
         void bind();
         void unbind();
 
-        void set_attribute(size_t index, Buffer &buffer, size_t size, DataType type, size_t stride, size_t offset);
+        void set_attribute(size_t index, Buffer &buffer, size_t size, DataType type, size_t stride, size_t offset, bool normalized = false);
         void set_index_buffer(Buffer &buffer);
         void enable_attribute(size_t index);
         void set_attribute_divisor(size_t index, size_t divisor);
@@ -199,8 +506,20 @@ namespace gfx
         RGB = 6407,
         RGBA = 6408,
         Depth = 0x1902,
+        Depth32F = 0x8CAC,
+        R8 = 0x8229,
+        R16F = 0x822D,
+        R32F = 0x822E,
+        R32UI = 0x8236,
+        RGBA8 = 0x8058,
+        RGBA16F = 0x881A,
+        R11FG11FB10F = 0x8C3A,
     };
 
+    // The format itself when this context can render into it, otherwise the nearest renderable one:
+    // 32-bit and packed float fall back to half float, half float falls back to 8-bit normalized
+    TextureFormat renderable_format(TextureFormat format);
+
     enum class SamplerFilter : uint32_t
     {
         Nearest = 0x2600,
@@ -231,16 +550,68 @@ namespace gfx
         Sampler(SamplerFilter min_filter, SamplerFilter mag_filter, SamplerWrap wrap_s, SamplerWrap wrap_t) : min_filter(min_filter), mag_filter(mag_filter), wrap_s(wrap_s), wrap_t(wrap_t) {}
     };
 
+    enum class ImageAccess : uint32_t
+    {
+        ReadOnly = 0x88B8,
+        WriteOnly = 0x88B9,
+        ReadWrite = 0x88BA
+    };
+
     class Image
     {
     public:
         glid id = 0;
         TextureFormat format;
+        bool _immutable = false; // Fixed size single level storage, sized formats on GLES
 
         Image(int width, int height, TextureFormat format);
         ~Image();
 
-        void set_data(const void *data, size_t width, size_t height, size_t channels);
+        void set_data(const void *data, size_t width, size_t height, size_t channels); // Immutable images keep their size and single level
+
+        void bind(int slot = 0);
+        void unbind(int slot = 0);
+
+        void bind_image(int unit, ImageAccess access); // Bind level 0 for imageLoad/imageStore, needs a sized format
+
+        void set_depth_compare(bool enable); // Sample depth formats through sampler2DShadow with hardware comparison
+
+        void _apply_sampler(Sampler &sampler);
+    };
+
+    class ImageArray // 2D texture array
+    {
+    public:
+        glid id = 0;
+        TextureFormat format;
+        int _width;
+        int _height;
+        int _layers;
+
+        ImageArray(int width, int height, int layers, TextureFormat format);
+        ~ImageArray();
+
+        void set_layer(const void *data, int layer);
+        void set_sub_data(const void *data, int x, int y, int width, int height, int layer);
+        void generate_mipmaps();
+
+        void bind(int slot = 0);
+        void unbind(int slot = 0);
+
+        void _apply_sampler(Sampler &sampler);
+    };
+
+    class ImageCube // Cubemap, faces ordered +X, -X, +Y, -Y, +Z, -Z
+    {
+    public:
+        glid id = 0;
+        TextureFormat format;
+        int _size;
+
+        ImageCube(int size, TextureFormat format);
+        ~ImageCube();
+
+        void set_face(const void *data, int face);
 
         void bind(int slot = 0);
         void unbind(int slot = 0);
@@ -277,6 +648,68 @@ namespace gfx
         void unbind();
 
         void attach(AttachmentType attachment, Image &image);
+
+        // Layered attachments, gl_Layer written by the vertex or geometry stage selects the layer or face
+        void attach(AttachmentType attachment, ImageArray &image);
+        void attach(AttachmentType attachment, ImageCube &image);
+
+        void attach_layer(AttachmentType attachment, ImageArray &image, int layer); // A single layer, for stages that can't write gl_Layer
+        void attach_face(AttachmentType attachment, ImageCube &image, int face);
+
+        void disable_color(); // Depth-only, no draw or read color buffer so the framebuffer is complete without Color0
+
+        void read_pixels(int x, int y, int width, int height, TextureFormat format, void *data); // Read back Color0
+
+        // Copy Color0 scaled to width x height of the target, nullptr targets the default framebuffer
+        void blit(Framebuffer *target, int width, int height, SamplerFilter filter = SamplerFilter::Nearest);
+
+        void blit_depth(Framebuffer &target, int x, int y, int width, int height); // Copy a depth region to the same place in target
+    };
+
+    enum class QueryType : uint32_t
+    {
+        SamplesPassed = 0x8914,
+        AnySamplesPassed = 0x8C2F,
+        AnySamplesPassedConservative = 0x8D6A,
+        PrimitivesGenerated = 0x8C87,
+        TimeElapsed = 0x88BF,
+        Timestamp = 0x8E28
+    };
+
+    enum class ConditionalRenderMode : uint32_t
+    {
+        Wait = 0x8E13,
+        NoWait = 0x8E14,
+        ByRegionWait = 0x8E15,
+        ByRegionNoWait = 0x8E16
+    };
+
+    class Query
+    {
+    public:
+        glid id = 0;
+        QueryType type;
+
+        Query(QueryType type);
+        ~Query();
+
+        void begin();
+        void end();
+
+        void counter(); // Record the GPU time once every previous command completed, for Timestamp queries
+
+        bool is_available(); // True once the result can be read without stalling
+        uint64_t get_result(); // Blocks until the result is available
     };
 
+    // Skip the draws between begin/end on the GPU when the query saw no samples, no CPU readback involved.
+    // Without capabilities().conditional_render the draws always run.
+    void begin_conditional_render(Query &query, ConditionalRenderMode mode = ConditionalRenderMode::NoWait);
+
+    void end_conditional_render();
+
+    // Disjoint events seen so far, e.g. a GPU clock change. A timer result is only valid when the count
+    // didn't change between starting the query and reading it. Always 0 on desktop GL.
+    uint64_t timer_disjoint_count();
+
 }
\ No newline at end of file
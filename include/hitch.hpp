@@ -0,0 +1,102 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "gfx.hpp"
+
+namespace gfx
+{
+    struct TraceEvent
+    {
+        std::string name;
+        uint64_t start_ns; // Relative to the detector's creation
+        uint64_t end_ns;
+        uint32_t thread; // 0 for the GPU track
+    };
+
+    struct FrameRecord
+    {
+        uint64_t index = 0;
+        uint64_t start_ns = 0;
+        uint64_t end_ns = 0;
+        float cpu_ms = 0.0f;
+        float gpu_ms = 0.0f; // First GPU zone start to last GPU zone end
+        RenderStats stats; // gfx counters during the frame
+        std::vector<TraceEvent> events;
+        uint64_t _gpu_base = 0; // Timestamp of the first resolved GPU zone
+    };
+
+    // Keeps the last frames of CPU and GPU trace zones with their render stats. A frame slower than
+    // budget_multiplier times the median is a hitch: once frames_after more frames were recorded the
+    // whole history is written as a Chrome trace JSON file together with the log tail, so shader
+    // compiles, uploads and allocation spikes can be diagnosed after the fact.
+    class HitchDetector
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        class Zone // Scoped CPU zone
+        {
+        public:
+            HitchDetector &_detector;
+            const char *_name;
+            uint64_t _start;
+
+            Zone(HitchDetector &detector, const char *name) : _detector(detector), _name(name), _start(detector._now()) {}
+            ~Zone() { _detector.add_event(_name, _start, _detector._now()); }
+        };
+
+        struct GpuZone
+        {
+            std::string name;
+            std::unique_ptr<Query> begin;
+            std::unique_ptr<Query> end;
+            uint64_t frame;
+        };
+
+        float budget_multiplier = 2.0f;
+        float min_budget_ms = 4.0f; // Frames faster than this are never hitches
+        size_t frames_after = 5;
+        std::string directory = "."; // Where hitch_<frame>.json files are written
+        size_t dumps = 0;
+
+        size_t _history;
+        std::vector<FrameRecord> _frames; // Ring of the history
+        FrameRecord _current;
+        uint64_t _frame = 0;
+        Clock::time_point _epoch;
+        std::mutex _mutex;
+        bool _in_frame = false;
+        uint64_t _dump_at = UINT64_MAX;
+        uint64_t _hitch_frame = 0;
+
+        std::vector<GpuZone> _gpu_zones; // Waiting for their timestamps
+        std::vector<std::unique_ptr<Query>> _free_queries;
+        GpuZone *_open_gpu_zone = nullptr;
+
+        HitchDetector(size_t history = 120);
+
+        void begin_frame();
+        void end_frame();
+
+        void add_event(const char *name, uint64_t start_ns, uint64_t end_ns); // Thread safe
+
+        // GPU zones are timestamp queries and can't nest, their results are attached a few frames later.
+        // Both calls do nothing without timer queries.
+        // A zone still open at end_frame is closed there.
+        void begin_gpu_zone(const char *name);
+        void end_gpu_zone();
+
+        bool dump(const std::string &path); // Write the history now
+
+        uint64_t _now();
+        std::unique_ptr<Query> _acquire_query();
+        void _resolve_gpu_zones();
+        float _median_ms();
+    };
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "gfx.hpp"
+
+namespace gfx
+{
+    enum class LayerSelection : uint32_t
+    {
+        Vertex, // gl_Layer from the vertex stage, one instance per layer, needs a viewport layer extension
+        Geometry // gl_Layer from geometry shader invocations, one invocation per layer
+    };
+
+    // Renders into every layer of a layered framebuffer attachment in one pass, e.g. the six faces of an
+    // omnidirectional shadow cubemap or reflection probe, instead of switching framebuffers per layer.
+    //
+    // The sources are stage bodies without a #version line. The vertex stage calls
+    // emit_layered(world_position) instead of writing gl_Position and reads its instance through
+    // layered_instance. Varyings are given as members such as "vec3 normal; vec2 uv;" and are accessed
+    // as layered.normal in both stages.
+    class LayeredPass
+    {
+    public:
+        LayerSelection selection;
+        int layers;
+        Pipeline pipeline;
+        Uniform _view_projections;
+
+        LayeredPass(int layers, const char *vertex_source, const char *fragment_source, const char *varyings = "");
+
+        void use(const float *view_projections); // One column-major matrix per layer
+
+        void draw(size_t vertex_count, size_t instance_count = 1, PrimitiveType primitive_type = PrimitiveType::Triangles);
+
+        static LayerSelection detect(); // Vertex when the context supports it
+    };
+
+    // View-projections of the six cube faces around a position, in ImageCube face order
+    void cube_view_projections(const float *position, float near, float far, float *out);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "gfx.hpp"
+
+namespace gfx
+{
+    struct Light
+    {
+        float position[3] = {0.0f, 0.0f, 0.0f}; // World space
+        float range = 10.0f;
+        float color[3] = {1.0f, 1.0f, 1.0f};
+        float intensity = 1.0f;
+        float direction[3] = {0.0f, 0.0f, -1.0f}; // Spot lights only
+        float spot_cos = -1.0f; // Cosine of the cone half angle, -1 for point lights
+    };
+
+    struct GpuLight // std430 layout of ClusterLights, in view space
+    {
+        float position_range[4];
+        float color_intensity[4];
+        float direction_cos[4];
+    };
+
+    struct ClusterParams // std140 layout of the ClusterParams block
+    {
+        uint32_t grid[4]; // x, y, z, light count
+        float screen[4]; // width, height, near, far
+        float inverse_projection[16];
+        uint32_t limits[4]; // max light indices
+    };
+
+    // Clustered forward lighting. Lights are binned into a view-space froxel grid with exponential depth
+    // slices, either by a compute pass or on the CPU, into compact per-cluster index lists that
+    // fragment shaders walk through shader_source. Shading cost then follows the lights touching a
+    // pixel instead of the lights in the scene.
+    //
+    // The cluster lists are storage blocks, so contexts without compute support log once and update and
+    // bind do nothing.
+    class ClusteredLighting
+    {
+    public:
+        static const char *shader_source; // GLSL declarations and cluster_shade, include in fragment stages
+
+        std::vector<Light> lights;
+        bool use_compute; // Defaults to compute support, false selects the CPU binning path
+
+        uint32_t _grid[3];
+        size_t _max_lights;
+        size_t _max_indices;
+        std::vector<GpuLight> _view_lights;
+        ClusterParams _params;
+
+        Buffer _params_buffer;
+        Buffer _lights_buffer;
+        Buffer _ranges_buffer;
+        Buffer _indices_buffer;
+        Buffer _counter_buffer;
+        Pipeline _cull;
+
+        // CPU path scratch, cluster bounds are kept in structure-of-arrays form so the tests vectorize
+        std::vector<float> _bounds[6];
+        std::vector<uint32_t> _counts;
+        std::vector<uint32_t> _ranges;
+        std::vector<uint32_t> _indices;
+        std::vector<uint32_t> _light_clusters;
+
+        ClusteredLighting(uint32_t grid_x = 16, uint32_t grid_y = 9, uint32_t grid_z = 24, size_t max_lights = 1024, size_t max_indices = 1 << 18);
+
+        // Bin the lights for a camera, view and projection are column-major matrices
+        void update(const float *view, const float *projection, float near, float far, int width, int height);
+
+        void bind(); // Bind the cluster blocks by name for the fragment stages
+
+        void _cull_cpu();
+        void _cluster_bounds(uint32_t cluster, float *min, float *max);
+    };
+}
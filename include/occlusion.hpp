@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "gfx.hpp"
+
+namespace gfx
+{
+    // Occlusion culling for objects tagged as occluder-sensitive. Each object gets a bounding-box proxy
+    // whose query is reused every frame and consumed by conditional rendering, so the CPU never waits
+    // on a query result. Without conditional rendering (GLES) results are read once available, so
+    // visibility lags a frame or more, and begin reports whether the draws should be issued at all.
+    class OcclusionCuller
+    {
+    public:
+        struct Proxy
+        {
+            float min[3];
+            float max[3];
+            std::unique_ptr<Query> query;
+            bool active = false;
+            bool issued = false; // A query was issued for this proxy in the last render_proxies
+            bool pending = false; // A query result was not read back yet, without conditional rendering
+            bool visible = true; // Last read back result, without conditional rendering
+        };
+
+        std::vector<Proxy> _proxies;
+        std::vector<size_t> _free;
+
+        Pipeline _pipeline;
+        VertexArray _vertex_array;
+        Uniform _view_projection;
+        Uniform _min;
+        Uniform _max;
+
+        OcclusionCuller(); // Constructor, requires an initialized context
+
+        size_t add(const float *min, const float *max); // Tag an object as occluder-sensitive, returns its handle
+
+        void remove(size_t handle);
+
+        void set_bounds(size_t handle, const float *min, const float *max);
+
+        // Draw every proxy against the current depth buffer, call after the occluders were drawn.
+        // Proxies containing the eye or crossing the near plane are skipped and their objects are drawn
+        // unconditionally. The culling state is restored afterwards.
+        void render_proxies(float *view_projection, const float *eye);
+
+        bool begin(size_t handle); // Begin the expensive draws of an object, false when they can be skipped
+
+        void end(size_t handle); // End the expensive draws of an object
+    };
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "gfx.hpp"
+
+namespace gfx
+{
+    struct OverdrawStats
+    {
+        float average_layers = 0.0f; // Average over the pixels touched at least once
+        float max_layers = 0.0f;
+        float coverage = 0.0f; // Fraction of the pixels touched at least once
+    };
+
+    // Debug render mode counting how many fragments are shaded per pixel. Between begin_pass and
+    // end_pass every pipeline outputs 1.0 into an R32F target (R16F without float blending) with additive
+    // blending, which can then be drawn as a heatmap or reduced into summary statistics. Contexts without
+    // float color buffers log once and count nothing.
+    class OverdrawView
+    {
+    public:
+        int _width;
+        int _height;
+
+        Image _counter;
+        Image _depth;
+        Framebuffer _framebuffer;
+        ShaderModule _count_shader;
+        Pipeline _heatmap;
+        VertexArray _vertex_array;
+        Uniform _heatmap_counter;
+        Uniform _heatmap_max_layers;
+
+        OverdrawView(int width, int height); // Constructor, requires an initialized context
+        ~OverdrawView(); // Destructor
+
+        void begin_pass(); // Start counting, the counters of the previous pass are cleared
+
+        void end_pass(); // Stop counting and restore the regular fragment stages
+
+        void draw_heatmap(float max_layers = 8.0f); // Draw the last pass into the bound framebuffer
+
+        OverdrawStats read_stats(); // Read the counters of the last pass back to the CPU
+    };
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include "gfx.hpp"
+#include "scan.hpp"
+
+namespace gfx
+{
+    struct ParticleData // Matches the std430 layout of the particle storage buffers
+    {
+        float position_age[4];
+        float velocity_lifetime[4];
+        float color[4];
+    };
+
+    struct ParticleEmitter
+    {
+        float origin[3] = {0.0f, 0.0f, 0.0f};
+        float velocity[3] = {0.0f, 1.0f, 0.0f};
+        float spread = 0.5f; // Random velocity added in every direction
+        float lifetime = 2.0f; // Seconds
+        float color[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+    };
+
+    // GPU particle system. Particle state lives in two storage buffers; every update simulates the
+    // live particles, compacts the survivors with a prefix sum over their alive flags, appends the
+    // emitted particles and writes the indirect draw arguments. The alive count never leaves the GPU.
+    //
+    // Without compute shaders the transform feedback backend runs the simulation in a vertex shader over
+    // every slot, ping-ponging the two buffers with rasterizer discard. Dead slots inside a window that
+    // rotates every update respawn, and rendering skips dead slots instead of compacting them.
+    class ParticleSystem
+    {
+    public:
+        ParticleEmitter emitter;
+        float gravity[3] = {0.0f, -9.81f, 0.0f};
+        float size = 0.1f; // Billboard size in world units
+
+        size_t capacity;
+        SimulationBackend backend;
+        std::unique_ptr<PrefixScan> _scan;
+        std::unique_ptr<Buffer> _particles[2];
+        std::unique_ptr<VertexArray> _vertex_arrays[2];
+        Buffer _alive_flags;
+        Buffer _counter; // Alive count followed by the indirect draw arguments
+        int _current = 0; // Buffer holding the live particles
+        uint32_t _seed = 0;
+        uint32_t _emit_offset = 0;
+        std::unique_ptr<VertexArray> _feedback_arrays[2]; // Per-vertex layouts of the buffers for the feedback pass
+        std::unique_ptr<TransformFeedback> _feedbacks[2]; // Capturing into buffer 1 - i
+
+        Pipeline _simulate;
+        Pipeline _compact;
+        Pipeline _emit;
+        Pipeline _render;
+        Pipeline _feedback_simulate;
+
+        // Uniforms of the backend in use. The feedback pipeline simulates and emits in one pass, so it
+        // fills both the simulate and the emit uniforms.
+        Uniform _simulate_capacity;
+        Uniform _simulate_delta_time;
+        Uniform _simulate_gravity;
+        Uniform _compact_capacity;
+        Uniform _emit_capacity;
+        Uniform _emit_count;
+        Uniform _emit_seed;
+        Uniform _emit_origin;
+        Uniform _emit_velocity;
+        Uniform _emit_spread;
+        Uniform _emit_lifetime;
+        Uniform _emit_color;
+        Uniform _feedback_emit_offset;
+        Uniform _render_view_projection;
+        Uniform _render_camera_right;
+        Uniform _render_camera_up;
+        Uniform _render_size;
+
+        ParticleSystem(size_t capacity); // Constructor, picks the backend from the context capabilities
+
+        void update(float delta_time, uint32_t emit_count); // Simulate, compact and emit on the GPU
+
+        // Draw camera-facing quads, right and up are the camera axes in world space
+        void render(float *view_projection, const float *camera_right, const float *camera_up);
+
+        void _bind_particles(int input);
+        void _get_uniforms(Pipeline &simulate, Pipeline &emit);
+        void _set_emitter(uint32_t emit_count);
+        void _update_feedback(float delta_time, uint32_t emit_count);
+    };
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "gfx.hpp"
+#include "render_targets.hpp"
+
+namespace gfx
+{
+    // One post-processing step. Inputs are named images, each sampled as u_<name> with its texel size
+    // in u_<name>_texel; the first input is read into `vec4 color` at `vec2 uv` before the code runs and
+    // `color` is written to the output afterwards. An empty output name is the chain's final target.
+    struct PostPass
+    {
+        std::vector<std::string> inputs;
+        std::string output;
+        float scale = 1.0f; // Resolution relative to the chain
+        TextureFormat format = TextureFormat::RGBA16F;
+        bool per_pixel = false; // Only reads `color`, so it can be fused with its neighbours
+        std::string declarations; // GLSL uniforms and functions
+        std::string code;
+        std::vector<std::string> uniforms; // Declared uniforms looked up once when the chain compiles
+        std::function<void(std::vector<Uniform> &uniforms)> set_uniforms; // Set them before drawing, in the order of uniforms
+        std::function<void(Pipeline &pipeline)> setup; // Set the declared uniforms before drawing, looking them up by name
+    };
+
+    struct PostSettings
+    {
+        float exposure = 1.0f;
+        float bloom_threshold = 1.0f;
+        float bloom_intensity = 0.05f;
+        float saturation = 1.0f;
+        float contrast = 1.0f;
+        float tint[3] = {1.0f, 1.0f, 1.0f};
+        float vignette = 0.3f;
+    };
+
+    // A post-processing graph compiled into as few fullscreen passes as possible. Consecutive per-pixel
+    // passes whose intermediate result nobody else reads are fused into one generated shader, scaled
+    // passes render at their fraction of the chain resolution, and intermediate images are pooled
+    // render targets released right after their last reader.
+    class PostChain
+    {
+    public:
+        struct Group // One generated shader and draw
+        {
+            std::vector<size_t> passes;
+            std::vector<std::string> inputs;
+            std::string output;
+            float scale;
+            TextureFormat format;
+            std::unique_ptr<Pipeline> pipeline;
+            std::vector<Uniform> samplers;
+            std::vector<Uniform> texels;
+            std::vector<std::vector<Uniform>> uniforms; // Per pass, resolved from PostPass::uniforms
+        };
+
+        struct External
+        {
+            Image *image;
+            int width;
+            int height;
+        };
+
+        std::vector<PostPass> passes;
+        PostSettings settings; // Read by the built-in passes every frame
+
+        RenderTargetPool &_pool;
+        std::vector<Group> _groups;
+        std::unordered_map<std::string, External> _external;
+        VertexArray _vertex_array;
+        bool _dirty = true;
+
+        PostChain(RenderTargetPool &pool); // Constructor, requires an initialized context
+
+        void add(const PostPass &pass);
+
+        void set_input(const std::string &name, Image &image, int width, int height); // An image produced outside the chain, e.g. "scene"
+
+        // Half resolution dual-filter bloom: thresholded downsample, then a chain of downsamples and
+        // additive upsamples down to 1 / 2^levels, written to output at half resolution
+        void add_bloom(const std::string &input, const std::string &output, int levels = 5);
+
+        // Built-in per-pixel passes driven by settings, fused when chained directly
+        void add_tonemap(const std::string &input, const std::string &output, const std::string &bloom = "");
+        void add_color_grade(const std::string &input, const std::string &output);
+        void add_vignette(const std::string &input, const std::string &output);
+        void add_dither(const std::string &input, const std::string &output);
+
+        void compile(); // Fuse and build the shaders, done by render when passes changed
+
+        // Run the chain at width x height into target, nullptr targets the default framebuffer.
+        // Leaves depth testing and blending disabled.
+        void render(int width, int height, Framebuffer *target = nullptr);
+
+        size_t draw_count(); // Fullscreen draws per render after fusion
+    };
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "gfx.hpp"
+
+namespace gfx
+{
+    struct RenderTarget
+    {
+        int width;
+        int height;
+        TextureFormat format;
+        Image color; // Linear filtered, clamped to edge
+        std::unique_ptr<Image> depth;
+        Framebuffer framebuffer;
+        uint64_t _last_used = 0;
+        bool _in_use = false;
+
+        RenderTarget(int width, int height, TextureFormat format, bool with_depth);
+    };
+
+    // Transient framebuffers shared between passes. Targets are matched on size, format and depth and
+    // kept around while idle, so ping-pong and scaled targets stop being reallocated every frame.
+    // Formats the context can't render into are replaced by renderable_format.
+    class RenderTargetPool
+    {
+    public:
+        uint32_t max_idle_frames = 3; // Free targets unused for longer are deleted by end_frame
+
+        std::vector<std::unique_ptr<RenderTarget>> _targets;
+        uint64_t _frame = 0;
+
+        RenderTarget *acquire(int width, int height, TextureFormat format, bool with_depth = false);
+
+        void release(RenderTarget *target);
+
+        void end_frame();
+    };
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "gfx.hpp"
+
+namespace gfx
+{
+    void build_compute_pipeline(Pipeline &pipeline, const char *source); // Compile and link a single compute stage
+
+    // Work-efficient prefix sum over uint storage buffers. Each workgroup scans 512 elements in shared
+    // memory, block sums are scanned recursively and added back, so any count up to the capacity takes
+    // a fixed number of dispatches and never leaves the GPU.
+    class PrefixScan
+    {
+    public:
+        static const size_t block_size = 512;
+
+        size_t capacity;
+        Pipeline _scan_blocks;
+        Pipeline _add_offsets;
+        Uniform _scan_count;
+        Uniform _scan_inclusive;
+        Uniform _add_count;
+        uint32_t _data_binding;
+        uint32_t _sums_binding;
+        std::vector<size_t> _sizes; // Element count of each level
+        std::vector<std::unique_ptr<Buffer>> _sums; // Block sums of each level, the last one holds the total
+
+        PrefixScan(size_t capacity); // Constructor, requires a context with compute support
+
+        void exclusive(Buffer &data, size_t count); // In place, count must not exceed the capacity
+
+        void inclusive(Buffer &data, size_t count); // In place, count must not exceed the capacity
+
+        Buffer &total(); // One uint holding the sum of the last scanned elements
+
+        void _scan(Buffer &data, size_t count, bool inclusive);
+    };
+
+    // Copies the uint elements whose flag is non-zero to the front of the output, keeping their order
+    class StreamCompaction
+    {
+    public:
+        PrefixScan _scan;
+        Buffer _offsets;
+        Pipeline _flags;
+        Pipeline _scatter;
+        Uniform _flags_count;
+        Uniform _scatter_count;
+
+        StreamCompaction(size_t capacity); // Constructor, requires a context with compute support
+
+        void compact(Buffer &flags, Buffer &input, Buffer &output, size_t count);
+
+        Buffer &count(); // One uint holding the number of elements written by the last compact
+    };
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "gfx.hpp"
+
+namespace gfx
+{
+    // Shader preprocessing and permutation cache. Sources can `#include "path"` files registered in a
+    // virtual filesystem, feature keys are injected as `#define`s after the `#version` line, and every
+    // unique (stage, source hash, defines) variant is compiled once and shared between pipelines.
+    class ShaderCache
+    {
+    public:
+        std::unordered_map<std::string, std::string> _files; // Virtual filesystem for #include
+        std::unordered_map<std::string, std::shared_ptr<ShaderModule>> _modules; // Compiled variants
+        size_t compile_count = 0; // Number of variants compiled so far
+
+        void add_file(const std::string &path, const std::string &source); // Register an includable file
+
+        // Resolve includes and inject defines, a define is either "KEY" or "KEY=VALUE". Empty on failure.
+        std::string preprocess(const std::string &source, const std::vector<std::string> &defines);
+
+        // Get the compiled variant, compiling it on first use. Null when preprocessing fails, nothing is
+        // cached then, so the variant resolves once the missing include is added.
+        std::shared_ptr<ShaderModule> get(ShaderType type, const std::string &source, const std::vector<std::string> &defines = {});
+
+        void clear(); // Drop every cached variant, pipelines already linked keep theirs
+
+        bool _preprocess(const std::string &source, const std::vector<std::string> &defines, std::string &out);
+        bool _expand(const std::string &source, const std::string &path, std::unordered_set<std::string> &included, std::string &out);
+    };
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "gfx.hpp"
+
+namespace gfx
+{
+    enum class ShadowCasters : uint32_t
+    {
+        Static, // Geometry that only moves through invalidate_static
+        Dynamic // Geometry drawn every time the shadow updates
+    };
+
+    // Draw the casters of one kind with the given column-major view-projection
+    using ShadowDrawCallback = std::function<void(const float *view_projection, ShadowCasters casters)>;
+
+    // Shadow maps packed as square tiles of a depth atlas. Static casters are rendered into a second
+    // atlas only when the light or the static geometry changes; an update copies that cached depth into
+    // the sampled atlas and draws the dynamic casters on top. Shadows with an update interval above one,
+    // such as distant cascades, refresh on staggered frames instead of every frame.
+    class ShadowSystem
+    {
+    public:
+        struct Shadow
+        {
+            float view_projection[16]; // Matrix the sampled tile was rendered with
+            float _pending[16];
+            int tile = -1;
+            uint32_t update_interval = 1;
+            uint32_t phase = 0;
+            bool dynamic_casters = true; // False skips the per-update dynamic draw and copy once cached
+            bool active = false;
+            bool _static_dirty = true;
+            bool _rendered = false;
+        };
+
+        float bias_factor = 1.5f;
+        float bias_units = 4.0f;
+
+        int _atlas_size;
+        int _tile_size;
+        uint64_t _frame = 0;
+
+        Image _depth;
+        Image _static_depth;
+        Framebuffer _framebuffer;
+        Framebuffer _static_framebuffer;
+
+        std::vector<Shadow> _shadows;
+        std::vector<size_t> _free;
+        std::vector<int> _free_tiles;
+
+        ShadowSystem(int atlas_size = 4096, int tile_size = 1024); // Constructor, requires an initialized context
+
+        size_t add(uint32_t update_interval = 1, uint32_t phase = 0); // Returns a handle, or SIZE_MAX when the atlas is full
+
+        // Cascades with the first two updated every frame and further ones at halving rates, offset so
+        // at most a couple of distant splits refresh on the same frame. Returns the handles from the nearest
+        // split out, which need not be consecutive, or none when the atlas can't fit them all.
+        std::vector<size_t> add_cascades(uint32_t count);
+
+        void remove(size_t handle);
+
+        // Takes effect on the shadow's next update, a changed matrix re-renders its static casters.
+        // Snap cascade matrices to texels so camera motion alone doesn't invalidate the cache.
+        void set_view_projection(size_t handle, const float *view_projection);
+
+        void invalidate_static(); // Static geometry changed, re-render every cached layer
+
+        void invalidate_static(size_t handle);
+
+        // Update the shadows due this frame, leaves the default framebuffer bound and the viewport on the last tile
+        void render(const ShadowDrawCallback &draw);
+
+        // Atlas uv scale and offset of a shadow's tile as x, y scale then x, y offset
+        void tile_transform(size_t handle, float *scale_offset);
+
+        void bind(int slot = 0); // Bind the atlas for sampling, it compares depth through sampler2DShadow
+
+        void _update(Shadow &shadow, const ShadowDrawCallback &draw);
+    };
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "gfx.hpp"
+
+namespace gfx
+{
+    struct SkinnedVertex // Bind pose vertex, 32 bytes
+    {
+        float position[3];
+        float normal[3];
+        uint8_t joints[4];
+        uint8_t weights[4]; // Normalized, summing to 255
+    };
+
+    struct SkinnedOutput // Skinned vertex as written by the skinning pass
+    {
+        float position[3];
+        float normal[3];
+    };
+
+    // Mesh skinned once per frame on the GPU. The output buffer holds post-skinning positions and normals
+    // and feeds the depth, shadow, main and velocity passes as a plain vertex buffer, so no later pass
+    // repeats the bone blending.
+    class SkinnedMesh
+    {
+    public:
+        size_t vertex_count;
+        size_t bone_count;
+        SimulationBackend backend;
+        Buffer source;
+        Buffer output;
+        std::unique_ptr<VertexArray> _source_layout; // Transform feedback backend only
+        std::unique_ptr<TransformFeedback> _feedback;
+
+        SkinnedMesh(const SkinnedVertex *vertices, size_t vertex_count, size_t bone_count);
+
+        void bind_output(VertexArray &vertex_array, size_t position_index = 0, size_t normal_index = 1); // Attach the skinned attributes
+    };
+
+    // Skins meshes once per frame. With compute shaders the palettes of every mesh are uploaded together
+    // into one storage buffer and a dispatch per mesh blends up to four bones per vertex into its output
+    // buffer. Otherwise a vertex shader does the same from the BonePalette uniform block and transform
+    // feedback captures the result, one palette upload per mesh.
+    //
+    // A frame calls begin_frame, add_palette for every mesh, upload, skin for every mesh and finish.
+    class Skinning
+    {
+    public:
+        static constexpr size_t max_bones = 256; // Per mesh, 16 KiB of matrices, the minimum uniform block size
+        static constexpr size_t group_size = 64;
+
+        SimulationBackend backend;
+        Buffer palette;
+        std::vector<float> _palette_data; // Column-major matrices staged this frame
+        size_t _palette_capacity = 0; // In bones
+        Pipeline _compute_skin;
+        Pipeline _feedback_skin;
+        Uniform _base_bone;
+        Uniform _vertex_count;
+
+        Skinning(); // Constructor, picks the backend from the context capabilities
+
+        void begin_frame();
+        uint32_t add_palette(const float *bones, size_t bone_count); // Returns the first bone of the palette
+        void upload(); // One upload for all palettes of the frame
+
+        void skin(SkinnedMesh &mesh, uint32_t base_bone);
+
+        void finish(); // Make the skinned vertices visible to vertex fetch
+    };
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "gfx.hpp"
+#include "scan.hpp"
+
+namespace gfx
+{
+    // Stable least-significant-digit radix sort of uint keys with uint values, 4 bits per pass. Each
+    // pass counts digits per 128-key block, scans the digit-major counts with PrefixScan and scatters
+    // every key using its rank within the block, computed in shared memory.
+    class RadixSort
+    {
+    public:
+        static const size_t block_size = 128;
+
+        size_t capacity;
+        PrefixScan _scan;
+        Buffer _counts;
+        Buffer _keys;
+        Buffer _values;
+        Pipeline _count;
+        Pipeline _scatter;
+        Uniform _count_count;
+        Uniform _count_shift;
+        Uniform _count_blocks;
+        Uniform _scatter_count;
+        Uniform _scatter_shift;
+        Uniform _scatter_blocks;
+
+        RadixSort(size_t capacity); // Constructor, requires a context with compute support
+
+        // Sort ascending in place, only the lowest bits of the keys are compared (rounded up to 4)
+        void sort(Buffer &keys, Buffer &values, size_t count, uint32_t bits = 32);
+    };
+
+    struct ComputeBenchmark
+    {
+        size_t count;
+        double scan_ms;
+        double compact_ms;
+        double sort_ms;
+    };
+
+    // Time scan, compaction and a full 32-bit key-value sort with GPU timer queries, averaged over the
+    // iterations. Results are also logged.
+    std::vector<ComputeBenchmark> benchmark_compute_primitives(const std::vector<size_t> &counts, int iterations = 10);
+}
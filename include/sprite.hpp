@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "gfx.hpp"
+
+namespace gfx
+{
+    struct Sprite
+    {
+        float x = 0.0f; // Center
+        float y = 0.0f;
+        float width = 1.0f;
+        float height = 1.0f;
+        float rotation = 0.0f; // Radians around the center
+        float u0 = 0.0f;
+        float v0 = 0.0f;
+        float u1 = 1.0f;
+        float v1 = 1.0f;
+        uint32_t color = 0xFFFFFFFF; // RGBA8, red in the lowest byte
+        uint32_t layer = 0; // Layer of the texture array
+    };
+
+    struct SpriteInstance // Compact per-instance data, 32 bytes
+    {
+        float x;
+        float y;
+        float width;
+        float height;
+        uint16_t uv[4]; // Normalized u0, v0, u1, v1
+        uint32_t color;
+        uint16_t rotation; // Normalized turns
+        uint16_t layer;
+    };
+
+    // Batched sprite renderer. Sprites are packed into a streaming ring buffer and expanded into quads
+    // in the vertex shader from gl_VertexID, so a batch costs one instanced draw. A batch only ends when
+    // the texture array or the pipeline changes, or when the frame capacity is reached.
+    class SpriteBatch
+    {
+    public:
+        static const char *vertex_source; // Vertex stage to pair custom fragment stages with
+
+        RingBuffer _ring;
+        VertexArray _vertex_array;
+        Pipeline _default_pipeline;
+        std::vector<SpriteInstance> _instances;
+        size_t _batch_size;
+
+        Pipeline *_pipeline = nullptr;
+        Uniform _view_projection_uniform;
+        Uniform _texture_uniform;
+        ImageArray *_texture = nullptr;
+        float _view_projection[16];
+
+        size_t draw_calls = 0; // Draw calls issued since begin
+        size_t sprite_count = 0; // Sprites drawn since begin
+
+        // Capacity is the number of sprites per frame, batch size the number of sprites per draw
+        SpriteBatch(size_t capacity = 1 << 20, size_t batch_size = 1 << 16);
+
+        void begin(float *view_projection); // Start a frame
+
+        void set_texture(ImageArray &texture); // Flushes when the texture array changes
+
+        void set_pipeline(Pipeline *pipeline); // Flushes when the pipeline changes, nullptr selects the default one
+
+        void draw(const Sprite &sprite);
+
+        void draw(const SpriteInstance *instances, size_t count); // Append already packed instances
+
+        void end(); // Flush and end the frame
+
+        void flush();
+
+        // Draw instances kept in a persistent buffer, such as cached static text, with the current state
+        void draw_range(Buffer &buffer, size_t first, size_t count);
+
+        void _draw_instances(Buffer &buffer, size_t offset, size_t count);
+    };
+
+    SpriteInstance pack_sprite(const Sprite &sprite);
+}
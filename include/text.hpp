@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "gfx.hpp"
+#include "sprite.hpp"
+
+namespace gfx
+{
+    struct GlyphBitmap
+    {
+        int width = 0;
+        int height = 0;
+        std::vector<uint8_t> coverage; // Row-major, top row first
+        float bearing_x = 0.0f; // From the pen to the left edge
+        float bearing_y = 0.0f; // From the baseline up to the top edge
+        float advance = 0.0f;
+    };
+
+    // Rasterizes a glyph at the renderer's font size, returns false for unsupported codepoints
+    using GlyphLoader = std::function<bool(uint32_t codepoint, GlyphBitmap &bitmap)>;
+
+    // Signed distance field of a coverage bitmap padded by spread pixels on each side, 128 on the edge
+    std::vector<uint8_t> generate_sdf(const GlyphBitmap &bitmap, int spread);
+
+    struct Glyph
+    {
+        uint16_t layer;
+        float u0, v0, u1, v1;
+        float width, height; // Quad size in font pixels, padding included
+        float offset_x, offset_y; // From the pen to the top left corner of the quad
+        float advance;
+    };
+
+    struct TextRange // Static text instances in the renderer's static buffer
+    {
+        size_t first = 0;
+        size_t count = 0;
+    };
+
+    // SDF text drawn through the sprite path. Glyphs are rasterized on first use into a texture array
+    // atlas, shaped strings are cached by hash, and static text is laid out once into a persistent
+    // instance buffer. Coordinates are in screen space with y pointing down.
+    class TextRenderer
+    {
+    public:
+        struct ShapedText
+        {
+            std::string text;
+            std::vector<SpriteInstance> instances; // At the origin, in font pixels
+            float width = 0.0f;
+            uint64_t last_used = 0; // The shape call that last returned it
+        };
+
+        size_t max_shaped = 1024; // Cached strings, the least recently shaped one is dropped beyond it
+
+        GlyphLoader _loader;
+        float _font_size;
+        int _spread;
+        float _line_height;
+
+        ImageArray _atlas;
+        int _shelf_x = 0;
+        int _shelf_y = 0;
+        int _shelf_height = 0;
+        int _layer = 0;
+        std::unordered_map<uint32_t, Glyph> _glyphs;
+        std::unordered_map<uint64_t, ShapedText> _shaped;
+        uint64_t _shape_calls = 0;
+        ShapedText _uncached; // Last shaped string that missed glyphs because the atlas was full
+        bool _atlas_full = false; // Set by _glyph when a glyph did not fit
+
+        Pipeline _pipeline;
+        Buffer _static_buffer;
+        std::vector<SpriteInstance> _static_instances;
+        size_t _static_uploaded = 0;
+        std::vector<SpriteInstance> _scratch;
+
+        TextRenderer(GlyphLoader loader, float font_size, int atlas_size = 1024, int atlas_layers = 4, int spread = 4);
+
+        const ShapedText &shape(const std::string &text); // Cached by string hash unless glyphs did not fit the atlas, valid until the next shape
+
+        float measure(const std::string &text, float size); // Width of the longest line
+
+        void draw(SpriteBatch &batch, const std::string &text, float x, float y, float size, uint32_t color = 0xFFFFFFFF);
+
+        TextRange add_static(const std::string &text, float x, float y, float size, uint32_t color = 0xFFFFFFFF);
+
+        void draw_static(SpriteBatch &batch, TextRange range);
+
+        void clear_static(); // Release every static range
+
+        void clear_cache(); // Drop the shaped strings
+
+        void clear_atlas(); // Drop every rasterized glyph and the shaped strings referencing them
+
+        const Glyph *_glyph(uint32_t codepoint);
+        void _transform(const ShapedText &shaped, float x, float y, float size, uint32_t color, std::vector<SpriteInstance> &out);
+        void _bind(SpriteBatch &batch);
+    };
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "gfx.hpp"
+
+namespace gfx
+{
+    struct UIRect // Screen pixels, origin at the top left
+    {
+        float x = 0.0f;
+        float y = 0.0f;
+        float width = 0.0f;
+        float height = 0.0f;
+
+        bool intersects(const UIRect &other) const;
+        UIRect united(const UIRect &other) const;
+        bool empty() const { return width <= 0.0f || height <= 0.0f; }
+    };
+
+    struct UIVertex
+    {
+        float x, y;
+        uint32_t color; // RGBA8, red in the lowest byte
+    };
+
+    void ui_quad(std::vector<UIVertex> &out, const UIRect &rect, uint32_t color); // Append two triangles
+
+    class Widget
+    {
+    public:
+        UIRect bounds;
+        bool visible = true;
+
+        bool _dirty = true;
+        UIRect _drawn_bounds; // Bounds covered by the cached geometry
+        size_t _first = 0; // Vertex range in the renderer's persistent buffer
+        size_t _count = 0;
+        size_t _capacity = 0;
+
+        virtual ~Widget() = default;
+
+        // Append the widget's triangles, only called after mark_dirty. Geometry must stay inside bounds.
+        virtual void tessellate(std::vector<UIVertex> &out) = 0;
+
+        void mark_dirty(); // Call after changing anything that affects the geometry, bounds included
+    };
+
+    class Panel : public Widget
+    {
+    public:
+        uint32_t color = 0xFF404040;
+        uint32_t border_color = 0xFF808080;
+        float border_width = 1.0f;
+
+        void tessellate(std::vector<UIVertex> &out) override;
+    };
+
+    // Retained-mode UI renderer. Widget geometry lives in a persistent vertex buffer and only dirty
+    // widgets are re-tessellated. The UI is kept in an offscreen framebuffer where only the damaged
+    // regions are redrawn under a scissor, so an unchanged screen costs a single blit.
+    class UIRenderer
+    {
+    public:
+        int _width;
+        int _height;
+        std::vector<Widget *> _widgets;
+        std::vector<UIRect> _damage;
+        std::vector<UIVertex> _scratch;
+
+        Image _color;
+        Framebuffer _framebuffer;
+        Buffer _buffer;
+        size_t _buffer_capacity = 0; // In vertices
+        size_t _buffer_used = 0;
+        VertexArray _vertex_array;
+        Pipeline _pipeline;
+        Uniform _screen_size;
+
+        float background[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+
+        size_t redrawn_regions = 0; // Damaged regions redrawn by the last render
+        size_t tessellated_widgets = 0; // Widgets re-tessellated by the last render
+
+        UIRenderer(int width, int height, size_t initial_vertices = 1 << 16);
+
+        void add(Widget &widget); // Widgets are drawn in the order they were added
+
+        void remove(Widget &widget);
+
+        void invalidate(const UIRect &rect); // Force a region to be redrawn
+
+        void invalidate_all();
+
+        bool render(); // Redraw the damaged regions, returns false when nothing changed
+
+        void composite(); // Copy the UI to the default framebuffer
+
+        void _upload(Widget &widget);
+        void _rebuild_buffer(size_t min_capacity);
+        void _merge_damage();
+    };
+}
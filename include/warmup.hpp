@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "gfx.hpp"
+
+namespace gfx
+{
+    struct RenderState
+    {
+        bool depth_test = true;
+        bool backface_culling = false;
+        bool blending = false;
+        PrimitiveType primitive_type = PrimitiveType::Triangles;
+        TextureFormat color_format = TextureFormat::RGBA; // Format of the target drawn into
+        TextureFormat depth_format = TextureFormat::Depth;
+        bool has_depth = true;
+
+        void apply() const; // Set the fixed-function state
+
+        uint32_t key() const;
+        static RenderState from_key(uint32_t key);
+    };
+
+    // Pre-warms pipelines so drivers finish deferred compilation at load time instead of on the first
+    // draw. Pipelines and vertex layouts are registered by a name that is stable across runs, play
+    // sessions record the combinations they draw with, and warm issues a tiny draw into a 1x1
+    // framebuffer with the recorded target formats for each recorded combination.
+    class PipelineWarmer
+    {
+    public:
+        struct Combination
+        {
+            size_t pipeline;
+            size_t layout;
+            RenderState state;
+        };
+
+        std::vector<std::string> _pipeline_names;
+        std::vector<Pipeline *> _pipelines;
+        std::vector<std::string> _layout_names;
+        std::vector<VertexArray *> _layouts;
+        std::unordered_set<uint64_t> _seen;
+
+        // Register a pipeline, returns the handle passed to record. Re-registering a name replaces it.
+        size_t register_pipeline(const std::string &name, Pipeline &pipeline);
+
+        // Register a vertex layout, its buffers must hold at least three vertices
+        size_t register_layout(const std::string &name, VertexArray &vertex_array);
+
+        void record(size_t pipeline, size_t layout, const RenderState &state); // Cheap enough to call on every draw
+
+        std::vector<Combination> combinations() const; // Every recorded combination
+
+        bool save(const std::string &path) const; // Store the recorded combinations by name
+
+        bool load(const std::string &path); // Merge combinations stored by a previous session
+
+        size_t warm(); // Draw every recorded combination whose pipeline and layout are registered, returns the count
+
+        static uint64_t _pack(size_t pipeline, size_t layout, uint32_t state); // 16 bits per handle, 32 for the state
+    };
+}
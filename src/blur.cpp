@@ -0,0 +1,498 @@
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+
+#include "blur.hpp"
+#include "debug.hpp"
+#include "scan.hpp"
+
+namespace gfx
+{
+    static const char *blur_vertex_source = R"(#version 330 core
+out vec2 v_uv;
+
+void main()
+{
+    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    v_uv = position;
+    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+    static const char *gaussian_fragment_source = R"(
+in vec2 v_uv;
+out vec4 color;
+
+uniform sampler2D u_source;
+uniform vec2 u_direction; // Texel step along the blur axis
+
+void main()
+{
+    vec4 sum = texture(u_source, v_uv) * WEIGHTS[0];
+
+    for (int i = 1; i < TAPS; i++)
+    {
+        vec2 offset = u_direction * OFFSETS[i];
+        sum += (texture(u_source, v_uv + offset) + texture(u_source, v_uv - offset)) * WEIGHTS[i];
+    }
+
+    color = sum;
+}
+)";
+
+    static const char *dual_down_fragment_source = R"(#version 330 core
+in vec2 v_uv;
+out vec4 color;
+
+uniform sampler2D u_source;
+uniform vec2 u_texel;
+uniform float u_offset;
+
+void main()
+{
+    vec2 t = u_texel * 0.5 * u_offset;
+    vec4 sum = texture(u_source, v_uv) * 4.0;
+    sum += texture(u_source, v_uv + vec2(-t.x, -t.y)) + texture(u_source, v_uv + vec2(t.x, -t.y));
+    sum += texture(u_source, v_uv + vec2(-t.x, t.y)) + texture(u_source, v_uv + vec2(t.x, t.y));
+    color = sum * 0.125;
+}
+)";
+
+    static const char *dual_up_fragment_source = R"(#version 330 core
+in vec2 v_uv;
+out vec4 color;
+
+uniform sampler2D u_source;
+uniform vec2 u_texel;
+uniform float u_offset;
+
+void main()
+{
+    vec2 t = u_texel * 0.5 * u_offset;
+    vec4 sum = texture(u_source, v_uv + vec2(-t.x * 2.0, 0.0)) + texture(u_source, v_uv + vec2(t.x * 2.0, 0.0));
+    sum += texture(u_source, v_uv + vec2(0.0, -t.y * 2.0)) + texture(u_source, v_uv + vec2(0.0, t.y * 2.0));
+    sum += (texture(u_source, v_uv + vec2(-t.x, t.y)) + texture(u_source, v_uv + vec2(t.x, t.y))) * 2.0;
+    sum += (texture(u_source, v_uv + vec2(-t.x, -t.y)) + texture(u_source, v_uv + vec2(t.x, -t.y))) * 2.0;
+    color = sum / 12.0;
+}
+)";
+
+    static const char *kawase_fragment_source = R"(#version 330 core
+in vec2 v_uv;
+out vec4 color;
+
+uniform sampler2D u_source;
+uniform vec2 u_texel;
+uniform float u_distance;
+
+void main()
+{
+    vec2 t = u_texel * (u_distance + 0.5);
+    vec4 sum = texture(u_source, v_uv + vec2(-t.x, -t.y)) + texture(u_source, v_uv + vec2(t.x, -t.y));
+    sum += texture(u_source, v_uv + vec2(-t.x, t.y)) + texture(u_source, v_uv + vec2(t.x, t.y));
+    color = sum * 0.25;
+}
+)";
+
+    static const char *compute_gaussian_source = R"(
+layout(local_size_x = 256) in;
+
+uniform sampler2D u_source;
+layout(rgba16f) uniform writeonly image2D u_output;
+uniform vec2 u_size;
+uniform int u_horizontal;
+
+shared vec4 tile[256 + 2 * RADIUS];
+
+ivec2 texel(int along, int across)
+{
+    return u_horizontal != 0 ? ivec2(along, across) : ivec2(across, along);
+}
+
+void main()
+{
+    int length = int(u_horizontal != 0 ? u_size.x : u_size.y);
+    int across = int(gl_WorkGroupID.y);
+    int start = int(gl_WorkGroupID.x) * 256;
+    int local = int(gl_LocalInvocationID.x);
+
+    for (int i = local; i < 256 + 2 * RADIUS; i += 256)
+    {
+        int along = clamp(start + i - RADIUS, 0, length - 1);
+        tile[i] = texelFetch(u_source, texel(along, across), 0);
+    }
+
+    barrier();
+
+    int along = start + local;
+    if (along >= length)
+    {
+        return;
+    }
+
+    vec4 sum = tile[local + RADIUS] * WEIGHTS[0];
+    for (int k = 1; k <= RADIUS; k++)
+    {
+        sum += (tile[local + RADIUS - k] + tile[local + RADIUS + k]) * WEIGHTS[k];
+    }
+
+    imageStore(u_output, texel(along, across), sum);
+}
+)";
+
+    static std::string float_array(const char *name, const std::vector<float> &values)
+    {
+        std::string source = "const float " + std::string(name) + "[" + std::to_string(values.size()) + "] = float[](";
+
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            source += (i > 0 ? ", " : "") + std::to_string(values[i]);
+        }
+
+        return source + ");\n";
+    }
+
+    static void link_fullscreen(Pipeline &pipeline, const char *fragment_source)
+    {
+        ShaderModule vertex(ShaderType::Vertex);
+        vertex.set_source(blur_vertex_source);
+        vertex.compile();
+
+        ShaderModule fragment(ShaderType::Fragment);
+        fragment.set_source(fragment_source);
+        fragment.compile();
+
+        pipeline.attach_shader(vertex);
+        pipeline.attach_shader(fragment);
+        pipeline.link();
+    }
+
+    BlurKernel gaussian_kernel(int radius, float sigma, bool linear_taps)
+    {
+        radius = std::max(radius, 0);
+        if (sigma <= 0.0f)
+        {
+            sigma = std::max(radius * 0.5f, 0.5f);
+        }
+
+        std::vector<float> weights(radius + 1);
+        float total = 0.0f;
+
+        for (int i = 0; i <= radius; i++)
+        {
+            weights[i] = std::exp(-(float)(i * i) / (2.0f * sigma * sigma));
+            total += i == 0 ? weights[i] : 2.0f * weights[i];
+        }
+
+        for (auto &weight : weights)
+        {
+            weight /= total;
+        }
+
+        BlurKernel kernel;
+        kernel.offsets.push_back(0.0f);
+        kernel.weights.push_back(weights[0]);
+
+        if (!linear_taps)
+        {
+            for (int i = 1; i <= radius; i++)
+            {
+                kernel.offsets.push_back((float)i);
+                kernel.weights.push_back(weights[i]);
+            }
+
+            return kernel;
+        }
+
+        // Sampling between texels a and a + 1 at the weighted position fetches both with one tap
+        for (int a = 1; a <= radius; a += 2)
+        {
+            float weight_a = weights[a];
+            float weight_b = a + 1 <= radius ? weights[a + 1] : 0.0f;
+            float weight = weight_a + weight_b;
+
+            kernel.offsets.push_back((a * weight_a + (a + 1) * weight_b) / weight);
+            kernel.weights.push_back(weight);
+        }
+
+        return kernel;
+    }
+
+    GaussianBlur::GaussianBlur(RenderTargetPool &pool, int radius, float sigma, bool linear_taps)
+        : kernel(gaussian_kernel(radius, sigma, linear_taps)),
+          _pool(pool)
+    {
+        std::string source = "#version 330 core\n#define TAPS " + std::to_string(kernel.weights.size()) + "\n";
+        source += float_array("OFFSETS", kernel.offsets);
+        source += float_array("WEIGHTS", kernel.weights);
+        source += gaussian_fragment_source;
+
+        link_fullscreen(_pipeline, source.c_str());
+        _source = _pipeline.get_uniform("u_source");
+        _direction = _pipeline.get_uniform("u_direction");
+    }
+
+    void GaussianBlur::apply(Image &source, int width, int height, Framebuffer &output)
+    {
+        RenderTarget *temporary = _pool.acquire(width, height, TextureFormat::RGBA16F);
+
+        enable_depth_test(false);
+        enable_blending(false);
+        viewport(0.0f, 0.0f, (float)width, (float)height);
+
+        _pipeline.use();
+        _source.set_int(0);
+        _vertex_array.bind();
+
+        temporary->framebuffer.bind();
+        source.bind(0);
+        _direction.set_vec2(1.0f / width, 0.0f);
+        draw(3);
+
+        output.bind();
+        temporary->color.bind(0);
+        _direction.set_vec2(0.0f, 1.0f / height);
+        draw(3);
+
+        _vertex_array.unbind();
+        unbind_framebuffer();
+        _pool.release(temporary);
+    }
+
+    DualFilterBlur::DualFilterBlur(RenderTargetPool &pool, int iterations)
+        : iterations(iterations),
+          _pool(pool)
+    {
+        link_fullscreen(_down, dual_down_fragment_source);
+        link_fullscreen(_up, dual_up_fragment_source);
+        _down_source = _down.get_uniform("u_source");
+        _down_offset = _down.get_uniform("u_offset");
+        _down_texel = _down.get_uniform("u_texel");
+        _up_source = _up.get_uniform("u_source");
+        _up_offset = _up.get_uniform("u_offset");
+        _up_texel = _up.get_uniform("u_texel");
+    }
+
+    void DualFilterBlur::apply(Image &source, int width, int height, Framebuffer &output)
+    {
+        std::vector<RenderTarget *> levels;
+        Image *input = &source;
+        int input_width = width;
+        int input_height = height;
+
+        enable_depth_test(false);
+        enable_blending(false);
+        _vertex_array.bind();
+
+        _down.use();
+        _down_source.set_int(0);
+        _down_offset.set_float(offset);
+
+        for (int i = 0; i < std::max(iterations, 1); i++)
+        {
+            RenderTarget *level = _pool.acquire(std::max(input_width / 2, 1), std::max(input_height / 2, 1), TextureFormat::RGBA16F);
+            level->framebuffer.bind();
+            viewport(0.0f, 0.0f, (float)level->width, (float)level->height);
+            input->bind(0);
+            _down_texel.set_vec2(1.0f / input_width, 1.0f / input_height);
+            draw(3);
+
+            levels.push_back(level);
+            input = &level->color;
+            input_width = level->width;
+            input_height = level->height;
+        }
+
+        _up.use();
+        _up_source.set_int(0);
+        _up_offset.set_float(offset);
+
+        for (int i = (int)levels.size() - 2; i >= -1; i--)
+        {
+            RenderTarget *level = i >= 0 ? _pool.acquire(levels[i]->width, levels[i]->height, TextureFormat::RGBA16F) : nullptr;
+
+            if (level != nullptr)
+            {
+                level->framebuffer.bind();
+                viewport(0.0f, 0.0f, (float)level->width, (float)level->height);
+            }
+            else
+            {
+                output.bind();
+                viewport(0.0f, 0.0f, (float)width, (float)height);
+            }
+
+            input->bind(0);
+            _up_texel.set_vec2(1.0f / input_width, 1.0f / input_height);
+            draw(3);
+
+            if (level != nullptr)
+            {
+                levels.push_back(level);
+                input = &level->color;
+                input_width = level->width;
+                input_height = level->height;
+            }
+        }
+
+        for (auto *level : levels)
+        {
+            _pool.release(level);
+        }
+
+        _vertex_array.unbind();
+        unbind_framebuffer();
+    }
+
+    KawaseBlur::KawaseBlur(RenderTargetPool &pool) : _pool(pool)
+    {
+        link_fullscreen(_pipeline, kawase_fragment_source);
+        _source = _pipeline.get_uniform("u_source");
+        _texel = _pipeline.get_uniform("u_texel");
+        _distance = _pipeline.get_uniform("u_distance");
+    }
+
+    void KawaseBlur::apply(Image &source, int width, int height, Framebuffer &output)
+    {
+        RenderTarget *targets[2] = {_pool.acquire(width, height, TextureFormat::RGBA16F), _pool.acquire(width, height, TextureFormat::RGBA16F)};
+        Image *input = &source;
+
+        enable_depth_test(false);
+        enable_blending(false);
+        viewport(0.0f, 0.0f, (float)width, (float)height);
+
+        _pipeline.use();
+        _source.set_int(0);
+        _texel.set_vec2(1.0f / width, 1.0f / height);
+        _vertex_array.bind();
+
+        for (size_t i = 0; i < distances.size(); i++)
+        {
+            bool last = i + 1 == distances.size();
+            RenderTarget *target = targets[i & 1];
+
+            if (last)
+            {
+                output.bind();
+            }
+            else
+            {
+                target->framebuffer.bind();
+            }
+
+            input->bind(0);
+            _distance.set_float(distances[i]);
+            draw(3);
+            input = &target->color;
+        }
+
+        _vertex_array.unbind();
+        unbind_framebuffer();
+        _pool.release(targets[0]);
+        _pool.release(targets[1]);
+    }
+
+    ComputeGaussianBlur::ComputeGaussianBlur(int radius, float sigma) : radius(std::max(radius, 1))
+    {
+        BlurKernel kernel = gaussian_kernel(this->radius, sigma, false);
+
+        std::string source = "#version 430 core\n#define RADIUS " + std::to_string(this->radius) + "\n";
+        source += float_array("WEIGHTS", kernel.weights);
+        source += compute_gaussian_source;
+
+        build_compute_pipeline(_pipeline, source.c_str());
+
+        _source = _pipeline.get_uniform("u_source");
+        _output_unit = get_binding(ResourceKind::Image, "u_output");
+        _size = _pipeline.get_uniform("u_size");
+        _horizontal = _pipeline.get_uniform("u_horizontal");
+    }
+
+    void ComputeGaussianBlur::apply(Image &source, Image &temporary, Image &output, int width, int height)
+    {
+        _pipeline.use();
+        _source.set_int(0);
+        _size.set_vec2((float)width, (float)height);
+
+        source.bind(0);
+        temporary.bind_image((int)_output_unit, ImageAccess::WriteOnly);
+        _horizontal.set_int(1);
+        dispatch((width + 255) / 256, height);
+        memory_barrier(Barrier::TextureFetch);
+
+        temporary.bind(0);
+        output.bind_image((int)_output_unit, ImageAccess::WriteOnly);
+        _horizontal.set_int(0);
+        dispatch((height + 255) / 256, width);
+        memory_barrier(Barrier::TextureFetch | Barrier::ShaderImageAccess);
+    }
+
+    template <typename F>
+    static double time_gpu(int iterations, F &&work)
+    {
+        Query query(QueryType::TimeElapsed);
+        uint64_t total = 0;
+
+        for (int i = 0; i < iterations; i++)
+        {
+            query.begin();
+            work();
+            query.end();
+            total += query.get_result();
+        }
+
+        return (double)total / iterations / 1e6;
+    }
+
+    std::vector<BlurBenchmark> benchmark_blurs(const std::vector<std::pair<int, int>> &resolutions, int radius, int iterations)
+    {
+        std::vector<BlurBenchmark> results;
+
+        if (!capabilities().timer_query)
+        {
+            debug::log("Blur benchmarks need timer queries, this context has none");
+            return results;
+        }
+
+        RenderTargetPool pool;
+
+        GaussianBlur naive(pool, radius, 0.0f, false);
+        GaussianBlur gaussian(pool, radius);
+        std::unique_ptr<ComputeGaussianBlur> compute;
+
+        // The compute blur writes rgba16f images, which pooled targets only are with half float color buffers
+        if (capabilities().compute && capabilities().color_buffer_half_float)
+        {
+            compute = std::make_unique<ComputeGaussianBlur>(radius);
+        }
+        DualFilterBlur dual(pool);
+        KawaseBlur kawase(pool);
+
+        for (auto [width, height] : resolutions)
+        {
+            RenderTarget *source = pool.acquire(width, height, TextureFormat::RGBA16F);
+            RenderTarget *temporary = pool.acquire(width, height, TextureFormat::RGBA16F);
+            RenderTarget *output = pool.acquire(width, height, TextureFormat::RGBA16F);
+
+            BlurBenchmark result;
+            result.width = width;
+            result.height = height;
+            result.naive_ms = time_gpu(iterations, [&]() { naive.apply(source->color, width, height, output->framebuffer); });
+            result.gaussian_ms = time_gpu(iterations, [&]() { gaussian.apply(source->color, width, height, output->framebuffer); });
+            result.compute_ms = compute ? time_gpu(iterations, [&]() { compute->apply(source->color, temporary->color, output->color, width, height); }) : 0.0;
+            result.dual_ms = time_gpu(iterations, [&]() { dual.apply(source->color, width, height, output->framebuffer); });
+            result.kawase_ms = time_gpu(iterations, [&]() { kawase.apply(source->color, width, height, output->framebuffer); });
+
+            debug::log("Blur {}x{}: naive {:.3f} ms, gaussian {:.3f} ms, compute {:.3f} ms, dual {:.3f} ms, kawase {:.3f} ms", width, height, result.naive_ms, result.gaussian_ms, result.compute_ms, result.dual_ms, result.kawase_ms);
+
+            pool.release(source);
+            pool.release(temporary);
+            pool.release(output);
+            pool.end_frame();
+            results.push_back(result);
+        }
+
+        return results;
+    }
+}
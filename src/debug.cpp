@@ -2,4 +2,28 @@
 
 #include "debug.hpp"
 
-std::mutex debug::mtx;
\ No newline at end of file
+std::mutex debug::mtx;
+
+static const size_t tail_capacity = 256;
+static std::vector<std::string> tail_lines;
+static size_t tail_next = 0;
+
+void debug::record(const std::string &line)
+{
+    if (tail_lines.size() < tail_capacity)
+    {
+        tail_lines.push_back(line);
+        return;
+    }
+
+    tail_lines[tail_next] = line;
+    tail_next = (tail_next + 1) % tail_capacity;
+}
+
+std::vector<std::string> debug::tail()
+{
+    std::scoped_lock lock(mtx);
+    std::vector<std::string> lines(tail_lines.begin() + tail_next, tail_lines.end());
+    lines.insert(lines.end(), tail_lines.begin(), tail_lines.begin() + tail_next);
+    return lines;
+}
@@ -0,0 +1,380 @@
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <numbers>
+#include <unordered_map>
+
+#include "debug_draw.hpp"
+
+namespace gfx
+{
+    static const char *debug_vertex_source = R"(#version 330 core
+layout(location = 0) in vec3 a_position;
+layout(location = 1) in vec4 a_color;
+
+uniform mat4 u_view_projection;
+
+out vec4 v_color;
+
+void main()
+{
+    gl_Position = u_view_projection * vec4(a_position, 1.0);
+    v_color = a_color;
+}
+)";
+
+    static const char *debug_fragment_source = R"(#version 330 core
+in vec4 v_color;
+out vec4 color;
+
+void main()
+{
+    color = v_color;
+}
+)";
+
+    static std::atomic<uint64_t> next_instance{1};
+
+    // Buffers of every instance the thread drew into, by instance id. Ids are never reused, so an entry
+    // can only expire, and expired entries are dropped whenever the thread meets a new instance. When the
+    // thread ends, the buffers still alive are marked so their instance drops them after one more merge.
+    struct ThreadBuffers
+    {
+        std::unordered_map<uint64_t, std::weak_ptr<DebugDraw::ThreadBuffer>> buffers;
+
+        ~ThreadBuffers()
+        {
+            for (auto &[instance, weak] : buffers)
+            {
+                if (auto buffer = weak.lock())
+                {
+                    std::scoped_lock lock(buffer->mutex);
+                    buffer->exited = true;
+                }
+            }
+        }
+    };
+
+    static thread_local ThreadBuffers thread_buffers;
+
+    DebugDraw::DebugDraw() : _instance(next_instance++), _buffer(BufferType::Array)
+    {
+        ShaderModule vertex(ShaderType::Vertex);
+        vertex.set_source(debug_vertex_source);
+        vertex.compile();
+
+        ShaderModule fragment(ShaderType::Fragment);
+        fragment.set_source(debug_fragment_source);
+        fragment.compile();
+
+        _pipeline.attach_shader(vertex);
+        _pipeline.attach_shader(fragment);
+        _pipeline.link();
+        _view_projection = _pipeline.get_uniform("u_view_projection");
+
+        _vertex_array.set_attribute(0, _buffer, 3, DataType::Float, sizeof(DebugVertex), offsetof(DebugVertex, x));
+        _vertex_array.set_attribute(1, _buffer, 4, DataType::UnsignedByte, sizeof(DebugVertex), offsetof(DebugVertex, color), true);
+    }
+
+    DebugDraw::ThreadBuffer &DebugDraw::_thread_buffer()
+    {
+        auto it = thread_buffers.buffers.find(_instance);
+
+        if (it != thread_buffers.buffers.end())
+        {
+            return *it->second.lock(); // Alive, the instance owns it
+        }
+
+        std::erase_if(thread_buffers.buffers, [](const auto &entry)
+                      { return entry.second.expired(); });
+
+        auto buffer = std::make_shared<ThreadBuffer>();
+        {
+            std::scoped_lock lock(_registry_mutex);
+            _threads.push_back(buffer);
+        }
+
+        thread_buffers.buffers.emplace(_instance, buffer);
+        return *buffer;
+    }
+
+    void DebugDraw::_push(ThreadBuffer &buffer, const float *a, const float *b, uint32_t color, float duration, bool depth_test)
+    {
+        DebugVertex va = {a[0], a[1], a[2], color};
+        DebugVertex vb = {b[0], b[1], b[2], color};
+
+        if (duration > 0.0f)
+        {
+            buffer.persistent.push_back(PersistentLine{va, vb, duration, depth_test});
+        }
+        else
+        {
+            buffer.lines[depth_test].push_back(va);
+            buffer.lines[depth_test].push_back(vb);
+        }
+    }
+
+    void DebugDraw::line(const float *a, const float *b, uint32_t color, float duration, bool depth_test)
+    {
+        ThreadBuffer &buffer = _thread_buffer();
+        std::scoped_lock lock(buffer.mutex);
+        _push(buffer, a, b, color, duration, depth_test);
+    }
+
+    static const int box_edges[12][2] = {
+        {0, 1}, {2, 3}, {4, 5}, {6, 7}, // Along x
+        {0, 2}, {1, 3}, {4, 6}, {5, 7}, // Along y
+        {0, 4}, {1, 5}, {2, 6}, {3, 7}, // Along z
+    };
+
+    static void push_box(DebugDraw::ThreadBuffer &buffer, const float corners[8][3], uint32_t color, float duration, bool depth_test)
+    {
+        for (const auto &edge : box_edges)
+        {
+            DebugDraw::_push(buffer, corners[edge[0]], corners[edge[1]], color, duration, depth_test);
+        }
+    }
+
+    void DebugDraw::aabb(const float *min, const float *max, uint32_t color, float duration, bool depth_test)
+    {
+        float corners[8][3];
+
+        for (int i = 0; i < 8; i++)
+        {
+            corners[i][0] = (i & 1) ? max[0] : min[0];
+            corners[i][1] = (i & 2) ? max[1] : min[1];
+            corners[i][2] = (i & 4) ? max[2] : min[2];
+        }
+
+        ThreadBuffer &buffer = _thread_buffer();
+        std::scoped_lock lock(buffer.mutex);
+        push_box(buffer, corners, color, duration, depth_test);
+    }
+
+    void DebugDraw::obb(const float *center, const float *half_extents, const float *rotation, uint32_t color, float duration, bool depth_test)
+    {
+        float corners[8][3];
+
+        for (int i = 0; i < 8; i++)
+        {
+            float local[3] = {
+                (i & 1) ? half_extents[0] : -half_extents[0],
+                (i & 2) ? half_extents[1] : -half_extents[1],
+                (i & 4) ? half_extents[2] : -half_extents[2],
+            };
+
+            for (int axis = 0; axis < 3; axis++)
+            {
+                corners[i][axis] = center[axis] + rotation[axis] * local[0] + rotation[3 + axis] * local[1] + rotation[6 + axis] * local[2];
+            }
+        }
+
+        ThreadBuffer &buffer = _thread_buffer();
+        std::scoped_lock lock(buffer.mutex);
+        push_box(buffer, corners, color, duration, depth_test);
+    }
+
+    void DebugDraw::sphere(const float *center, float radius, uint32_t color, float duration, bool depth_test, int segments)
+    {
+        ThreadBuffer &buffer = _thread_buffer();
+        std::scoped_lock lock(buffer.mutex);
+
+        // One great circle per axis plane
+        for (int plane = 0; plane < 3; plane++)
+        {
+            int u = plane;
+            int v = (plane + 1) % 3;
+            float previous[3] = {center[0], center[1], center[2]};
+            previous[u] += radius;
+
+            for (int i = 1; i <= segments; i++)
+            {
+                float angle = 2.0f * std::numbers::pi_v<float> * i / segments;
+                float point[3] = {center[0], center[1], center[2]};
+                point[u] += radius * std::cos(angle);
+                point[v] += radius * std::sin(angle);
+
+                _push(buffer, previous, point, color, duration, depth_test);
+                std::copy(point, point + 3, previous);
+            }
+        }
+    }
+
+    void DebugDraw::frustum(const float *inverse_view_projection, uint32_t color, float duration, bool depth_test)
+    {
+        const float *m = inverse_view_projection;
+        float corners[8][3];
+
+        for (int i = 0; i < 8; i++)
+        {
+            float ndc[4] = {(i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f, 1.0f};
+            float world[4];
+
+            for (int row = 0; row < 4; row++)
+            {
+                world[row] = m[row] * ndc[0] + m[4 + row] * ndc[1] + m[8 + row] * ndc[2] + m[12 + row] * ndc[3];
+            }
+
+            for (int axis = 0; axis < 3; axis++)
+            {
+                corners[i][axis] = world[axis] / world[3];
+            }
+        }
+
+        ThreadBuffer &buffer = _thread_buffer();
+        std::scoped_lock lock(buffer.mutex);
+        push_box(buffer, corners, color, duration, depth_test);
+    }
+
+    void DebugDraw::arrow(const float *from, const float *to, uint32_t color, float head_size, float duration, bool depth_test)
+    {
+        float direction[3] = {to[0] - from[0], to[1] - from[1], to[2] - from[2]};
+        float length = std::sqrt(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+
+        ThreadBuffer &buffer = _thread_buffer();
+        std::scoped_lock lock(buffer.mutex);
+        _push(buffer, from, to, color, duration, depth_test);
+
+        if (length <= 0.0f)
+        {
+            return;
+        }
+
+        for (float &component : direction)
+        {
+            component /= length;
+        }
+
+        // Any vector not parallel to the direction gives the head's basis
+        float reference[3] = {0.0f, 1.0f, 0.0f};
+        if (std::fabs(direction[1]) > 0.9f)
+        {
+            reference[0] = 1.0f;
+            reference[1] = 0.0f;
+        }
+
+        float side[3] = {
+            direction[1] * reference[2] - direction[2] * reference[1],
+            direction[2] * reference[0] - direction[0] * reference[2],
+            direction[0] * reference[1] - direction[1] * reference[0],
+        };
+        float side_length = std::sqrt(side[0] * side[0] + side[1] * side[1] + side[2] * side[2]);
+
+        float up[3] = {
+            direction[1] * side[2] - direction[2] * side[1],
+            direction[2] * side[0] - direction[0] * side[2],
+            direction[0] * side[1] - direction[1] * side[0],
+        };
+
+        for (int i = 0; i < 4; i++)
+        {
+            const float *axis = i < 2 ? side : up;
+            float sign = (i & 1) ? -1.0f : 1.0f;
+            float point[3];
+
+            for (int j = 0; j < 3; j++)
+            {
+                point[j] = to[j] - direction[j] * head_size + axis[j] / side_length * head_size * 0.5f * sign;
+            }
+
+            _push(buffer, to, point, color, duration, depth_test);
+        }
+    }
+
+    void DebugDraw::grid(const float *center, float size, int divisions, uint32_t color, float duration, bool depth_test)
+    {
+        ThreadBuffer &buffer = _thread_buffer();
+        std::scoped_lock lock(buffer.mutex);
+
+        float half = size * 0.5f;
+
+        for (int i = 0; i <= divisions; i++)
+        {
+            float offset = -half + size * i / divisions;
+
+            float a[3] = {center[0] + offset, center[1], center[2] - half};
+            float b[3] = {center[0] + offset, center[1], center[2] + half};
+            _push(buffer, a, b, color, duration, depth_test);
+
+            float c[3] = {center[0] - half, center[1], center[2] + offset};
+            float d[3] = {center[0] + half, center[1], center[2] + offset};
+            _push(buffer, c, d, color, duration, depth_test);
+        }
+    }
+
+    void DebugDraw::render(float *view_projection, float delta_time)
+    {
+        _merged[0].clear();
+        _merged[1].clear();
+
+        {
+            std::scoped_lock registry_lock(_registry_mutex);
+
+            std::erase_if(_threads, [this](const std::shared_ptr<ThreadBuffer> &thread)
+                          {
+                              std::scoped_lock lock(thread->mutex);
+
+                              for (int mode = 0; mode < 2; mode++)
+                              {
+                                  _merged[mode].insert(_merged[mode].end(), thread->lines[mode].begin(), thread->lines[mode].end());
+                                  thread->lines[mode].clear();
+                              }
+
+                              _persistent.insert(_persistent.end(), thread->persistent.begin(), thread->persistent.end());
+                              thread->persistent.clear();
+
+                              return thread->exited; // Nothing more can arrive from an ended thread
+                          });
+        }
+
+        size_t kept = 0;
+
+        for (PersistentLine &line : _persistent)
+        {
+            _merged[line.depth_test].push_back(line.a);
+            _merged[line.depth_test].push_back(line.b);
+
+            line.remaining -= delta_time;
+            if (line.remaining > 0.0f)
+            {
+                _persistent[kept++] = line;
+            }
+        }
+
+        _persistent.resize(kept);
+
+        size_t depth_tested = _merged[1].size();
+        _merged[1].insert(_merged[1].end(), _merged[0].begin(), _merged[0].end());
+
+        draw_calls = 0;
+        line_count = _merged[1].size() / 2;
+
+        if (_merged[1].empty())
+        {
+            return;
+        }
+
+        _buffer.set_data(_merged[1].data(), _merged[1].size() * sizeof(DebugVertex), BufferUsage::StreamDraw);
+
+        _pipeline.use();
+        _view_projection.set_mat4(view_projection);
+        _vertex_array.bind();
+
+        if (depth_tested > 0)
+        {
+            enable_depth_test(true);
+            draw(depth_tested, 1, 0, 0, PrimitiveType::Lines);
+            draw_calls++;
+        }
+
+        if (_merged[1].size() > depth_tested)
+        {
+            enable_depth_test(false);
+            draw(_merged[1].size() - depth_tested, 1, depth_tested, 0, PrimitiveType::Lines);
+            draw_calls++;
+            enable_depth_test(true);
+        }
+
+        _vertex_array.unbind();
+    }
+}
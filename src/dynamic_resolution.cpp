@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <cmath>
+
+#include "debug.hpp"
+#include "dynamic_resolution.hpp"
+
+namespace gfx
+{
+    DynamicResolution::DynamicResolution(RenderTargetPool &pool, int width, int height, size_t latency)
+        : _pool(pool),
+          _width(width),
+          _height(height)
+    {
+        if (!capabilities().timer_query)
+        {
+            debug::log("Dynamic resolution needs timer queries, the scale stays at {}", scale);
+            return;
+        }
+
+        latency = std::max<size_t>(latency, 1);
+
+        for (size_t i = 0; i < latency; i++)
+        {
+            _queries.push_back(std::make_unique<Query>(QueryType::TimeElapsed));
+        }
+
+        _pending.assign(latency, false);
+        _disjoint.assign(latency, 0);
+    }
+
+    DynamicResolution::~DynamicResolution()
+    {
+        if (_target != nullptr)
+        {
+            _pool.release(_target);
+        }
+    }
+
+    void DynamicResolution::resize(int width, int height)
+    {
+        _width = width;
+        _height = height;
+    }
+
+    int DynamicResolution::render_width()
+    {
+        return std::max((int)std::lround(_width * scale), 1);
+    }
+
+    int DynamicResolution::render_height()
+    {
+        return std::max((int)std::lround(_height * scale), 1);
+    }
+
+    void DynamicResolution::_update_scale(float frame_ms)
+    {
+        gpu_ms = gpu_ms > 0.0f ? gpu_ms + (frame_ms - gpu_ms) * 0.1f : frame_ms;
+
+        // Within 5% of the budget the scale holds, which keeps it from oscillating around the target
+        float ratio = target_ms / std::max(gpu_ms, 0.01f);
+        if (ratio > 0.95f && ratio < 1.05f)
+        {
+            return;
+        }
+
+        // Cost follows the pixel count, the square of the per-axis scale, approach the ideal gradually
+        float ideal = scale * std::sqrt(ratio);
+        float next = scale + (ideal - scale) * 0.25f;
+        next = std::round(next / step) * step;
+
+        scale = std::clamp(next, min_scale, max_scale);
+    }
+
+    RenderTarget &DynamicResolution::begin_frame()
+    {
+        for (size_t i = 0; i < _queries.size(); i++)
+        {
+            if (_pending[i] && _queries[i]->is_available())
+            {
+                uint64_t result = _queries[i]->get_result();
+
+                // A disjoint event while the query ran, e.g. a clock change, makes the time meaningless
+                if (timer_disjoint_count() == _disjoint[i])
+                {
+                    _update_scale((float)(result / 1e6));
+                }
+
+                _pending[i] = false;
+            }
+        }
+
+        int width = render_width();
+        int height = render_height();
+
+        if (_target == nullptr || _target->width != width || _target->height != height)
+        {
+            if (_target != nullptr)
+            {
+                _pool.release(_target);
+            }
+
+            _target = _pool.acquire(width, height, TextureFormat::RGBA16F, true);
+        }
+
+        _target->framebuffer.bind();
+        viewport(0.0f, 0.0f, (float)width, (float)height);
+
+        if (_queries.empty())
+        {
+            return *_target;
+        }
+
+        // A slot still in flight is skipped rather than waited on, that frame just goes unmeasured
+        size_t slot = _frame % _queries.size();
+        _in_frame = !_pending[slot];
+
+        if (_in_frame)
+        {
+            _disjoint[slot] = timer_disjoint_count();
+            _queries[slot]->begin();
+        }
+
+        return *_target;
+    }
+
+    void DynamicResolution::end_frame()
+    {
+        if (_in_frame)
+        {
+            size_t slot = _frame % _queries.size();
+            _queries[slot]->end();
+            _pending[slot] = true;
+            _in_frame = false;
+        }
+
+        _frame++;
+    }
+
+    void DynamicResolution::composite(Framebuffer *target, SamplerFilter filter)
+    {
+        if (_target == nullptr)
+        {
+            return;
+        }
+
+        _target->framebuffer.blit(target, _width, _height, filter);
+    }
+}
@@ -0,0 +1,184 @@
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include "debug.hpp"
+#include "frame_pacing.hpp"
+
+namespace gfx
+{
+    FrameTimeHistogram::FrameTimeHistogram(size_t window)
+    {
+        _buckets.assign(bucket_count, 0);
+        _samples.assign(std::max<size_t>(window, 1), 0.0f);
+    }
+
+    static size_t bucket_of(float ms)
+    {
+        return std::min((size_t)std::max(ms / FrameTimeHistogram::bucket_ms, 0.0f), FrameTimeHistogram::bucket_count - 1);
+    }
+
+    void FrameTimeHistogram::add(float ms)
+    {
+        if (_count == _samples.size())
+        {
+            _buckets[bucket_of(_samples[_next])]--;
+        }
+        else
+        {
+            _count++;
+        }
+
+        _samples[_next] = ms;
+        _buckets[bucket_of(ms)]++;
+        _next = (_next + 1) % _samples.size();
+    }
+
+    float FrameTimeHistogram::percentile(float p)
+    {
+        if (_count == 0)
+        {
+            return 0.0f;
+        }
+
+        size_t rank = (size_t)std::ceil(p * _count);
+        size_t seen = 0;
+
+        for (size_t i = 0; i < bucket_count; i++)
+        {
+            seen += _buckets[i];
+
+            if (seen >= rank && seen > 0)
+            {
+                return (i + 1) * bucket_ms;
+            }
+        }
+
+        return bucket_count * bucket_ms;
+    }
+
+    void FrameTimeHistogram::clear()
+    {
+        std::fill(_buckets.begin(), _buckets.end(), 0);
+        _next = 0;
+        _count = 0;
+    }
+
+    FramePacer::FramePacer(size_t max_frames_in_flight) : max_frames_in_flight(std::max<size_t>(max_frames_in_flight, 1))
+    {
+        // One more query pair than frames in flight, the oldest is then always finished when its slot comes back
+        size_t slots = this->max_frames_in_flight + 1;
+        _fences.resize(slots);
+        _pending.assign(slots, false);
+
+        // Timestamps rather than a TIME_ELAPSED query, which can't nest with one begun inside the frame
+        if (!capabilities().timer_query)
+        {
+            debug::log("Frame pacing needs timer queries, the GPU frame time isn't measured");
+            return;
+        }
+
+        for (size_t i = 0; i < slots; i++)
+        {
+            _starts.push_back(std::make_unique<Query>(QueryType::Timestamp));
+            _ends.push_back(std::make_unique<Query>(QueryType::Timestamp));
+        }
+
+        _disjoint.assign(slots, 0);
+    }
+
+    void FramePacer::_read_queries()
+    {
+        for (size_t i = 0; i < _ends.size(); i++)
+        {
+            // The end timestamp is recorded last, so the start is available once it is
+            if (_pending[i] && _ends[i]->is_available())
+            {
+                uint64_t start = _starts[i]->get_result();
+                uint64_t end = _ends[i]->get_result();
+
+                // A disjoint event since the start makes the difference meaningless
+                if (timer_disjoint_count() == _disjoint[i] && end >= start)
+                {
+                    gpu_frame.add((float)((end - start) / 1e6));
+                }
+
+                _pending[i] = false;
+            }
+        }
+    }
+
+    void FramePacer::begin_frame()
+    {
+        size_t slots = _fences.size();
+
+        // The frame max_frames_in_flight back has to be done before this one may be recorded
+        if (_frame >= max_frames_in_flight)
+        {
+            _fences[(_frame - max_frames_in_flight) % slots].wait();
+        }
+
+        _read_queries();
+
+        // Start as late as the typical CPU frame allows before the next expected present
+        if (late_input && _presented && present_interval.count() > 0)
+        {
+            auto interval = std::chrono::duration<float, std::milli>(present_interval.p50());
+            auto cost = std::chrono::duration<float, std::milli>(cpu_frame.p95() + safety_margin_ms);
+            auto deadline = _last_present + std::chrono::duration_cast<Clock::duration>(interval - cost);
+
+            if (deadline > Clock::now())
+            {
+                std::this_thread::sleep_until(deadline);
+            }
+        }
+
+        _frame_start = Clock::now();
+
+        size_t slot = _frame % slots;
+        if (!_starts.empty() && !_pending[slot])
+        {
+            _disjoint[slot] = timer_disjoint_count();
+            _starts[slot]->counter();
+            _began = true;
+        }
+    }
+
+    void FramePacer::end_frame()
+    {
+        size_t slot = _frame % _fences.size();
+
+        if (_began)
+        {
+            _ends[slot]->counter();
+            _pending[slot] = true;
+            _began = false;
+        }
+
+        _fences[slot].insert();
+        cpu_frame.add(std::chrono::duration<float, std::milli>(Clock::now() - _frame_start).count());
+        _frame++;
+    }
+
+    void FramePacer::present(SDL_Window *window)
+    {
+        SDL_GL_SwapWindow(window);
+
+        Clock::time_point now = Clock::now();
+
+        if (_presented)
+        {
+            present_interval.add(std::chrono::duration<float, std::milli>(now - _last_present).count());
+        }
+
+        _last_present = now;
+        _presented = true;
+    }
+
+    void FramePacer::log_stats()
+    {
+        debug::log("Frame pacing: cpu p50 {:.2f} p95 {:.2f} p99 {:.2f} ms, gpu p50 {:.2f} p95 {:.2f} p99 {:.2f} ms, present p50 {:.2f} p95 {:.2f} p99 {:.2f} ms",
+                   cpu_frame.p50(), cpu_frame.p95(), cpu_frame.p99(), gpu_frame.p50(), gpu_frame.p95(), gpu_frame.p99(), present_interval.p50(), present_interval.p95(), present_interval.p99());
+    }
+}
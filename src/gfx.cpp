@@ -1,39 +1,370 @@
 #include <glad/glad.h>
 #include <glad/glad.c>
+#if !defined(__ANDROID__)
 #include <GL/gl.h>
+#endif
 #include <SDL2/SDL.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <regex>
 
 #include "debug.hpp"
 #include "gfx.hpp"
 
 namespace gfx
 {
-    void init()
+    static glid fragment_override = 0;
+    static Capabilities caps;
+    static Pipeline *current_pipeline = nullptr;
+    static ProgramPipeline *current_program_pipeline = nullptr; // Only while a combined fallback program is bound
+
+    struct DamageTracker
     {
-        if (!gladLoadGLLoader((GLADloadproc)SDL_GL_GetProcAddress))
+        bool enabled = false;
+        bool damaged = true; // Changed since the last frame
+        bool in_frame = false;
+        bool frame_changed = false; // Changed during the current frame
+        uint64_t signature = 0; // Hash of the current frame's command stream
+        uint64_t last_signature = 0;
+        std::unordered_map<uint32_t, uint64_t> states; // Hash of the last value of each fixed-function state
+    };
+
+    static DamageTracker damage;
+
+    static void note_change()
+    {
+        if (damage.in_frame)
         {
-            debug::log("Failed to initialize GLAD");
+            damage.frame_changed = true;
+        }
+        else
+        {
+            damage.damaged = true;
+        }
+    }
+
+    static void note_command(uint64_t a, uint64_t b = 0)
+    {
+        if (damage.enabled && damage.in_frame)
+        {
+            damage.signature = (damage.signature ^ a) * 1099511628211ull;
+            damage.signature = (damage.signature ^ b) * 1099511628211ull;
+        }
+    }
+
+    // Fixed-function state only damages when its value changes, so setting it every frame stays free
+    static void note_state(uint32_t state, const void *value, size_t size)
+    {
+        if (!damage.enabled)
+        {
+            return;
+        }
+
+        uint64_t hash = 14695981039346656037ull;
+
+        for (size_t i = 0; i < size; i++)
+        {
+            hash = (hash ^ ((const uint8_t *)value)[i]) * 1099511628211ull;
+        }
+
+        uint64_t &last = damage.states[state];
+
+        if (last != hash)
+        {
+            last = hash;
+            note_change();
+        }
+    }
+
+    static void note_uniform(glid location, const void *value, size_t size)
+    {
+        if (!damage.enabled)
+        {
+            return;
+        }
+
+        if (current_pipeline == nullptr)
+        {
+            note_change();
+            return;
+        }
+
+        std::vector<uint8_t> &cached = current_pipeline->_uniform_values[location];
+
+        if (cached.size() != size || std::memcmp(cached.data(), value, size) != 0)
+        {
+            cached.assign((const uint8_t *)value, (const uint8_t *)value + size);
+            note_change();
+        }
+    }
+
+    void set_render_on_demand(bool enable)
+    {
+        damage.enabled = enable;
+        damage.damaged = true;
+    }
+
+    void mark_damaged()
+    {
+        note_change();
+    }
+
+    bool begin_frame()
+    {
+        if (damage.enabled && !damage.damaged)
+        {
+            return false;
+        }
+
+        damage.in_frame = true;
+        damage.frame_changed = damage.damaged;
+        damage.damaged = false;
+        damage.signature = 14695981039346656037ull;
+        return true;
+    }
+
+    bool end_frame()
+    {
+        damage.in_frame = false;
+
+        bool changed = damage.frame_changed || damage.signature != damage.last_signature;
+        damage.last_signature = damage.signature;
+        return !damage.enabled || changed;
+    }
+
+    static GLint resolve_location(glid location)
+    {
+        if (current_program_pipeline != nullptr)
+        {
+            // Locations handed out by the active stage pipeline are indices into its names
+            auto it = current_program_pipeline->_locations.find(current_program_pipeline->_active);
+            return it != current_program_pipeline->_locations.end() && location < it->second.size() ? it->second[location] : -1;
+        }
+
+        if (fragment_override == 0 || current_pipeline == nullptr || current_pipeline->_override_program == 0)
+        {
+            return location; // No override, or its variant failed to link and the pipeline itself is bound
+        }
+
+        auto it = current_pipeline->_override_locations.find(location);
+        return it != current_pipeline->_override_locations.end() ? (GLint)it->second : -1;
+    }
+
+    static GLenum pixel_format(TextureFormat format)
+    {
+        switch (format)
+        {
+        case TextureFormat::R8:
+        case TextureFormat::R16F:
+        case TextureFormat::R32F:
+            return GL_RED;
+        case TextureFormat::R32UI:
+            return GL_RED_INTEGER;
+        case TextureFormat::Depth32F:
+            return GL_DEPTH_COMPONENT;
+        case TextureFormat::RGBA8:
+        case TextureFormat::RGBA16F:
+            return GL_RGBA;
+        case TextureFormat::R11FG11FB10F:
+            return GL_RGB;
+        default:
+            return (GLenum)format;
+        }
+    }
+
+    static GLenum pixel_type(TextureFormat format)
+    {
+        switch (format)
+        {
+        case TextureFormat::R16F:
+        case TextureFormat::R32F:
+        case TextureFormat::Depth32F:
+        case TextureFormat::RGBA16F:
+        case TextureFormat::R11FG11FB10F:
+            return GL_FLOAT;
+        case TextureFormat::R32UI:
+        case TextureFormat::Depth:
+            return GL_UNSIGNED_INT;
+        default:
+            return GL_UNSIGNED_BYTE;
+        }
+    }
+
+    void configure_context(Api api, int major, int minor)
+    {
+        const char *force = std::getenv("GFX_FORCE_GLES");
+
+        if (force != nullptr && std::strcmp(force, "0") != 0)
+        {
+            api = Api::OpenGLES;
+            major = 3;
+            minor = 2;
+        }
+
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, api == Api::OpenGLES ? SDL_GL_CONTEXT_PROFILE_ES : SDL_GL_CONTEXT_PROFILE_CORE);
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, major);
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, minor);
+    }
+
+    const Capabilities &capabilities()
+    {
+        return caps;
+    }
+
+    SimulationBackend simulation_backend()
+    {
+        return caps.compute ? SimulationBackend::Compute : SimulationBackend::TransformFeedback;
+    }
+
+    static bool at_least(int major, int minor)
+    {
+        return caps.major > major || (caps.major == major && caps.minor >= minor);
+    }
+
+    // The bundled loader stops at GL ES 3.0 and loads no extensions, newer entry points are loaded here.
+    // A capability is only set when every entry point it needs resolved.
+    template <typename T>
+    static bool load_entry(T &function, const char *name)
+    {
+        if (function == nullptr)
+        {
+            function = (T)SDL_GL_GetProcAddress(name);
+        }
+
+        return function != nullptr;
+    }
+
+    static void detect_capabilities()
+    {
+        GL_CALL(glGetIntegerv(GL_MAJOR_VERSION, &caps.major));
+        GL_CALL(glGetIntegerv(GL_MINOR_VERSION, &caps.minor));
+
+        const char *vendor = (const char *)glGetString(GL_VENDOR);
+        const char *renderer = (const char *)glGetString(GL_RENDERER);
+        caps.vendor = vendor != nullptr ? vendor : "";
+        caps.renderer = renderer != nullptr ? renderer : "";
+
+        bool gles = caps.api == Api::OpenGLES;
+
+        if (gles)
+        {
+            bool es31 = at_least(3, 1);
+
+            caps.direct_state_access = false;
+            caps.buffer_storage = has_extension("GL_EXT_buffer_storage") && load_entry(glad_glBufferStorage, "glBufferStorageEXT");
+            caps.compute = es31 && load_entry(glad_glDispatchCompute, "glDispatchCompute") &&
+                           load_entry(glad_glDispatchComputeIndirect, "glDispatchComputeIndirect") &&
+                           load_entry(glad_glMemoryBarrier, "glMemoryBarrier") && load_entry(glad_glBindImageTexture, "glBindImageTexture");
+            caps.geometry_shader = at_least(3, 2) || has_extension("GL_EXT_geometry_shader");
+            caps.layered_framebuffer = caps.geometry_shader && load_entry(glad_glFramebufferTexture, at_least(3, 2) ? "glFramebufferTexture" : "glFramebufferTextureEXT");
+            caps.timer_query = has_extension("GL_EXT_disjoint_timer_query") && load_entry(glad_glQueryCounter, "glQueryCounterEXT") &&
+                               load_entry(glad_glGetQueryObjectui64v, "glGetQueryObjectui64vEXT");
+            caps.indirect_draw = es31 && load_entry(glad_glDrawArraysIndirect, "glDrawArraysIndirect");
+            caps.program_interface_query = es31 && load_entry(glad_glGetProgramInterfaceiv, "glGetProgramInterfaceiv") &&
+                                           load_entry(glad_glGetProgramResourceiv, "glGetProgramResourceiv") &&
+                                           load_entry(glad_glGetProgramResourceName, "glGetProgramResourceName") &&
+                                           load_entry(glad_glProgramUniform1iv, "glProgramUniform1iv");
+            caps.separate_programs = es31 && load_entry(glad_glGenProgramPipelines, "glGenProgramPipelines") &&
+                                     load_entry(glad_glDeleteProgramPipelines, "glDeleteProgramPipelines") &&
+                                     load_entry(glad_glBindProgramPipeline, "glBindProgramPipeline") &&
+                                     load_entry(glad_glUseProgramStages, "glUseProgramStages") &&
+                                     load_entry(glad_glActiveShaderProgram, "glActiveShaderProgram");
+            caps.transform_feedback_objects = true;
+            caps.conditional_render = false;
+            caps.color_buffer_float = at_least(3, 2) || has_extension("GL_EXT_color_buffer_float");
+            caps.color_buffer_half_float = caps.color_buffer_float || has_extension("GL_EXT_color_buffer_half_float");
+            caps.float_blend = caps.color_buffer_float && has_extension("GL_EXT_float_blend");
         }
         else
         {
-            debug::log("GLAD initialized");
+            caps.direct_state_access = (at_least(4, 5) || has_extension("GL_ARB_direct_state_access")) &&
+                                       load_entry(glad_glCreateBuffers, "glCreateBuffers") &&
+                                       load_entry(glad_glNamedBufferData, "glNamedBufferData") &&
+                                       load_entry(glad_glNamedBufferSubData, "glNamedBufferSubData");
+            caps.buffer_storage = (at_least(4, 4) || has_extension("GL_ARB_buffer_storage")) && load_entry(glad_glBufferStorage, "glBufferStorage");
+            caps.compute = at_least(4, 3) && glad_glDispatchCompute != nullptr && glad_glDispatchComputeIndirect != nullptr &&
+                           glad_glMemoryBarrier != nullptr && glad_glBindImageTexture != nullptr;
+            caps.geometry_shader = at_least(3, 2);
+            caps.layered_framebuffer = at_least(3, 2) && glad_glFramebufferTexture != nullptr;
+            caps.timer_query = at_least(3, 3) && glad_glQueryCounter != nullptr && glad_glGetQueryObjectui64v != nullptr;
+            caps.indirect_draw = at_least(4, 0) && glad_glDrawArraysIndirect != nullptr;
+            caps.program_interface_query = at_least(4, 3) && glad_glGetProgramInterfaceiv != nullptr && glad_glGetProgramResourceiv != nullptr &&
+                                           glad_glGetProgramResourceName != nullptr && glad_glProgramUniform1iv != nullptr;
+            caps.separate_programs = at_least(4, 1) && glad_glGenProgramPipelines != nullptr && glad_glDeleteProgramPipelines != nullptr &&
+                                     glad_glBindProgramPipeline != nullptr && glad_glUseProgramStages != nullptr && glad_glActiveShaderProgram != nullptr;
+            caps.transform_feedback_objects = (at_least(4, 0) || has_extension("GL_ARB_transform_feedback2")) &&
+                                              load_entry(glad_glGenTransformFeedbacks, "glGenTransformFeedbacks") &&
+                                              load_entry(glad_glDeleteTransformFeedbacks, "glDeleteTransformFeedbacks") &&
+                                              load_entry(glad_glBindTransformFeedback, "glBindTransformFeedback");
+            caps.conditional_render = glad_glBeginConditionalRender != nullptr && glad_glEndConditionalRender != nullptr;
+            caps.color_buffer_half_float = true;
+            caps.color_buffer_float = true;
+            caps.float_blend = true;
+        }
+
+        caps.vertex_layer = has_extension("GL_ARB_shader_viewport_layer_array") || has_extension("GL_AMD_vertex_shader_layer") || has_extension("GL_NV_viewport_array2");
+
+        debug::log("{} {}.{} on {} ({}): dsa {}, buffer storage {}, compute {}, geometry {}, vertex layer {}, timer query {}, reflection {}, conditional render {}, float blend {}, float color buffers {}/{}",
+                   gles ? "OpenGL ES" : "OpenGL", caps.major, caps.minor, caps.renderer, caps.vendor, caps.direct_state_access,
+                   caps.buffer_storage, caps.compute, caps.geometry_shader, caps.vertex_layer, caps.timer_query,
+                   caps.program_interface_query, caps.conditional_render, caps.float_blend, caps.color_buffer_half_float, caps.color_buffer_float);
+    }
+
+    void init()
+    {
+        int profile = 0;
+        SDL_GL_GetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, &profile);
+        caps.api = profile == SDL_GL_CONTEXT_PROFILE_ES ? Api::OpenGLES : Api::OpenGL;
+
+        int loaded = caps.api == Api::OpenGLES ? gladLoadGLES2Loader((GLADloadproc)SDL_GL_GetProcAddress) : gladLoadGLLoader((GLADloadproc)SDL_GL_GetProcAddress);
+
+        if (!loaded)
+        {
+            debug::log("Failed to initialize GLAD");
+            return;
         }
+
+        debug::log("GLAD initialized");
+        detect_capabilities();
     }
 
     void clear_color(float r, float g, float b, float a)
     {
+        const float value[4] = {r, g, b, a};
+        note_state(GL_COLOR_CLEAR_VALUE, value, sizeof(value));
         GL_CALL(glClearColor(r, g, b, a));
     }
 
     void clear()
     {
+        note_command(GL_CLEAR);
         GL_CALL(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
     }
 
+    void finish()
+    {
+        GL_CALL(glFinish());
+    }
+
+    static RenderStats stats;
+
+    const RenderStats &render_stats()
+    {
+        return stats;
+    }
+
+    void reset_render_stats()
+    {
+        stats = RenderStats();
+    }
+
     void draw(size_t vertex_count, size_t instance_count, size_t first_vertex, size_t first_instance, PrimitiveType primitive_type)
     {
         const auto _type = (GLenum)primitive_type;
+        note_command(((uint64_t)_type << 32) | vertex_count, ((uint64_t)first_vertex << 32) | instance_count);
+        stats.draw_calls++;
         if (instance_count <= 1)
         {
             GL_CALL(glDrawArrays(_type, first_vertex, vertex_count));
@@ -46,16 +377,33 @@ namespace gfx
 
     void draw_instanced(size_t vertex_count, size_t instance_count, size_t first_vertex, size_t first_instance, PrimitiveType primitive_type)
     {
+        note_command(((uint64_t)primitive_type << 32) | vertex_count, ((uint64_t)first_vertex << 32) | instance_count);
+        stats.draw_calls++;
         GL_CALL(glDrawArraysInstanced((GLenum)primitive_type, first_vertex, vertex_count, instance_count));
     }
 
+    void memory_barrier(Barrier barriers)
+    {
+        GL_CALL(glMemoryBarrier((GLbitfield)barriers));
+    }
+
+    void dispatch(uint32_t groups_x, uint32_t groups_y, uint32_t groups_z)
+    {
+        note_command(((uint64_t)groups_x << 32) | groups_y, groups_z);
+        stats.dispatches++;
+        GL_CALL(glDispatchCompute(groups_x, groups_y, groups_z));
+    }
+
     void viewport(float x, float y, float width, float height)
     {
+        const float value[4] = {x, y, width, height};
+        note_state(GL_VIEWPORT, value, sizeof(value));
         glViewport(x, y, width, height);
     }
 
     void enable_depth_test(bool enable)
     {
+        note_state(GL_DEPTH_TEST, &enable, sizeof(enable));
         if (enable)
         {
             glEnable(GL_DEPTH_TEST);
@@ -68,6 +416,7 @@ namespace gfx
 
     void enable_backface_culling(bool enable)
     {
+        note_state(GL_CULL_FACE, &enable, sizeof(enable));
         if (enable)
         {
             glEnable(GL_CULL_FACE);
@@ -78,9 +427,21 @@ namespace gfx
         }
     }
 
+    bool backface_culling_enabled()
+    {
+        return glIsEnabled(GL_CULL_FACE) == GL_TRUE;
+    }
+
     void enable_blending(bool enable)
     {
-        if (enable)
+        const bool value[2] = {enable, fragment_override != 0};
+        note_state(GL_BLEND, value, sizeof(value));
+        if (fragment_override != 0)
+        {
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE);
+        }
+        else if (enable)
         {
             glEnable(GL_BLEND);
             glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -91,8 +452,102 @@ namespace gfx
         }
     }
 
+    void enable_scissor_test(bool enable)
+    {
+        note_state(GL_SCISSOR_TEST, &enable, sizeof(enable));
+        if (enable)
+        {
+            glEnable(GL_SCISSOR_TEST);
+        }
+        else
+        {
+            glDisable(GL_SCISSOR_TEST);
+        }
+    }
+
+    void scissor(int x, int y, int width, int height)
+    {
+        const int value[4] = {x, y, width, height};
+        note_state(GL_SCISSOR_BOX, value, sizeof(value));
+        GL_CALL(glScissor(x, y, width, height));
+    }
+
+    void enable_rasterizer_discard(bool enable)
+    {
+        if (enable)
+        {
+            GL_CALL(glEnable(GL_RASTERIZER_DISCARD));
+        }
+        else
+        {
+            GL_CALL(glDisable(GL_RASTERIZER_DISCARD));
+        }
+    }
+
+    void enable_color_write(bool enable)
+    {
+        note_state(GL_COLOR_WRITEMASK, &enable, sizeof(enable));
+        GL_CALL(glColorMask(enable, enable, enable, enable));
+    }
+
+    void enable_depth_write(bool enable)
+    {
+        note_state(GL_DEPTH_WRITEMASK, &enable, sizeof(enable));
+        GL_CALL(glDepthMask(enable));
+    }
+
+    bool has_extension(const char *name)
+    {
+        GLint count = 0;
+        GL_CALL(glGetIntegerv(GL_NUM_EXTENSIONS, &count));
+
+        for (GLint i = 0; i < count; i++)
+        {
+            const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+
+            if (extension != nullptr && std::strcmp(extension, name) == 0)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    TextureFormat renderable_format(TextureFormat format)
+    {
+        switch (format)
+        {
+        case TextureFormat::R32F:
+            return caps.color_buffer_float ? format : renderable_format(TextureFormat::R16F);
+        case TextureFormat::R11FG11FB10F:
+            return caps.color_buffer_float ? format : renderable_format(TextureFormat::RGBA16F);
+        case TextureFormat::R16F:
+            return caps.color_buffer_half_float ? format : TextureFormat::R8;
+        case TextureFormat::RGBA16F:
+            return caps.color_buffer_half_float ? format : TextureFormat::RGBA8;
+        default:
+            return format;
+        }
+    }
+
+    void depth_bias(float factor, float units)
+    {
+        const float value[2] = {factor, units};
+        note_state(GL_POLYGON_OFFSET_FILL, value, sizeof(value));
+        if (factor == 0.0f && units == 0.0f)
+        {
+            GL_CALL(glDisable(GL_POLYGON_OFFSET_FILL));
+            return;
+        }
+
+        GL_CALL(glEnable(GL_POLYGON_OFFSET_FILL));
+        GL_CALL(glPolygonOffset(factor, units));
+    }
+
     void unbind_framebuffer()
     {
+        note_command(GL_FRAMEBUFFER, 0);
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
     }
 
@@ -101,13 +556,96 @@ namespace gfx
         id = glCreateShader((GLenum)type);
     }
 
+    static uint32_t declared_binding(ResourceKind kind, const std::string &name);
+
+    // GLES can't rebind storage blocks or image uniforms after linking, so their binding is written into
+    // the declaration, taken from the registry by name like the bindings reflection assigns on desktop
+    static std::string declare_bindings(const std::string &text)
+    {
+        static const std::regex declaration(R"(layout\s*\(([^)]*)\)((?:\s*(?:readonly|writeonly|coherent|restrict|volatile))*\s*buffer\s+(\w+)|\s*uniform(?:\s+(?:readonly|writeonly|coherent|restrict|volatile))*\s+[iu]?image\w+\s+(\w+)))");
+
+        std::string out;
+        auto last = text.cbegin();
+
+        for (std::sregex_iterator it(text.begin(), text.end(), declaration), end; it != end; ++it)
+        {
+            const std::smatch &match = *it;
+            out.append(last, match[0].first);
+            last = match[0].second;
+
+            std::string qualifiers = match[1].str();
+
+            if (qualifiers.find("binding") != std::string::npos)
+            {
+                out += match[0].str();
+                continue;
+            }
+
+            bool block = match[3].matched;
+            uint32_t binding = declared_binding(block ? ResourceKind::StorageBlock : ResourceKind::Image, block ? match[3].str() : match[4].str());
+            out += "layout(" + qualifiers + ", binding = " + std::to_string(binding) + ")" + match[2].str();
+        }
+
+        out.append(last, text.cend());
+        return out;
+    }
+
+    // Desktop sources are written against #version 330 core or 430 core. On GLES the version line becomes
+    // the matching ES version, and default precisions follow the leading #extension and #define lines.
+    static std::string translate_source(const char *source)
+    {
+        std::string text = source;
+
+        if (caps.api != Api::OpenGLES || text.compare(0, 9, "#version ") != 0)
+        {
+            return text;
+        }
+
+        size_t line_end = text.find('\n');
+        int version = std::atoi(text.c_str() + 9);
+        bool core = text.compare(0, line_end, "#version " + std::to_string(version) + " core") == 0;
+
+        if (!core)
+        {
+            return text;
+        }
+
+        std::string es_version = version < 400 ? "300" : (at_least(3, 2) ? "320" : "310");
+        std::string precision = "precision highp float;\nprecision highp int;\nprecision highp sampler2DArray;\nprecision highp sampler2DShadow;\n";
+
+        if (es_version != "300")
+        {
+            precision += "precision highp image2D;\n";
+        }
+
+        size_t insert = line_end == std::string::npos ? text.size() : line_end + 1;
+
+        while (insert < text.size() && (text.compare(insert, 10, "#extension") == 0 || text.compare(insert, 7, "#define") == 0))
+        {
+            size_t next = text.find('\n', insert);
+            insert = next == std::string::npos ? text.size() : next + 1;
+        }
+
+        std::string body = text.substr(insert);
+
+        if (es_version != "300")
+        {
+            body = declare_bindings(body);
+        }
+
+        return "#version " + es_version + " es\n" + text.substr(line_end + 1, insert - line_end - 1) + precision + body;
+    }
+
     void ShaderModule::set_source(const char *source)
     {
-        GL_CALL(glShaderSource(id, 1, &source, NULL));
+        std::string translated = translate_source(source);
+        const char *text = translated.c_str();
+        GL_CALL(glShaderSource(id, 1, &text, NULL));
     }
 
     void ShaderModule::compile()
     {
+        stats.shader_compiles++;
         GL_CALL(glCompileShader(id));
 
         int success;
@@ -144,42 +682,65 @@ namespace gfx
 
     void Uniform::set_float(float value)
     {
-        GL_CALL(glUniform1f(id, value));
+        note_uniform(id, &value, sizeof(value));
+        GL_CALL(glUniform1f(resolve_location(id), value));
     }
 
     void Uniform::set_int(int value)
     {
-        GL_CALL(glUniform1i(id, value));
+        note_uniform(id, &value, sizeof(value));
+        GL_CALL(glUniform1i(resolve_location(id), value));
+    }
+
+    void Uniform::set_uint(uint32_t value)
+    {
+        note_uniform(id, &value, sizeof(value));
+        GL_CALL(glUniform1ui(resolve_location(id), value));
     }
 
     void Uniform::set_vec2(float x, float y)
     {
-        GL_CALL(glUniform2f(id, x, y));
+        const float value[2] = {x, y};
+        note_uniform(id, value, sizeof(value));
+        GL_CALL(glUniform2f(resolve_location(id), x, y));
     }
 
     void Uniform::set_vec3(float x, float y, float z)
     {
-        GL_CALL(glUniform3f(id, x, y, z));
+        const float value[3] = {x, y, z};
+        note_uniform(id, value, sizeof(value));
+        GL_CALL(glUniform3f(resolve_location(id), x, y, z));
     }
 
     void Uniform::set_vec4(float x, float y, float z, float w)
     {
-        GL_CALL(glUniform4f(id, x, y, z, w));
+        const float value[4] = {x, y, z, w};
+        note_uniform(id, value, sizeof(value));
+        GL_CALL(glUniform4f(resolve_location(id), x, y, z, w));
     }
 
     void Uniform::set_mat2(float *value)
     {
-        GL_CALL(glUniformMatrix2fv(id, 1, GL_FALSE, value));
+        note_uniform(id, value, sizeof(float) * 4);
+        GL_CALL(glUniformMatrix2fv(resolve_location(id), 1, GL_FALSE, value));
     }
 
     void Uniform::set_mat3(float *value)
     {
-        GL_CALL(glUniformMatrix3fv(id, 1, GL_FALSE, value));
+        note_uniform(id, value, sizeof(float) * 9);
+        GL_CALL(glUniformMatrix3fv(resolve_location(id), 1, GL_FALSE, value));
     }
 
     void Uniform::set_mat4(float *value)
     {
-        GL_CALL(glUniformMatrix4fv(id, 1, GL_FALSE, value));
+        note_uniform(id, value, sizeof(float) * 16);
+        GL_CALL(glUniformMatrix4fv(resolve_location(id), 1, GL_FALSE, value));
+    }
+
+    void Uniform::set_mat4_array(const float *values, size_t count)
+    {
+        note_uniform(id, values, sizeof(float) * 16 * count);
+        GL_CALL(glUniformMatrix4fv(resolve_location(id), (GLsizei)count, GL_FALSE, values));
     }
 
     Pipeline::Pipeline()
@@ -192,98 +753,1356 @@ namespace gfx
         GL_CALL(glAttachShader(id, shader.id));
     }
 
+    // A stage-only pipeline is never linked, its locations are indices into the names asked for so far
+    static glid stage_location(std::vector<std::string> &names, const char *name)
+    {
+        auto it = std::find(names.begin(), names.end(), name);
+
+        if (it != names.end())
+        {
+            return (glid)(it - names.begin());
+        }
+
+        names.push_back(name);
+        return (glid)(names.size() - 1);
+    }
+
     glid Pipeline::get_uniform_location(const char *name)
     {
+        if (_stage_only)
+        {
+            return stage_location(_uniform_names, name);
+        }
+
         return glGetUniformLocation(id, name);
     }
 
     Attribute Pipeline::get_attribute(const char *name)
     {
         Attribute attribute;
-        attribute.id = glGetAttribLocation(id, name);
+        attribute.id = _stage_only ? stage_location(_attribute_names, name) : glGetAttribLocation(id, name);
         return attribute;
     }
 
     Uniform Pipeline::get_uniform(const char *name)
     {
         Uniform uniform;
-        uniform.id = glGetUniformLocation(id, name);
+        uniform.id = get_uniform_location(name);
         return uniform;
     }
 
-    void Pipeline::link()
+    struct BindingRegistry
     {
-        GL_CALL(glLinkProgram(id));
+        std::unordered_map<std::string, uint32_t> bindings;
+        std::vector<bool> used; // Reserved, declared in a source or held by a live pipeline
+        std::vector<bool> reserved;
+        std::vector<uint32_t> users; // Live pipelines holding each binding point
+        GLint limit = 0;
+        bool initialized = false;
+    };
 
-        int success;
-        char infoLog[512];
+    static BindingRegistry binding_registries[4];
 
-        GL_CALL(glGetProgramiv(id, GL_LINK_STATUS, &success));
+    static BindingRegistry &registry(ResourceKind kind)
+    {
+        static const GLenum limits[4] = {GL_MAX_UNIFORM_BUFFER_BINDINGS, GL_MAX_SHADER_STORAGE_BUFFER_BINDINGS, GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, GL_MAX_IMAGE_UNITS};
+        BindingRegistry &registry = binding_registries[(uint32_t)kind];
 
-        if (!success)
+        if (!registry.initialized)
         {
-            GL_CALL(glGetProgramInfoLog(id, 512, NULL, infoLog));
-            debug::log("Pipeline linking failed: {}", std::string(infoLog));
+            registry.initialized = true;
+
+            // Storage blocks and image units arrive with compute, the limits are invalid enums before that
+            bool supported = caps.compute || kind == ResourceKind::UniformBlock || kind == ResourceKind::Sampler;
+
+            if (supported)
+            {
+                GL_CALL(glGetIntegerv(limits[(uint32_t)kind], &registry.limit));
+            }
+
+            registry.used.resize(std::max(registry.limit, 0), false);
+            registry.reserved.resize(registry.used.size(), false);
+            registry.users.resize(registry.used.size(), 0);
         }
+
+        return registry;
     }
 
-    void Pipeline::use()
+    void reserve_binding(ResourceKind kind, const std::string &name, uint32_t binding)
     {
-        GL_CALL(glUseProgram(id));
+        BindingRegistry &reg = registry(kind);
+        reg.bindings[name] = binding;
+
+        if (binding < reg.used.size())
+        {
+            reg.used[binding] = true;
+            reg.reserved[binding] = true;
+        }
     }
 
-    Pipeline::~Pipeline()
+    uint32_t get_binding(ResourceKind kind, const std::string &name)
     {
-        GL_CALL(glDeleteProgram(id));
+        BindingRegistry &reg = registry(kind);
+        auto it = reg.bindings.find(name);
+        return it != reg.bindings.end() ? it->second : UINT32_MAX;
     }
 
-    Buffer::Buffer(BufferType type)
+    static uint32_t declared_binding(ResourceKind kind, const std::string &name)
     {
-        this->type = type;
-        GL_CALL(glGenBuffers(1, &id));
+        BindingRegistry &reg = registry(kind);
+        auto it = reg.bindings.find(name);
+
+        if (it != reg.bindings.end())
+        {
+            return it->second;
+        }
+
+        for (uint32_t binding = 0; binding < reg.used.size(); binding++)
+        {
+            if (!reg.used[binding])
+            {
+                reg.used[binding] = true;
+                reg.bindings[name] = binding;
+                return binding;
+            }
+        }
+
+        debug::panic("Out of binding points for {}, the context has {}", name, reg.used.size());
+        return 0;
+    }
+
+    static bool range_free(const std::vector<bool> &taken, uint32_t first, uint32_t count)
+    {
+        if (first + count > taken.size())
+        {
+            return false;
+        }
+
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            if (taken[i])
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Prefer the binding the name got in other pipelines. Otherwise take a slot no other name uses, so two
+    // names never alias the same buffer or unit.
+    static uint32_t assign_binding(ResourceKind kind, const std::string &name, uint32_t count, std::vector<bool> &taken)
+    {
+        BindingRegistry &reg = registry(kind);
+        auto it = reg.bindings.find(name);
+
+        if (it != reg.bindings.end() && range_free(taken, it->second, count))
+        {
+            std::fill(taken.begin() + it->second, taken.begin() + it->second + count, true);
+            return it->second;
+        }
+
+        for (uint32_t first = 0; first + count <= reg.used.size(); first++)
+        {
+            if (range_free(reg.used, first, count) && range_free(taken, first, count))
+            {
+                std::fill(reg.used.begin() + first, reg.used.begin() + first + count, true);
+                std::fill(taken.begin() + first, taken.begin() + first + count, true);
+
+                if (it == reg.bindings.end())
+                {
+                    reg.bindings[name] = first;
+                }
+
+                return first;
+            }
+        }
+
+        debug::panic("Out of binding points for {}, the context has {}", name, reg.used.size());
+        return 0;
+    }
+
+    // Count the pipeline as a user of its binding points. Sources compiled on GLES carry their bindings,
+    // so a name whose binding was released meanwhile takes it back unless another name holds it.
+    static void acquire_bindings(const PipelineReflection &reflection)
+    {
+        for (const ShaderResource &resource : reflection.resources)
+        {
+            BindingRegistry &reg = registry(resource.kind);
+
+            if (!reg.bindings.contains(resource.name))
+            {
+                for (const auto &[name, binding] : reg.bindings)
+                {
+                    if (binding == resource.binding)
+                    {
+                        debug::panic("{} was compiled with binding {}, which {} now holds", resource.name, binding, name);
+                    }
+                }
+
+                reg.bindings[resource.name] = resource.binding;
+            }
+
+            for (uint32_t slot = resource.binding; slot < resource.binding + resource.count && slot < reg.users.size(); slot++)
+            {
+                reg.users[slot]++;
+                reg.used[slot] = true;
+            }
+        }
+    }
+
+    // Free the binding points no live pipeline holds any more, forgetting the names assigned to them
+    static void release_bindings(const PipelineReflection &reflection)
+    {
+        for (const ShaderResource &resource : reflection.resources)
+        {
+            BindingRegistry &reg = registry(resource.kind);
+
+            for (uint32_t slot = resource.binding; slot < resource.binding + resource.count && slot < reg.users.size(); slot++)
+            {
+                if (reg.users[slot] == 0 || --reg.users[slot] > 0 || reg.reserved[slot])
+                {
+                    continue;
+                }
+
+                reg.used[slot] = false;
+                std::erase_if(reg.bindings, [slot](const auto &entry) { return entry.second == slot; });
+            }
+        }
+    }
+
+    static bool is_sampler_type(GLenum type)
+    {
+        switch (type)
+        {
+        case GL_SAMPLER_1D:
+        case GL_SAMPLER_2D:
+        case GL_SAMPLER_3D:
+        case GL_SAMPLER_CUBE:
+        case GL_SAMPLER_2D_SHADOW:
+        case GL_SAMPLER_1D_ARRAY:
+        case GL_SAMPLER_2D_ARRAY:
+        case GL_SAMPLER_2D_ARRAY_SHADOW:
+        case GL_SAMPLER_CUBE_SHADOW:
+        case GL_SAMPLER_CUBE_MAP_ARRAY:
+        case GL_SAMPLER_CUBE_MAP_ARRAY_SHADOW:
+        case GL_SAMPLER_2D_MULTISAMPLE:
+        case GL_SAMPLER_BUFFER:
+        case GL_INT_SAMPLER_2D:
+        case GL_INT_SAMPLER_3D:
+        case GL_INT_SAMPLER_CUBE:
+        case GL_INT_SAMPLER_2D_ARRAY:
+        case GL_INT_SAMPLER_BUFFER:
+        case GL_UNSIGNED_INT_SAMPLER_2D:
+        case GL_UNSIGNED_INT_SAMPLER_3D:
+        case GL_UNSIGNED_INT_SAMPLER_CUBE:
+        case GL_UNSIGNED_INT_SAMPLER_2D_ARRAY:
+        case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    static bool is_image_type(GLenum type)
+    {
+        switch (type)
+        {
+        case GL_IMAGE_2D:
+        case GL_IMAGE_3D:
+        case GL_IMAGE_CUBE:
+        case GL_IMAGE_2D_ARRAY:
+        case GL_IMAGE_BUFFER:
+        case GL_INT_IMAGE_2D:
+        case GL_INT_IMAGE_3D:
+        case GL_INT_IMAGE_2D_ARRAY:
+        case GL_INT_IMAGE_BUFFER:
+        case GL_UNSIGNED_INT_IMAGE_2D:
+        case GL_UNSIGNED_INT_IMAGE_3D:
+        case GL_UNSIGNED_INT_IMAGE_2D_ARRAY:
+        case GL_UNSIGNED_INT_IMAGE_BUFFER:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    static std::string resource_name(glid program, GLenum interface, GLuint index)
+    {
+        char name[256];
+        GL_CALL(glGetProgramResourceName(program, interface, index, sizeof(name), NULL, name));
+        return std::string(name);
+    }
+
+    static void reflect_blocks(glid program, GLenum interface, GLenum member_interface, ResourceKind kind, PipelineReflection &reflection, std::vector<bool> &taken)
+    {
+        GLint count = 0;
+        GL_CALL(glGetProgramInterfaceiv(program, interface, GL_ACTIVE_RESOURCES, &count));
+
+        for (GLint i = 0; i < count; i++)
+        {
+            const GLenum block_props[2] = {GL_BUFFER_DATA_SIZE, GL_NUM_ACTIVE_VARIABLES};
+            GLint block_values[2];
+            GL_CALL(glGetProgramResourceiv(program, interface, i, 2, block_props, 2, NULL, block_values));
+
+            ShaderResource resource;
+            resource.name = resource_name(program, interface, i);
+            resource.kind = kind;
+            resource.data_size = block_values[0];
+
+            std::vector<GLint> variables(block_values[1]);
+            if (!variables.empty())
+            {
+                const GLenum active_props[1] = {GL_ACTIVE_VARIABLES};
+                GL_CALL(glGetProgramResourceiv(program, interface, i, 1, active_props, variables.size(), NULL, variables.data()));
+            }
+
+            for (GLint variable : variables)
+            {
+                const GLenum member_props[5] = {GL_TYPE, GL_OFFSET, GL_ARRAY_SIZE, GL_ARRAY_STRIDE, GL_MATRIX_STRIDE};
+                GLint values[5];
+                GL_CALL(glGetProgramResourceiv(program, member_interface, variable, 5, member_props, 5, NULL, values));
+
+                BlockMember member;
+                member.name = resource_name(program, member_interface, variable);
+                member.type = values[0];
+                member.offset = values[1];
+                member.array_size = values[2];
+                member.array_stride = values[3];
+                member.matrix_stride = values[4];
+                resource.members.push_back(member);
+            }
+
+            if (kind == ResourceKind::StorageBlock && glad_glShaderStorageBlockBinding == nullptr)
+            {
+                // GLES, the binding was declared in the source
+                const GLenum binding_prop[1] = {GL_BUFFER_BINDING};
+                GLint binding = 0;
+                GL_CALL(glGetProgramResourceiv(program, interface, i, 1, binding_prop, 1, NULL, &binding));
+                resource.binding = binding;
+                reflection.resources.push_back(resource);
+                continue;
+            }
+
+            resource.binding = assign_binding(kind, resource.name, 1, taken);
+
+            if (kind == ResourceKind::UniformBlock)
+            {
+                GL_CALL(glUniformBlockBinding(program, i, resource.binding));
+            }
+            else
+            {
+                GL_CALL(glShaderStorageBlockBinding(program, i, resource.binding));
+            }
+
+            reflection.resources.push_back(resource);
+        }
+    }
+
+    static void assign_units(glid program, GLint location, const std::vector<GLint> &units)
+    {
+        if (caps.program_interface_query)
+        {
+            GL_CALL(glProgramUniform1iv(program, location, units.size(), units.data()));
+            return;
+        }
+
+        // No separate program uniforms before GL 4.1 / ES 3.1, set them through the program in use
+        GLint previous = 0;
+        GL_CALL(glGetIntegerv(GL_CURRENT_PROGRAM, &previous));
+        GL_CALL(glUseProgram(program));
+        GL_CALL(glUniform1iv(location, units.size(), units.data()));
+
+        // A program deleted while in use is freed once replaced, it can't be made current again
+        GL_CALL(glUseProgram(glIsProgram(previous) ? previous : 0));
+    }
+
+    static void reflect_sampler(glid program, std::string name, GLenum type, GLint location, GLint size, PipelineReflection &reflection, std::vector<bool> &texture_units, std::vector<bool> &image_units)
+    {
+        if (name.ends_with("[0]"))
+        {
+            name.resize(name.size() - 3);
+        }
+
+        ShaderResource resource;
+        resource.name = name;
+        resource.kind = is_sampler_type(type) ? ResourceKind::Sampler : ResourceKind::Image;
+        resource.count = size;
+
+        if (resource.kind == ResourceKind::Image && caps.api == Api::OpenGLES)
+        {
+            // GLES, the unit was declared in the source and image uniforms are read-only
+            GLint unit = 0;
+            GL_CALL(glGetUniformiv(program, location, &unit));
+            resource.binding = unit;
+            reflection.resources.push_back(resource);
+            return;
+        }
+
+        resource.binding = assign_binding(resource.kind, name, resource.count, resource.kind == ResourceKind::Sampler ? texture_units : image_units);
+
+        std::vector<GLint> units(resource.count);
+        for (uint32_t unit = 0; unit < resource.count; unit++)
+        {
+            units[unit] = resource.binding + unit;
+        }
+
+        assign_units(program, location, units);
+        reflection.resources.push_back(resource);
+    }
+
+    // GL 3.3 / ES 3.0 path: uniform blocks and the default block through the active uniform queries
+    static void reflect_program_legacy(glid id, PipelineReflection &reflection, std::vector<bool> &uniform_blocks, std::vector<bool> &texture_units, std::vector<bool> &image_units)
+    {
+        char name[256];
+        GLint block_count = 0;
+        GL_CALL(glGetProgramiv(id, GL_ACTIVE_UNIFORM_BLOCKS, &block_count));
+
+        for (GLint i = 0; i < block_count; i++)
+        {
+            GLint data_size = 0;
+            GLint member_count = 0;
+            GL_CALL(glGetActiveUniformBlockName(id, i, sizeof(name), NULL, name));
+            GL_CALL(glGetActiveUniformBlockiv(id, i, GL_UNIFORM_BLOCK_DATA_SIZE, &data_size));
+            GL_CALL(glGetActiveUniformBlockiv(id, i, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, &member_count));
+
+            ShaderResource resource;
+            resource.name = name;
+            resource.kind = ResourceKind::UniformBlock;
+            resource.data_size = data_size;
+
+            std::vector<GLint> indices(member_count);
+            if (!indices.empty())
+            {
+                GL_CALL(glGetActiveUniformBlockiv(id, i, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES, indices.data()));
+            }
+
+            for (GLint index : indices)
+            {
+                GLuint uniform = (GLuint)index;
+                GLint values[4];
+                GL_CALL(glGetActiveUniformsiv(id, 1, &uniform, GL_UNIFORM_OFFSET, &values[0]));
+                GL_CALL(glGetActiveUniformsiv(id, 1, &uniform, GL_UNIFORM_ARRAY_STRIDE, &values[1]));
+                GL_CALL(glGetActiveUniformsiv(id, 1, &uniform, GL_UNIFORM_MATRIX_STRIDE, &values[2]));
+
+                GLint size;
+                GLenum type;
+                GL_CALL(glGetActiveUniform(id, uniform, sizeof(name), NULL, &size, &type, name));
+
+                BlockMember member;
+                member.name = name;
+                member.type = type;
+                member.offset = values[0];
+                member.array_size = size;
+                member.array_stride = values[1];
+                member.matrix_stride = values[2];
+                resource.members.push_back(member);
+            }
+
+            resource.binding = assign_binding(ResourceKind::UniformBlock, resource.name, 1, uniform_blocks);
+            GL_CALL(glUniformBlockBinding(id, i, resource.binding));
+            reflection.resources.push_back(resource);
+        }
+
+        GLint count = 0;
+        GL_CALL(glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count));
+
+        for (GLint i = 0; i < count; i++)
+        {
+            GLuint uniform = (GLuint)i;
+            GLint block = -1;
+            GL_CALL(glGetActiveUniformsiv(id, 1, &uniform, GL_UNIFORM_BLOCK_INDEX, &block));
+
+            if (block != -1)
+            {
+                continue; // Member of a uniform block
+            }
+
+            GLint size;
+            GLenum type;
+            GL_CALL(glGetActiveUniform(id, uniform, sizeof(name), NULL, &size, &type, name));
+            GLint location = glGetUniformLocation(id, name);
+
+            if (!is_sampler_type(type) && !is_image_type(type))
+            {
+                reflection.uniforms.push_back(UniformInfo{name, type, (uint32_t)location, (uint32_t)size});
+                continue;
+            }
+
+            reflect_sampler(id, name, type, location, size, reflection, texture_units, image_units);
+        }
+    }
+
+    static void reflect_program(glid id, PipelineReflection &reflection)
+    {
+        std::vector<bool> uniform_blocks(registry(ResourceKind::UniformBlock).used.size(), false);
+        std::vector<bool> storage_blocks(registry(ResourceKind::StorageBlock).used.size(), false);
+        std::vector<bool> texture_units(registry(ResourceKind::Sampler).used.size(), false);
+        std::vector<bool> image_units(registry(ResourceKind::Image).used.size(), false);
+
+        if (!caps.program_interface_query)
+        {
+            reflect_program_legacy(id, reflection, uniform_blocks, texture_units, image_units);
+            return;
+        }
+
+        reflect_blocks(id, GL_UNIFORM_BLOCK, GL_UNIFORM, ResourceKind::UniformBlock, reflection, uniform_blocks);
+        reflect_blocks(id, GL_SHADER_STORAGE_BLOCK, GL_BUFFER_VARIABLE, ResourceKind::StorageBlock, reflection, storage_blocks);
+
+        GLint count = 0;
+        GL_CALL(glGetProgramInterfaceiv(id, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count));
+
+        for (GLint i = 0; i < count; i++)
+        {
+            const GLenum props[4] = {GL_BLOCK_INDEX, GL_TYPE, GL_LOCATION, GL_ARRAY_SIZE};
+            GLint values[4];
+            GL_CALL(glGetProgramResourceiv(id, GL_UNIFORM, i, 4, props, 4, NULL, values));
+
+            if (values[0] != -1)
+            {
+                continue; // Member of a uniform block
+            }
+
+            std::string name = resource_name(id, GL_UNIFORM, i);
+            GLenum type = values[1];
+
+            if (!is_sampler_type(type) && !is_image_type(type))
+            {
+                reflection.uniforms.push_back(UniformInfo{name, type, (uint32_t)values[2], (uint32_t)values[3]});
+                continue;
+            }
+
+            reflect_sampler(id, name, type, values[2], values[3], reflection, texture_units, image_units);
+        }
+    }
+
+    void Pipeline::_reflect()
+    {
+        release_bindings(reflection);
+        reflection = PipelineReflection();
+        reflect_program(id, reflection);
+        acquire_bindings(reflection);
+    }
+
+    const ShaderResource *PipelineReflection::find_resource(const std::string &name) const
+    {
+        for (const ShaderResource &resource : resources)
+        {
+            if (resource.name == name)
+            {
+                return &resource;
+            }
+        }
+
+        return nullptr;
+    }
+
+    const UniformInfo *PipelineReflection::find_uniform(const std::string &name) const
+    {
+        for (const UniformInfo &uniform : uniforms)
+        {
+            if (uniform.name == name)
+            {
+                return &uniform;
+            }
+        }
+
+        return nullptr;
+    }
+
+    void Pipeline::set_separable(bool separable)
+    {
+        if (!caps.separate_programs)
+        {
+            // Kept as shaders only, ProgramPipeline links the stages it takes into one program
+            debug::log("Separable pipelines need GL 4.1 or ES 3.1, this context has {}.{}, stages are combined at bind", caps.major, caps.minor);
+            _stage_only = separable;
+            return;
+        }
+
+        GL_CALL(glProgramParameteri(id, GL_PROGRAM_SEPARABLE, separable ? GL_TRUE : GL_FALSE));
+    }
+
+    void Pipeline::set_feedback_varyings(const std::vector<std::string> &varyings)
+    {
+        std::vector<const char *> names;
+
+        for (auto &varying : varyings)
+        {
+            names.push_back(varying.c_str());
+        }
+
+        GL_CALL(glTransformFeedbackVaryings(id, (GLsizei)names.size(), names.data(), GL_INTERLEAVED_ATTRIBS));
+    }
+
+    void Pipeline::link()
+    {
+        if (_stage_only)
+        {
+            return; // A single stage may not link on its own, e.g. on ES 3.0
+        }
+
+        stats.pipeline_links++;
+        GL_CALL(glLinkProgram(id));
+
+        int success;
+        char infoLog[512];
+
+        GL_CALL(glGetProgramiv(id, GL_LINK_STATUS, &success));
+
+        if (!success)
+        {
+            GL_CALL(glGetProgramInfoLog(id, 512, NULL, infoLog));
+            debug::log("Pipeline linking failed: {}", std::string(infoLog));
+            return;
+        }
+
+        _reflect();
+    }
+
+    void Pipeline::use()
+    {
+        current_pipeline = this;
+        current_program_pipeline = nullptr;
+        note_command(GL_PROGRAM, id);
+
+        if (fragment_override != 0)
+        {
+            _link_override();
+            GL_CALL(glUseProgram(_override_program != 0 ? _override_program : id));
+            return;
+        }
+
+        GL_CALL(glUseProgram(id));
+    }
+
+    Pipeline::~Pipeline()
+    {
+        if (current_pipeline == this)
+        {
+            current_pipeline = nullptr;
+        }
+
+        if (_override_program != 0)
+        {
+            GL_CALL(glDeleteProgram(_override_program));
+        }
+
+        release_bindings(reflection);
+        GL_CALL(glDeleteProgram(id));
+    }
+
+    // Write the value a uniform has in one program to a location of the program in use, samplers and images excluded
+    static void copy_uniform(glid from, GLint from_location, GLint to_location, GLenum type)
+    {
+        GLfloat f[16];
+        GLint i[4];
+        GLuint u[4];
+
+        switch (type)
+        {
+        case GL_FLOAT:
+        case GL_FLOAT_VEC2:
+        case GL_FLOAT_VEC3:
+        case GL_FLOAT_VEC4:
+            GL_CALL(glGetUniformfv(from, from_location, f));
+            break;
+        case GL_INT:
+        case GL_INT_VEC2:
+        case GL_INT_VEC3:
+        case GL_INT_VEC4:
+        case GL_BOOL:
+        case GL_BOOL_VEC2:
+        case GL_BOOL_VEC3:
+        case GL_BOOL_VEC4:
+            GL_CALL(glGetUniformiv(from, from_location, i));
+            break;
+        case GL_UNSIGNED_INT:
+        case GL_UNSIGNED_INT_VEC2:
+        case GL_UNSIGNED_INT_VEC3:
+        case GL_UNSIGNED_INT_VEC4:
+            GL_CALL(glGetUniformuiv(from, from_location, u));
+            break;
+        default:
+            GL_CALL(glGetUniformfv(from, from_location, f)); // Matrices
+            break;
+        }
+
+        switch (type)
+        {
+        case GL_FLOAT:
+            GL_CALL(glUniform1fv(to_location, 1, f));
+            break;
+        case GL_FLOAT_VEC2:
+            GL_CALL(glUniform2fv(to_location, 1, f));
+            break;
+        case GL_FLOAT_VEC3:
+            GL_CALL(glUniform3fv(to_location, 1, f));
+            break;
+        case GL_FLOAT_VEC4:
+            GL_CALL(glUniform4fv(to_location, 1, f));
+            break;
+        case GL_INT:
+        case GL_BOOL:
+            GL_CALL(glUniform1iv(to_location, 1, i));
+            break;
+        case GL_INT_VEC2:
+        case GL_BOOL_VEC2:
+            GL_CALL(glUniform2iv(to_location, 1, i));
+            break;
+        case GL_INT_VEC3:
+        case GL_BOOL_VEC3:
+            GL_CALL(glUniform3iv(to_location, 1, i));
+            break;
+        case GL_INT_VEC4:
+        case GL_BOOL_VEC4:
+            GL_CALL(glUniform4iv(to_location, 1, i));
+            break;
+        case GL_UNSIGNED_INT:
+            GL_CALL(glUniform1uiv(to_location, 1, u));
+            break;
+        case GL_UNSIGNED_INT_VEC2:
+            GL_CALL(glUniform2uiv(to_location, 1, u));
+            break;
+        case GL_UNSIGNED_INT_VEC3:
+            GL_CALL(glUniform3uiv(to_location, 1, u));
+            break;
+        case GL_UNSIGNED_INT_VEC4:
+            GL_CALL(glUniform4uiv(to_location, 1, u));
+            break;
+        case GL_FLOAT_MAT2:
+            GL_CALL(glUniformMatrix2fv(to_location, 1, GL_FALSE, f));
+            break;
+        case GL_FLOAT_MAT3:
+            GL_CALL(glUniformMatrix3fv(to_location, 1, GL_FALSE, f));
+            break;
+        case GL_FLOAT_MAT4:
+            GL_CALL(glUniformMatrix4fv(to_location, 1, GL_FALSE, f));
+            break;
+        case GL_FLOAT_MAT2x3:
+            GL_CALL(glUniformMatrix2x3fv(to_location, 1, GL_FALSE, f));
+            break;
+        case GL_FLOAT_MAT2x4:
+            GL_CALL(glUniformMatrix2x4fv(to_location, 1, GL_FALSE, f));
+            break;
+        case GL_FLOAT_MAT3x2:
+            GL_CALL(glUniformMatrix3x2fv(to_location, 1, GL_FALSE, f));
+            break;
+        case GL_FLOAT_MAT3x4:
+            GL_CALL(glUniformMatrix3x4fv(to_location, 1, GL_FALSE, f));
+            break;
+        case GL_FLOAT_MAT4x2:
+            GL_CALL(glUniformMatrix4x2fv(to_location, 1, GL_FALSE, f));
+            break;
+        case GL_FLOAT_MAT4x3:
+            GL_CALL(glUniformMatrix4x3fv(to_location, 1, GL_FALSE, f));
+            break;
+        }
+    }
+
+    void Pipeline::_link_override()
+    {
+        if (_override_shader == fragment_override)
+        {
+            return;
+        }
+
+        if (_override_program != 0)
+        {
+            GL_CALL(glDeleteProgram(_override_program));
+        }
+
+        _override_program = glCreateProgram();
+        _override_shader = fragment_override;
+        _override_locations.clear();
+
+        // Shaders flagged for deletion stay alive while attached, so the original stages can be reused
+        GLuint shaders[8];
+        GLsizei count = 0;
+        GL_CALL(glGetAttachedShaders(id, 8, &count, shaders));
+
+        for (GLsizei i = 0; i < count; i++)
+        {
+            GLint type;
+            GL_CALL(glGetShaderiv(shaders[i], GL_SHADER_TYPE, &type));
+
+            if (type != GL_FRAGMENT_SHADER)
+            {
+                GL_CALL(glAttachShader(_override_program, shaders[i]));
+            }
+        }
+
+        GL_CALL(glAttachShader(_override_program, fragment_override));
+
+        char name[256];
+        GLint active = 0;
+
+        // Keep the attribute locations the vertex arrays were set up with
+        GL_CALL(glGetProgramiv(id, GL_ACTIVE_ATTRIBUTES, &active));
+        for (GLint i = 0; i < active; i++)
+        {
+            GLint size;
+            GLenum type;
+            GL_CALL(glGetActiveAttrib(id, i, sizeof(name), NULL, &size, &type, name));
+            GLint location = glGetAttribLocation(id, name);
+
+            if (location >= 0)
+            {
+                GL_CALL(glBindAttribLocation(_override_program, location, name));
+            }
+        }
+
+        GL_CALL(glLinkProgram(_override_program));
+
+        int success;
+        GL_CALL(glGetProgramiv(_override_program, GL_LINK_STATUS, &success));
+
+        if (!success)
+        {
+            char infoLog[512];
+            GL_CALL(glGetProgramInfoLog(_override_program, 512, NULL, infoLog));
+            debug::log("Pipeline override linking failed: {}", std::string(infoLog));
+
+            // use() keeps binding the pipeline itself until the override changes
+            GL_CALL(glDeleteProgram(_override_program));
+            _override_program = 0;
+            return;
+        }
+
+        PipelineReflection variant;
+        reflect_program(_override_program, variant); // Same names, so the same binding points
+
+        // The uniforms are set through the program in use
+        GLint previous = 0;
+        GL_CALL(glGetIntegerv(GL_CURRENT_PROGRAM, &previous));
+        GL_CALL(glUseProgram(_override_program));
+
+        // Map the uniform locations handed out by get_uniform to the ones of the variant and carry their values over
+        GL_CALL(glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &active));
+        for (GLint i = 0; i < active; i++)
+        {
+            GLint size;
+            GLenum type;
+            GL_CALL(glGetActiveUniform(id, i, sizeof(name), NULL, &size, &type, name));
+
+            std::string base(name);
+            if (base.size() > 3 && base.ends_with("[0]"))
+            {
+                base.resize(base.size() - 3);
+            }
+
+            for (GLint element = 0; element < size; element++)
+            {
+                std::string element_name = size > 1 ? base + "[" + std::to_string(element) + "]" : std::string(name);
+                GLint location = glGetUniformLocation(id, element_name.c_str());
+
+                if (location < 0)
+                {
+                    continue;
+                }
+
+                GLint variant_location = glGetUniformLocation(_override_program, element_name.c_str());
+                _override_locations[location] = variant_location;
+
+                if (variant_location >= 0 && !is_sampler_type(type) && !is_image_type(type))
+                {
+                    copy_uniform(id, location, variant_location, type);
+                }
+            }
+        }
+
+        // A program deleted while in use is freed once replaced, it can't be made current again
+        GL_CALL(glUseProgram(glIsProgram(previous) ? previous : 0));
+    }
+
+    ProgramPipeline::ProgramPipeline()
+    {
+        if (caps.separate_programs)
+        {
+            GL_CALL(glGenProgramPipelines(1, &id));
+        }
+    }
+
+    ProgramPipeline::~ProgramPipeline()
+    {
+        if (current_program_pipeline == this)
+        {
+            current_program_pipeline = nullptr;
+        }
+
+        _unlink();
+
+        if (id != 0)
+        {
+            GL_CALL(glDeleteProgramPipelines(1, &id));
+        }
+    }
+
+    void ProgramPipeline::use_stages(ShaderStage stages, const Pipeline &pipeline)
+    {
+        if (id == 0)
+        {
+            // Later stages replace the same stages taken from earlier pipelines, as glUseProgramStages does
+            std::erase_if(_stages, [&](auto &stage)
+                          {
+                              stage.first &= ~(uint32_t)stages;
+                              return stage.first == 0;
+                          });
+
+            _stages.push_back({(uint32_t)stages, &pipeline});
+            _unlink();
+            return;
+        }
+
+        GL_CALL(glUseProgramStages(id, (GLbitfield)stages, pipeline.id));
+    }
+
+    void ProgramPipeline::set_active(const Pipeline &pipeline)
+    {
+        if (id == 0)
+        {
+            _active = &pipeline;
+            return;
+        }
+
+        GL_CALL(glActiveShaderProgram(id, pipeline.id));
+    }
+
+    void ProgramPipeline::bind()
+    {
+        current_pipeline = nullptr; // Fragment overrides only apply to monolithic pipelines
+
+        if (id == 0)
+        {
+            _link();
+            note_command(GL_PROGRAM, _combined);
+            current_program_pipeline = this;
+            GL_CALL(glUseProgram(_linked ? _combined : 0));
+            return;
+        }
+
+        note_command(GL_PROGRAM_PIPELINE, id);
+        current_program_pipeline = nullptr;
+        GL_CALL(glUseProgram(0)); // A bound program takes precedence over the program pipeline
+        GL_CALL(glBindProgramPipeline(id));
+    }
+
+    void ProgramPipeline::unbind()
+    {
+        if (id == 0)
+        {
+            current_program_pipeline = nullptr;
+            GL_CALL(glUseProgram(0));
+            return;
+        }
+
+        GL_CALL(glBindProgramPipeline(0));
+    }
+
+    static uint32_t stage_bit(GLint type)
+    {
+        switch (type)
+        {
+        case GL_VERTEX_SHADER:
+            return (uint32_t)ShaderStage::Vertex;
+        case GL_FRAGMENT_SHADER:
+            return (uint32_t)ShaderStage::Fragment;
+        case GL_GEOMETRY_SHADER:
+            return (uint32_t)ShaderStage::Geometry;
+        case GL_TESS_CONTROL_SHADER:
+            return (uint32_t)ShaderStage::TessControl;
+        case GL_TESS_EVALUATION_SHADER:
+            return (uint32_t)ShaderStage::TessEvaluation;
+        case GL_COMPUTE_SHADER:
+            return (uint32_t)ShaderStage::Compute;
+        }
+
+        return 0;
+    }
+
+    void ProgramPipeline::_link()
+    {
+        if (_combined != 0)
+        {
+            return;
+        }
+
+        _combined = glCreateProgram();
+
+        for (auto &[stages, pipeline] : _stages)
+        {
+            GLuint shaders[8];
+            GLsizei count = 0;
+            GL_CALL(glGetAttachedShaders(pipeline->id, 8, &count, shaders));
+
+            for (GLsizei i = 0; i < count; i++)
+            {
+                GLint type;
+                GL_CALL(glGetShaderiv(shaders[i], GL_SHADER_TYPE, &type));
+
+                if ((stage_bit(type) & stages) != 0)
+                {
+                    GL_CALL(glAttachShader(_combined, shaders[i]));
+                }
+            }
+
+            // Attribute locations handed out by the vertex stage pipeline
+            for (size_t i = 0; i < pipeline->_attribute_names.size(); i++)
+            {
+                GL_CALL(glBindAttribLocation(_combined, (GLuint)i, pipeline->_attribute_names[i].c_str()));
+            }
+        }
+
+        stats.pipeline_links++;
+        GL_CALL(glLinkProgram(_combined));
+
+        int success;
+        GL_CALL(glGetProgramiv(_combined, GL_LINK_STATUS, &success));
+        _linked = success;
+
+        if (!success)
+        {
+            char infoLog[512];
+            GL_CALL(glGetProgramInfoLog(_combined, 512, NULL, infoLog));
+            debug::log("Program pipeline linking failed: {}", std::string(infoLog));
+            return;
+        }
+
+        reflect_program(_combined, _reflection);
+        acquire_bindings(_reflection);
+
+        for (auto &[stages, pipeline] : _stages)
+        {
+            std::vector<int32_t> &locations = _locations[pipeline];
+            locations.clear();
+
+            for (const std::string &name : pipeline->_uniform_names)
+            {
+                locations.push_back(glGetUniformLocation(_combined, name.c_str()));
+            }
+        }
+    }
+
+    void ProgramPipeline::_unlink()
+    {
+        if (_combined == 0)
+        {
+            return;
+        }
+
+        release_bindings(_reflection);
+        _reflection = PipelineReflection();
+        _locations.clear();
+        GL_CALL(glDeleteProgram(_combined));
+        _combined = 0;
+        _linked = false;
+    }
+
+    void set_fragment_override(const ShaderModule *shader)
+    {
+        fragment_override = shader != nullptr ? shader->id : 0;
+
+        if (current_pipeline != nullptr)
+        {
+            current_pipeline->use();
+        }
+    }
+
+    Buffer::Buffer(BufferType type)
+    {
+        this->type = type;
+
+        if (caps.direct_state_access)
+        {
+            GL_CALL(glCreateBuffers(1, &id));
+        }
+        else
+        {
+            GL_CALL(glGenBuffers(1, &id));
+        }
+    }
+
+    Buffer::~Buffer()
+    {
+        GL_CALL(glDeleteBuffers(1, &id));
+    }
+
+    void Buffer::bind()
+    {
+        GL_CALL(glBindBuffer((GLenum)type, id));
+    }
+
+    void Buffer::unbind()
+    {
+        GL_CALL(glBindBuffer((GLenum)type, 0));
+    }
+
+    void Buffer::set_data(const void *data, size_t size, BufferUsage usage)
+    {
+        note_change();
+        stats.buffer_upload_bytes += data != nullptr ? size : 0;
+
+        if (caps.direct_state_access)
+        {
+            GL_CALL(glNamedBufferData(id, size, data, (GLenum)usage));
+            return;
+        }
+
+        this->bind();
+        GL_CALL(glBufferData((GLenum)type, size, data, (GLenum)usage));
+        this->unbind();
+    }
+
+    void Buffer::set_sub_data(const void *data, size_t size, size_t offset)
+    {
+        note_change();
+        stats.buffer_upload_bytes += size;
+
+        if (caps.direct_state_access)
+        {
+            GL_CALL(glNamedBufferSubData(id, offset, size, data));
+            return;
+        }
+
+        this->bind();
+        GL_CALL(glBufferSubData((GLenum)type, offset, size, data));
+        this->unbind();
+    }
+
+    void Buffer::map()
+    {
+        bind();
+        data = glMapBufferRange((GLenum)type, 0, 0, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    }
+
+    void Buffer::unmap()
+    {
+        note_change();
+        bind();
+        GL_CALL(glUnmapBuffer((GLenum)type));
+        data = nullptr;
+        unbind();
+    }
+
+    void Buffer::copy_from(Buffer &source, size_t size, size_t source_offset, size_t offset)
+    {
+        note_change();
+        GL_CALL(glBindBuffer(GL_COPY_READ_BUFFER, source.id));
+        GL_CALL(glBindBuffer(GL_COPY_WRITE_BUFFER, id));
+        GL_CALL(glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, source_offset, offset, size));
+        GL_CALL(glBindBuffer(GL_COPY_READ_BUFFER, 0));
+        GL_CALL(glBindBuffer(GL_COPY_WRITE_BUFFER, 0));
+    }
+
+    void Buffer::bind_base(uint32_t binding)
+    {
+        GL_CALL(glBindBufferBase((GLenum)type, binding, id));
+    }
+
+    void Buffer::bind_range(uint32_t binding, size_t offset, size_t size)
+    {
+        GL_CALL(glBindBufferRange((GLenum)type, binding, id, offset, size));
+    }
+
+    void bind_buffer(const std::string &name, Buffer &buffer)
+    {
+        ResourceKind kind = buffer.type == BufferType::ShaderStorage ? ResourceKind::StorageBlock : ResourceKind::UniformBlock;
+        uint32_t binding = get_binding(kind, name);
+
+        if (binding == UINT32_MAX)
+        {
+            debug::log("No pipeline declares the block {}", name);
+            return;
+        }
+
+        buffer.bind_base(binding);
+    }
+
+    void draw_indirect(Buffer &buffer, size_t offset, PrimitiveType primitive_type)
+    {
+        note_command(GL_DRAW_INDIRECT_BUFFER, ((uint64_t)buffer.id << 32) | offset);
+        stats.draw_calls++;
+        GL_CALL(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer.id));
+        GL_CALL(glDrawArraysIndirect((GLenum)primitive_type, (const void *)offset));
+        GL_CALL(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0));
     }
 
-    Buffer::~Buffer()
+    void dispatch_indirect(Buffer &buffer, size_t offset)
     {
-        GL_CALL(glDeleteBuffers(1, &id));
+        note_command(GL_DISPATCH_INDIRECT_BUFFER, ((uint64_t)buffer.id << 32) | offset);
+        stats.dispatches++;
+        GL_CALL(glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, buffer.id));
+        GL_CALL(glDispatchComputeIndirect(offset));
+        GL_CALL(glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0));
     }
 
-    void Buffer::bind()
+    TransformFeedback::TransformFeedback()
     {
-        GL_CALL(glBindBuffer((GLenum)type, id));
+        if (caps.transform_feedback_objects)
+        {
+            GL_CALL(glGenTransformFeedbacks(1, &id));
+        }
     }
 
-    void Buffer::unbind()
+    TransformFeedback::~TransformFeedback()
     {
-        GL_CALL(glBindBuffer((GLenum)type, 0));
+        if (id != 0)
+        {
+            GL_CALL(glDeleteTransformFeedbacks(1, &id));
+        }
     }
 
-    void Buffer::set_data(const void *data, size_t size, BufferUsage usage)
+    void TransformFeedback::attach(uint32_t index, Buffer &buffer)
     {
-        this->bind();
-        GL_CALL(glBufferData((GLenum)type, size, data, (GLenum)usage));
-        this->unbind();
+        if (id == 0)
+        {
+            _buffers.resize(std::max<size_t>(_buffers.size(), index + 1), 0);
+            _buffers[index] = buffer.id;
+            return;
+        }
+
+        GL_CALL(glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, id));
+        GL_CALL(glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, index, buffer.id));
+        GL_CALL(glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0));
     }
 
-    void Buffer::set_sub_data(const void *data, size_t size, size_t offset)
+    void TransformFeedback::begin(PrimitiveType primitive_type)
     {
-        this->bind();
-        GL_CALL(glBufferSubData((GLenum)type, offset, size, data));
-        this->unbind();
+        note_command(GL_TRANSFORM_FEEDBACK, id);
+
+        if (id != 0)
+        {
+            GL_CALL(glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, id));
+        }
+
+        // GL 3.3 keeps the capture targets in context state, bind them for this capture
+        for (size_t i = 0; i < _buffers.size(); i++)
+        {
+            GL_CALL(glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, i, _buffers[i]));
+        }
+
+        GL_CALL(glBeginTransformFeedback((GLenum)primitive_type));
     }
 
-    void Buffer::map()
+    void TransformFeedback::end()
     {
-        bind();
-        data = glMapBufferRange((GLenum)type, 0, 0, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        note_change();
+        GL_CALL(glEndTransformFeedback());
+
+        for (size_t i = 0; i < _buffers.size(); i++)
+        {
+            GL_CALL(glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, i, 0));
+        }
+
+        if (id != 0)
+        {
+            GL_CALL(glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0));
+        }
     }
 
-    void Buffer::unmap()
+    Fence::~Fence()
     {
-        bind();
-        GL_CALL(glUnmapBuffer((GLenum)type));
-        data = nullptr;
-        unbind();
+        if (sync != nullptr)
+        {
+            GL_CALL(glDeleteSync((GLsync)sync));
+        }
+    }
+
+    void Fence::insert()
+    {
+        if (sync != nullptr)
+        {
+            GL_CALL(glDeleteSync((GLsync)sync));
+        }
+
+        sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    bool Fence::wait(uint64_t timeout_ns)
+    {
+        if (sync == nullptr)
+        {
+            return true;
+        }
+
+        GLenum result = glClientWaitSync((GLsync)sync, GL_SYNC_FLUSH_COMMANDS_BIT, timeout_ns);
+        return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
+    }
+
+    bool Fence::is_signaled()
+    {
+        if (sync == nullptr)
+        {
+            return true;
+        }
+
+        GLint status = GL_UNSIGNALED;
+        GL_CALL(glGetSynciv((GLsync)sync, GL_SYNC_STATUS, 1, NULL, &status));
+        return status == GL_SIGNALED;
+    }
+
+    RingBuffer::RingBuffer(BufferType type, size_t region_size, size_t frames_in_flight)
+        : buffer(type), _region_size(region_size), _fences(frames_in_flight)
+    {
+        _frame = frames_in_flight - 1;
+
+        if (caps.buffer_storage)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            buffer.bind();
+            GL_CALL(glBufferStorage((GLenum)buffer.type, region_size * frames_in_flight, NULL, flags));
+            _mapped = glMapBufferRange((GLenum)buffer.type, 0, region_size * frames_in_flight, flags);
+            buffer.unbind();
+            return;
+        }
+
+        buffer.set_data(nullptr, region_size * frames_in_flight, BufferUsage::StreamDraw);
+    }
+
+    void RingBuffer::begin_frame()
+    {
+        _frame = (_frame + 1) % _fences.size();
+        _head = 0;
+        _fences[_frame].wait();
+    }
+
+    void RingBuffer::end_frame()
+    {
+        _fences[_frame].insert();
+    }
+
+    size_t RingBuffer::write(const void *data, size_t size, size_t alignment)
+    {
+        size_t head = (_head + alignment - 1) / alignment * alignment;
+
+        if (head + size > _region_size)
+        {
+            return SIZE_MAX;
+        }
+
+        size_t offset = _frame * _region_size + head;
+        _head = head + size;
+
+        if (_mapped != nullptr)
+        {
+            note_change();
+            std::memcpy((uint8_t *)_mapped + offset, data, size);
+            return offset;
+        }
+
+        buffer.bind();
+        void *target = glMapBufferRange((GLenum)buffer.type, offset, size, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+
+        if (target != nullptr)
+        {
+            note_change();
+            std::memcpy(target, data, size);
+            GL_CALL(glUnmapBuffer((GLenum)buffer.type));
+        }
+
+        buffer.unbind();
+
+        return offset;
     }
 
     VertexArray::VertexArray()
@@ -298,6 +2117,7 @@ namespace gfx
 
     void VertexArray::bind()
     {
+        note_command(GL_VERTEX_ARRAY, id);
         GL_CALL(glBindVertexArray(id));
     }
 
@@ -306,13 +2126,13 @@ namespace gfx
         GL_CALL(glBindVertexArray(0));
     }
 
-    void VertexArray::set_attribute(size_t index, Buffer &buffer, size_t size, DataType type, size_t stride, size_t offset)
+    void VertexArray::set_attribute(size_t index, Buffer &buffer, size_t size, DataType type, size_t stride, size_t offset, bool normalized)
     {
         bind();
-        buffer.bind();
-        GL_CALL(glVertexAttribPointer(index, size, (GLenum)type, GL_FALSE, stride, (void *)offset));
+        GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, buffer.id)); // Any buffer can feed attributes, storage buffers included
+        GL_CALL(glVertexAttribPointer(index, size, (GLenum)type, normalized ? GL_TRUE : GL_FALSE, stride, (void *)offset));
         GL_CALL(glEnableVertexAttribArray(index));
-        buffer.unbind();
+        GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
         unbind();
     }
 
@@ -343,7 +2163,20 @@ namespace gfx
 
         GL_CALL(glGenTextures(1, &id));
         GL_CALL(glBindTexture(GL_TEXTURE_2D, id));
-        GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, (GLenum)format, width, height, 0, (GLenum)format, GL_UNSIGNED_BYTE, NULL));
+
+        // GLES binds only immutable textures as images, sized formats get one level of fixed storage there
+        bool sized = format != TextureFormat::RGB && format != TextureFormat::RGBA && format != TextureFormat::Depth;
+        _immutable = caps.api == Api::OpenGLES && sized;
+
+        if (_immutable)
+        {
+            GL_CALL(glTexStorage2D(GL_TEXTURE_2D, 1, (GLenum)format, width, height));
+        }
+        else
+        {
+            GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, (GLenum)format, width, height, 0, pixel_format(format), pixel_type(format), NULL));
+        }
+
         GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
     }
 
@@ -354,14 +2187,26 @@ namespace gfx
 
     void Image::set_data(const void *data, size_t width, size_t height, size_t channels)
     {
+        note_change();
+        stats.texture_uploads++;
         GL_CALL(glBindTexture(GL_TEXTURE_2D, id));
-        GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, (GLenum)format, width, height, 0, (GLenum)format, GL_UNSIGNED_BYTE, data));
+
+        if (_immutable)
+        {
+            GL_CALL(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, pixel_format(format), pixel_type(format), data));
+        }
+        else
+        {
+            GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, (GLenum)format, width, height, 0, pixel_format(format), pixel_type(format), data));
+        }
+
         GL_CALL(glGenerateMipmap(GL_TEXTURE_2D));
         GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
     }
 
     void Image::bind(int slot)
     {
+        note_command(GL_TEXTURE0 + slot, id);
         GL_CALL(glActiveTexture(GL_TEXTURE0 + slot));
         GL_CALL(glBindTexture(GL_TEXTURE_2D, id));
     }
@@ -372,8 +2217,24 @@ namespace gfx
         GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
     }
 
+    void Image::bind_image(int unit, ImageAccess access)
+    {
+        note_command(GL_IMAGE_BINDING_NAME + unit, id);
+        GL_CALL(glBindImageTexture(unit, id, 0, GL_FALSE, 0, (GLenum)access, (GLenum)format));
+    }
+
+    void Image::set_depth_compare(bool enable)
+    {
+        note_change();
+        GL_CALL(glBindTexture(GL_TEXTURE_2D, id));
+        GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, enable ? GL_COMPARE_REF_TO_TEXTURE : GL_NONE));
+        GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL));
+        GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
+    }
+
     void Image::_apply_sampler(Sampler &sampler)
     {
+        note_change();
         GL_CALL(glBindTexture(GL_TEXTURE_2D, id));
         GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (GLenum)sampler.min_filter));
         GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, (GLenum)sampler.mag_filter));
@@ -382,6 +2243,126 @@ namespace gfx
         GL_CALL(glBindTexture(GL_TEXTURE_2D, 0));
     }
 
+    ImageArray::ImageArray(int width, int height, int layers, TextureFormat format)
+    {
+        this->format = format;
+        _width = width;
+        _height = height;
+        _layers = layers;
+
+        GL_CALL(glGenTextures(1, &id));
+        GL_CALL(glBindTexture(GL_TEXTURE_2D_ARRAY, id));
+        GL_CALL(glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, (GLenum)format, width, height, layers, 0, pixel_format(format), pixel_type(format), NULL));
+        GL_CALL(glBindTexture(GL_TEXTURE_2D_ARRAY, 0));
+    }
+
+    ImageArray::~ImageArray()
+    {
+        GL_CALL(glDeleteTextures(1, &id));
+    }
+
+    void ImageArray::set_layer(const void *data, int layer)
+    {
+        set_sub_data(data, 0, 0, _width, _height, layer);
+    }
+
+    void ImageArray::set_sub_data(const void *data, int x, int y, int width, int height, int layer)
+    {
+        note_change();
+        stats.texture_uploads++;
+        GL_CALL(glBindTexture(GL_TEXTURE_2D_ARRAY, id));
+        GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+        GL_CALL(glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, x, y, layer, width, height, 1, pixel_format(format), pixel_type(format), data));
+        GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+        GL_CALL(glBindTexture(GL_TEXTURE_2D_ARRAY, 0));
+    }
+
+    void ImageArray::generate_mipmaps()
+    {
+        GL_CALL(glBindTexture(GL_TEXTURE_2D_ARRAY, id));
+        GL_CALL(glGenerateMipmap(GL_TEXTURE_2D_ARRAY));
+        GL_CALL(glBindTexture(GL_TEXTURE_2D_ARRAY, 0));
+    }
+
+    void ImageArray::bind(int slot)
+    {
+        note_command(GL_TEXTURE0 + slot, id);
+        GL_CALL(glActiveTexture(GL_TEXTURE0 + slot));
+        GL_CALL(glBindTexture(GL_TEXTURE_2D_ARRAY, id));
+    }
+
+    void ImageArray::unbind(int slot)
+    {
+        GL_CALL(glActiveTexture(GL_TEXTURE0 + slot));
+        GL_CALL(glBindTexture(GL_TEXTURE_2D_ARRAY, 0));
+    }
+
+    void ImageArray::_apply_sampler(Sampler &sampler)
+    {
+        note_change();
+        GL_CALL(glBindTexture(GL_TEXTURE_2D_ARRAY, id));
+        GL_CALL(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, (GLenum)sampler.min_filter));
+        GL_CALL(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, (GLenum)sampler.mag_filter));
+        GL_CALL(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, (GLenum)sampler.wrap_s));
+        GL_CALL(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, (GLenum)sampler.wrap_t));
+        GL_CALL(glBindTexture(GL_TEXTURE_2D_ARRAY, 0));
+    }
+
+    ImageCube::ImageCube(int size, TextureFormat format)
+    {
+        this->format = format;
+        _size = size;
+
+        GL_CALL(glGenTextures(1, &id));
+        GL_CALL(glBindTexture(GL_TEXTURE_CUBE_MAP, id));
+
+        for (int face = 0; face < 6; face++)
+        {
+            GL_CALL(glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, (GLenum)format, size, size, 0, pixel_format(format), pixel_type(format), NULL));
+        }
+
+        GL_CALL(glBindTexture(GL_TEXTURE_CUBE_MAP, 0));
+    }
+
+    ImageCube::~ImageCube()
+    {
+        GL_CALL(glDeleteTextures(1, &id));
+    }
+
+    void ImageCube::set_face(const void *data, int face)
+    {
+        note_change();
+        stats.texture_uploads++;
+        GL_CALL(glBindTexture(GL_TEXTURE_CUBE_MAP, id));
+        GL_CALL(glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, 0, 0, _size, _size, pixel_format(format), pixel_type(format), data));
+        GL_CALL(glBindTexture(GL_TEXTURE_CUBE_MAP, 0));
+    }
+
+    void ImageCube::bind(int slot)
+    {
+        note_command(GL_TEXTURE0 + slot, id);
+        GL_CALL(glActiveTexture(GL_TEXTURE0 + slot));
+        GL_CALL(glBindTexture(GL_TEXTURE_CUBE_MAP, id));
+    }
+
+    void ImageCube::unbind(int slot)
+    {
+        GL_CALL(glActiveTexture(GL_TEXTURE0 + slot));
+        GL_CALL(glBindTexture(GL_TEXTURE_CUBE_MAP, 0));
+    }
+
+    void ImageCube::_apply_sampler(Sampler &sampler)
+    {
+        note_change();
+        GL_CALL(glBindTexture(GL_TEXTURE_CUBE_MAP, id));
+        GL_CALL(glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, (GLenum)sampler.min_filter));
+        GL_CALL(glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, (GLenum)sampler.mag_filter));
+        GL_CALL(glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, (GLenum)sampler.wrap_s));
+        GL_CALL(glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, (GLenum)sampler.wrap_t));
+        GL_CALL(glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, (GLenum)sampler.wrap_t));
+        GL_CALL(glBindTexture(GL_TEXTURE_CUBE_MAP, 0));
+    }
+
     Framebuffer::Framebuffer(int width, int height)
     {
         _width = width;
@@ -396,20 +2377,172 @@ namespace gfx
 
     void Framebuffer::bind()
     {
+        note_command(GL_FRAMEBUFFER, id);
         GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, id));
     }
 
     void Framebuffer::unbind()
     {
+        note_command(GL_FRAMEBUFFER, 0);
         GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
     }
 
     void Framebuffer::attach(AttachmentType attachment, Image &image)
     {
+        note_change();
         GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, id));
         GL_CALL(glFramebufferTexture2D(GL_FRAMEBUFFER, (GLenum)attachment, GL_TEXTURE_2D, image.id, 0));
         GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
     }
+
+    void Framebuffer::attach(AttachmentType attachment, ImageArray &image)
+    {
+        note_change();
+        GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, id));
+        GL_CALL(glFramebufferTexture(GL_FRAMEBUFFER, (GLenum)attachment, image.id, 0));
+        GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+    }
+
+    void Framebuffer::attach(AttachmentType attachment, ImageCube &image)
+    {
+        note_change();
+        GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, id));
+        GL_CALL(glFramebufferTexture(GL_FRAMEBUFFER, (GLenum)attachment, image.id, 0));
+        GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+    }
+
+    void Framebuffer::attach_layer(AttachmentType attachment, ImageArray &image, int layer)
+    {
+        note_change();
+        GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, id));
+        GL_CALL(glFramebufferTextureLayer(GL_FRAMEBUFFER, (GLenum)attachment, image.id, 0, layer));
+        GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+    }
+
+    void Framebuffer::attach_face(AttachmentType attachment, ImageCube &image, int face)
+    {
+        note_change();
+        GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, id));
+        GL_CALL(glFramebufferTexture2D(GL_FRAMEBUFFER, (GLenum)attachment, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, image.id, 0));
+        GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+    }
+
+    void Framebuffer::disable_color()
+    {
+        // glDrawBuffer is missing on GLES, glDrawBuffers with GL_NONE works on both
+        const GLenum none = GL_NONE;
+        note_change();
+        GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, id));
+        GL_CALL(glDrawBuffers(1, &none));
+        GL_CALL(glReadBuffer(GL_NONE));
+        GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+    }
+
+    void Framebuffer::read_pixels(int x, int y, int width, int height, TextureFormat format, void *data)
+    {
+        GL_CALL(glBindFramebuffer(GL_READ_FRAMEBUFFER, id));
+        GL_CALL(glReadBuffer(GL_COLOR_ATTACHMENT0));
+        GL_CALL(glReadPixels(x, y, width, height, pixel_format(format), pixel_type(format), data));
+        GL_CALL(glBindFramebuffer(GL_READ_FRAMEBUFFER, 0));
+    }
+
+    void Framebuffer::blit(Framebuffer *target, int width, int height, SamplerFilter filter)
+    {
+        note_command(GL_READ_FRAMEBUFFER, ((uint64_t)id << 32) | (target != nullptr ? target->id : 0));
+        GL_CALL(glBindFramebuffer(GL_READ_FRAMEBUFFER, id));
+        GL_CALL(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target != nullptr ? target->id : 0));
+        GL_CALL(glReadBuffer(GL_COLOR_ATTACHMENT0));
+        GL_CALL(glBlitFramebuffer(0, 0, _width, _height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, (GLenum)filter));
+        GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+    }
+
+    void Framebuffer::blit_depth(Framebuffer &target, int x, int y, int width, int height)
+    {
+        note_command(GL_READ_FRAMEBUFFER, ((uint64_t)id << 32) | target.id);
+        GL_CALL(glBindFramebuffer(GL_READ_FRAMEBUFFER, id));
+        GL_CALL(glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target.id));
+        GL_CALL(glBlitFramebuffer(x, y, x + width, y + height, x, y, x + width, y + height, GL_DEPTH_BUFFER_BIT, GL_NEAREST));
+        GL_CALL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+    }
+
+    Query::Query(QueryType type)
+    {
+        this->type = type;
+        GL_CALL(glGenQueries(1, &id));
+    }
+
+    Query::~Query()
+    {
+        GL_CALL(glDeleteQueries(1, &id));
+    }
+
+    void Query::begin()
+    {
+        GL_CALL(glBeginQuery((GLenum)type, id));
+    }
+
+    void Query::end()
+    {
+        GL_CALL(glEndQuery((GLenum)type));
+    }
+
+    void Query::counter()
+    {
+        GL_CALL(glQueryCounter(id, GL_TIMESTAMP));
+    }
+
+    bool Query::is_available()
+    {
+        GLuint available = GL_FALSE;
+        GL_CALL(glGetQueryObjectuiv(id, GL_QUERY_RESULT_AVAILABLE, &available));
+        return available == GL_TRUE;
+    }
+
+    uint64_t Query::get_result()
+    {
+        if (glad_glGetQueryObjectui64v == nullptr) // GLES without the timer query extension
+        {
+            GLuint result = 0;
+            GL_CALL(glGetQueryObjectuiv(id, GL_QUERY_RESULT, &result));
+            return result;
+        }
+
+        GLuint64 result = 0;
+        GL_CALL(glGetQueryObjectui64v(id, GL_QUERY_RESULT, &result));
+        return result;
+    }
+
+    void begin_conditional_render(Query &query, ConditionalRenderMode mode)
+    {
+        if (caps.conditional_render)
+        {
+            GL_CALL(glBeginConditionalRender(query.id, (GLenum)mode));
+        }
+    }
+
+    void end_conditional_render()
+    {
+        if (caps.conditional_render)
+        {
+            GL_CALL(glEndConditionalRender());
+        }
+    }
+
+    uint64_t timer_disjoint_count()
+    {
+        static const GLenum gpu_disjoint = 0x8FBB; // GL_GPU_DISJOINT_EXT, the loader has no extension enums
+        static uint64_t count = 0;
+
+        // Reading the flag clears it, so every caller shares this count instead of the flag
+        if (caps.api == Api::OpenGLES && caps.timer_query)
+        {
+            GLint disjoint = 0;
+            GL_CALL(glGetIntegerv(gpu_disjoint, &disjoint));
+            count += disjoint != 0;
+        }
+
+        return count;
+    }
 }
 
 void CheckOpenGLError(const char *stmt, const char *fname, int line)
@@ -0,0 +1,287 @@
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+#include "debug.hpp"
+#include "hitch.hpp"
+
+namespace gfx
+{
+    static std::string escape_json(const std::string &text)
+    {
+        std::string result;
+        result.reserve(text.size());
+
+        for (char c : text)
+        {
+            switch (c)
+            {
+            case '"':
+                result += "\\\"";
+                break;
+            case '\\':
+                result += "\\\\";
+                break;
+            case '\n':
+                result += "\\n";
+                break;
+            case '\t':
+                result += "\\t";
+                break;
+            default:
+                if ((unsigned char)c >= 0x20)
+                {
+                    result += c;
+                }
+            }
+        }
+
+        return result;
+    }
+
+    static uint32_t thread_number()
+    {
+        // Thread ids start at 1, the GPU track is 0
+        return (uint32_t)(std::hash<std::thread::id>()(std::this_thread::get_id()) % 0xFFFFFFFE) + 1;
+    }
+
+    HitchDetector::HitchDetector(size_t history) : _history(std::max<size_t>(history, 2))
+    {
+        _epoch = Clock::now();
+    }
+
+    uint64_t HitchDetector::_now()
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - _epoch).count();
+    }
+
+    void HitchDetector::begin_frame()
+    {
+        std::scoped_lock lock(_mutex);
+
+        _current = FrameRecord();
+        _current.index = _frame;
+        _current.start_ns = _now();
+        _in_frame = true;
+        reset_render_stats();
+    }
+
+    void HitchDetector::add_event(const char *name, uint64_t start_ns, uint64_t end_ns)
+    {
+        std::scoped_lock lock(_mutex);
+
+        if (_in_frame)
+        {
+            _current.events.push_back({name, start_ns, end_ns, thread_number()});
+        }
+    }
+
+    std::unique_ptr<Query> HitchDetector::_acquire_query()
+    {
+        if (_free_queries.empty())
+        {
+            return std::make_unique<Query>(QueryType::Timestamp);
+        }
+
+        auto query = std::move(_free_queries.back());
+        _free_queries.pop_back();
+        return query;
+    }
+
+    void HitchDetector::begin_gpu_zone(const char *name)
+    {
+        // Without timer queries no zone opens, so end_gpu_zone has nothing to close either
+        if (!capabilities().timer_query)
+        {
+            return;
+        }
+
+        if (_open_gpu_zone != nullptr)
+        {
+            debug::log("GPU zone '{}' started inside '{}', zones can't nest", name, _open_gpu_zone->name);
+            return;
+        }
+
+        GpuZone zone;
+        zone.name = name;
+        zone.begin = _acquire_query();
+        zone.end = _acquire_query();
+        zone.frame = _frame;
+        zone.begin->counter();
+
+        _gpu_zones.push_back(std::move(zone));
+        _open_gpu_zone = &_gpu_zones.back();
+    }
+
+    void HitchDetector::end_gpu_zone()
+    {
+        if (_open_gpu_zone == nullptr)
+        {
+            return;
+        }
+
+        _open_gpu_zone->end->counter();
+        _open_gpu_zone = nullptr;
+    }
+
+    void HitchDetector::_resolve_gpu_zones()
+    {
+        std::vector<GpuZone> waiting;
+
+        for (auto &zone : _gpu_zones)
+        {
+            // Zones whose frame already left the history are dropped without reading them
+            bool recorded = zone.frame + _history > _frame;
+
+            if (recorded && (!zone.begin->is_available() || !zone.end->is_available()))
+            {
+                waiting.push_back(std::move(zone));
+                continue;
+            }
+
+            if (recorded)
+            {
+                // GPU timestamps run on their own clock, a frame's first zone is placed at the frame's CPU
+                // start, which keeps durations exact and the alignment between tracks approximate
+                FrameRecord &frame = _frames[zone.frame % _history];
+                uint64_t begin = zone.begin->get_result();
+                uint64_t end = zone.end->get_result();
+
+                if (frame._gpu_base == 0)
+                {
+                    frame._gpu_base = begin;
+                }
+
+                uint64_t start_ns = frame.start_ns + (begin - frame._gpu_base);
+                uint64_t end_ns = frame.start_ns + (end - frame._gpu_base);
+                frame.events.push_back({zone.name, start_ns, end_ns, 0});
+                frame.gpu_ms = std::max(frame.gpu_ms, (float)((end_ns - frame.start_ns) / 1e6));
+            }
+
+            _free_queries.push_back(std::move(zone.begin));
+            _free_queries.push_back(std::move(zone.end));
+        }
+
+        _gpu_zones = std::move(waiting);
+    }
+
+    float HitchDetector::_median_ms()
+    {
+        std::vector<float> times;
+
+        for (auto &frame : _frames)
+        {
+            times.push_back(frame.cpu_ms);
+        }
+
+        if (times.empty())
+        {
+            return 0.0f;
+        }
+
+        std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+        return times[times.size() / 2];
+    }
+
+    void HitchDetector::end_frame()
+    {
+        end_gpu_zone();
+
+        {
+            std::scoped_lock lock(_mutex);
+
+            _current.end_ns = _now();
+            _current.cpu_ms = (float)((_current.end_ns - _current.start_ns) / 1e6);
+            _current.stats = render_stats();
+            _in_frame = false;
+        }
+
+        float median = _median_ms();
+        bool hitch = _frames.size() >= std::min<size_t>(_history, 10) && _current.cpu_ms > std::max(median * budget_multiplier, min_budget_ms);
+
+        if (_frames.size() < _history)
+        {
+            _frames.push_back(std::move(_current));
+        }
+        else
+        {
+            _frames[_frame % _history] = std::move(_current);
+        }
+
+        _frame++;
+        _resolve_gpu_zones();
+
+        if (hitch && _dump_at == UINT64_MAX)
+        {
+            debug::log("Frame {} took {:.2f} ms, {:.1f}x the median", _frame - 1, _frames[(_frame - 1) % _history].cpu_ms, median > 0.0f ? _frames[(_frame - 1) % _history].cpu_ms / median : 0.0f);
+            _hitch_frame = _frame - 1;
+            _dump_at = _frame + frames_after;
+        }
+
+        if (_frame >= _dump_at)
+        {
+            dump(directory + "/hitch_" + std::to_string(_hitch_frame) + ".json");
+            _dump_at = UINT64_MAX;
+        }
+    }
+
+    bool HitchDetector::dump(const std::string &path)
+    {
+        std::ofstream file(path);
+
+        if (!file)
+        {
+            debug::log("Failed to write hitch trace {}", path);
+            return false;
+        }
+
+        std::vector<const FrameRecord *> frames;
+        for (auto &frame : _frames)
+        {
+            frames.push_back(&frame);
+        }
+
+        std::sort(frames.begin(), frames.end(), [](const FrameRecord *a, const FrameRecord *b) { return a->index < b->index; });
+
+        file << "{\"traceEvents\":[\n";
+        bool first = true;
+
+        auto write_event = [&](const std::string &name, uint64_t start_ns, uint64_t end_ns, uint32_t thread, const std::string &args)
+        {
+            file << (first ? "" : ",\n") << "{\"name\":\"" << escape_json(name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread
+                 << ",\"ts\":" << start_ns / 1000.0 << ",\"dur\":" << (end_ns - start_ns) / 1000.0 << ",\"args\":{" << args << "}}";
+            first = false;
+        };
+
+        for (const FrameRecord *frame : frames)
+        {
+            const RenderStats &stats = frame->stats;
+            std::string args = "\"cpu_ms\":" + std::to_string(frame->cpu_ms) + ",\"gpu_ms\":" + std::to_string(frame->gpu_ms) +
+                               ",\"draw_calls\":" + std::to_string(stats.draw_calls) + ",\"dispatches\":" + std::to_string(stats.dispatches) +
+                               ",\"buffer_upload_bytes\":" + std::to_string(stats.buffer_upload_bytes) + ",\"texture_uploads\":" + std::to_string(stats.texture_uploads) +
+                               ",\"shader_compiles\":" + std::to_string(stats.shader_compiles) + ",\"pipeline_links\":" + std::to_string(stats.pipeline_links);
+
+            write_event("Frame " + std::to_string(frame->index), frame->start_ns, frame->end_ns, 1, args);
+
+            for (auto &event : frame->events)
+            {
+                write_event(event.name, event.start_ns, event.end_ns, event.thread, "");
+            }
+        }
+
+        file << "\n],\"metadata\":{\"hitch_frame\":" << _hitch_frame << ",\"log\":[";
+
+        std::vector<std::string> lines = debug::tail();
+        for (size_t i = 0; i < lines.size(); i++)
+        {
+            file << (i > 0 ? "," : "") << "\n\"" << escape_json(lines[i]) << "\"";
+        }
+
+        file << "\n]}}\n";
+        dumps++;
+
+        debug::log("Hitch trace written to {}", path);
+        return true;
+    }
+}
@@ -0,0 +1,204 @@
+#include <sstream>
+#include <vector>
+
+#include "debug.hpp"
+#include "layered.hpp"
+
+namespace gfx
+{
+    static std::vector<std::string> varying_names(const std::string &varyings)
+    {
+        std::vector<std::string> names;
+        std::stringstream stream(varyings);
+        std::string member;
+
+        while (std::getline(stream, member, ';'))
+        {
+            size_t end = member.find_last_not_of(" \t\n");
+
+            if (end == std::string::npos)
+            {
+                continue;
+            }
+
+            size_t start = member.find_last_of(" \t\n", end);
+            names.push_back(member.substr(start + 1, end - start));
+        }
+
+        return names;
+    }
+
+    static std::string varying_block(const std::string &varyings, const char *qualifier, const char *instance)
+    {
+        if (varyings.empty())
+        {
+            return "";
+        }
+
+        return std::string(qualifier) + " LayeredVaryings\n{\n" + varyings + "\n} " + instance + ";\n";
+    }
+
+    LayerSelection LayeredPass::detect()
+    {
+        if (capabilities().vertex_layer)
+        {
+            return LayerSelection::Vertex;
+        }
+
+        return LayerSelection::Geometry;
+    }
+
+    LayeredPass::LayeredPass(int layers, const char *vertex_source, const char *fragment_source, const char *varyings)
+    {
+        this->layers = layers;
+        selection = detect();
+
+        const Capabilities &caps = capabilities();
+
+        if (selection == LayerSelection::Geometry && !caps.geometry_shader)
+        {
+            debug::log("Layered passes need a viewport layer extension or geometry shaders, this context has {}.{}", caps.major, caps.minor);
+            return;
+        }
+
+        // 430 core becomes 310 or 320 es on GLES, the first versions with geometry shaders. Desktop contexts
+        // below 4.3 get 330 core, which is why the geometry stage loops over the layers instead of using invocations.
+        bool es = caps.api == Api::OpenGLES;
+        std::string version = es || caps.major > 4 || (caps.major == 4 && caps.minor >= 3) ? "#version 430 core\n" : "#version 330 core\n";
+        std::string io_blocks = es && caps.major == 3 && caps.minor < 2 ? "#extension GL_EXT_shader_io_blocks : require\n" : "";
+
+        std::string members = varyings;
+        std::string count = std::to_string(layers);
+        std::string vertex = version;
+
+        if (selection == LayerSelection::Vertex)
+        {
+            if (has_extension("GL_ARB_shader_viewport_layer_array"))
+            {
+                vertex += "#extension GL_ARB_shader_viewport_layer_array : require\n";
+            }
+            else if (has_extension("GL_AMD_vertex_shader_layer"))
+            {
+                vertex += "#extension GL_AMD_vertex_shader_layer : require\n";
+            }
+            else
+            {
+                vertex += "#extension GL_NV_viewport_array2 : require\n";
+            }
+            vertex += "uniform mat4 u_layer_view_projection[" + count + "];\n";
+            vertex += "#define layered_instance (gl_InstanceID / " + count + ")\n";
+            vertex += "void emit_layered(vec4 world_position)\n{\n"
+                      "    int layer = gl_InstanceID % " + count + ";\n"
+                      "    gl_Layer = layer;\n"
+                      "    gl_Position = u_layer_view_projection[layer] * world_position;\n}\n";
+        }
+        else
+        {
+            vertex += io_blocks;
+            vertex += "#define layered_instance gl_InstanceID\n";
+            vertex += "void emit_layered(vec4 world_position)\n{\n    gl_Position = world_position;\n}\n";
+        }
+
+        vertex += varying_block(members, "out", "layered");
+        vertex += vertex_source;
+
+        std::string fragment = version + (selection == LayerSelection::Geometry ? io_blocks : "") + varying_block(members, "in", "layered") + fragment_source;
+
+        ShaderModule vertex_shader(ShaderType::Vertex);
+        vertex_shader.set_source(vertex.c_str());
+        vertex_shader.compile();
+
+        ShaderModule fragment_shader(ShaderType::Fragment);
+        fragment_shader.set_source(fragment.c_str());
+        fragment_shader.compile();
+
+        pipeline.attach_shader(vertex_shader);
+        pipeline.attach_shader(fragment_shader);
+
+        if (selection == LayerSelection::Geometry)
+        {
+            std::string geometry = version;
+
+            if (!io_blocks.empty())
+            {
+                geometry += "#extension GL_EXT_geometry_shader : require\n";
+            }
+
+            geometry += "layout(triangles) in;\n"
+                        "layout(triangle_strip, max_vertices = " + std::to_string(3 * layers) + ") out;\n"
+                        "uniform mat4 u_layer_view_projection[" + count + "];\n";
+            geometry += varying_block(members, "in", "layered_in[]");
+            geometry += varying_block(members, "out", "layered");
+            geometry += "void main()\n{\n    for (int layer = 0; layer < " + count + "; layer++)\n    {\n"
+                        "        for (int i = 0; i < 3; i++)\n        {\n"
+                        "            gl_Layer = layer;\n"
+                        "            gl_Position = u_layer_view_projection[layer] * gl_in[i].gl_Position;\n";
+
+            for (auto &name : varying_names(members))
+            {
+                geometry += "            layered." + name + " = layered_in[i]." + name + ";\n";
+            }
+
+            geometry += "            EmitVertex();\n        }\n        EndPrimitive();\n    }\n}\n";
+
+            ShaderModule geometry_shader(ShaderType::Geometry);
+            geometry_shader.set_source(geometry.c_str());
+            geometry_shader.compile();
+            pipeline.attach_shader(geometry_shader);
+        }
+
+        pipeline.link();
+
+        _view_projections = pipeline.get_uniform("u_layer_view_projection");
+    }
+
+    void LayeredPass::use(const float *view_projections)
+    {
+        pipeline.use();
+        _view_projections.set_mat4_array(view_projections, layers);
+    }
+
+    void LayeredPass::draw(size_t vertex_count, size_t instance_count, PrimitiveType primitive_type)
+    {
+        if (selection == LayerSelection::Vertex)
+        {
+            instance_count *= layers;
+        }
+
+        gfx::draw(vertex_count, instance_count, 0, 0, primitive_type);
+    }
+
+    void cube_view_projections(const float *position, float near, float far, float *out)
+    {
+        static const float forwards[6][3] = {{1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+        static const float ups[6][3] = {{0, -1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}, {0, -1, 0}, {0, -1, 0}};
+
+        // 90 degree field of view, square aspect
+        float a = -(far + near) / (far - near);
+        float b = -2.0f * far * near / (far - near);
+
+        for (int face = 0; face < 6; face++)
+        {
+            const float *f = forwards[face];
+            const float *u = ups[face];
+            float s[3] = {f[1] * u[2] - f[2] * u[1], f[2] * u[0] - f[0] * u[2], f[0] * u[1] - f[1] * u[0]};
+
+            // Rows of the view rotation are s, u and -f, translated by the negated position
+            float rows[3][4] = {
+                {s[0], s[1], s[2], -(s[0] * position[0] + s[1] * position[1] + s[2] * position[2])},
+                {u[0], u[1], u[2], -(u[0] * position[0] + u[1] * position[1] + u[2] * position[2])},
+                {-f[0], -f[1], -f[2], f[0] * position[0] + f[1] * position[1] + f[2] * position[2]},
+            };
+
+            float *m = out + face * 16;
+
+            for (int column = 0; column < 4; column++)
+            {
+                m[column * 4 + 0] = rows[0][column];
+                m[column * 4 + 1] = rows[1][column];
+                m[column * 4 + 2] = a * rows[2][column] + (column == 3 ? b : 0.0f);
+                m[column * 4 + 3] = -rows[2][column];
+            }
+        }
+    }
+}
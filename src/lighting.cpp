@@ -0,0 +1,482 @@
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+#include "debug.hpp"
+#include "lighting.hpp"
+#include "scan.hpp"
+
+namespace gfx
+{
+    const char *ClusteredLighting::shader_source = R"(
+struct ClusterLight
+{
+    vec4 position_range;
+    vec4 color_intensity;
+    vec4 direction_cos;
+};
+
+layout(std140) uniform ClusterParams
+{
+    uvec4 cluster_grid;
+    vec4 cluster_screen;
+    mat4 cluster_inverse_projection;
+    uvec4 cluster_limits;
+};
+
+layout(std430) readonly buffer ClusterLights
+{
+    ClusterLight cluster_lights[];
+};
+
+layout(std430) buffer ClusterRanges
+{
+    uvec2 cluster_ranges[];
+};
+
+layout(std430) buffer ClusterIndices
+{
+    uint cluster_indices[];
+};
+
+#ifndef CLUSTER_CULL
+
+uvec2 cluster_range(vec2 frag_coord, float view_depth)
+{
+    uvec3 grid = cluster_grid.xyz;
+    float near = cluster_screen.z;
+    float far = cluster_screen.w;
+
+    uint x = min(uint(frag_coord.x / cluster_screen.x * float(grid.x)), grid.x - 1u);
+    uint y = min(uint(frag_coord.y / cluster_screen.y * float(grid.y)), grid.y - 1u);
+    float slice = log(max(view_depth, near) / near) / log(far / near) * float(grid.z);
+    uint z = min(uint(slice), grid.z - 1u);
+
+    return cluster_ranges[x + y * grid.x + z * grid.x * grid.y];
+}
+
+// Diffuse lighting from the lights of the pixel's cluster, position and normal in view space
+vec3 cluster_shade(vec2 frag_coord, vec3 view_position, vec3 view_normal)
+{
+    uvec2 range = cluster_range(frag_coord, -view_position.z);
+    vec3 result = vec3(0.0);
+
+    for (uint i = 0u; i < range.y; i++)
+    {
+        ClusterLight light = cluster_lights[cluster_indices[range.x + i]];
+        vec3 to_light = light.position_range.xyz - view_position;
+        float distance = length(to_light);
+        vec3 l = to_light / max(distance, 1e-4);
+
+        float attenuation = clamp(1.0 - distance / light.position_range.w, 0.0, 1.0);
+        attenuation *= attenuation;
+
+        if (light.direction_cos.w > -1.0)
+        {
+            float cos_angle = dot(-l, light.direction_cos.xyz);
+            attenuation *= smoothstep(light.direction_cos.w, mix(light.direction_cos.w, 1.0, 0.1), cos_angle);
+        }
+
+        result += light.color_intensity.rgb * light.color_intensity.a * attenuation * max(dot(view_normal, l), 0.0);
+    }
+
+    return result;
+}
+#endif
+)";
+
+    static const char *cull_source = R"(
+layout(local_size_x = 128) in;
+
+layout(std430) buffer ClusterCounter
+{
+    uint cluster_index_count;
+};
+
+shared vec4 tile_lights[128];
+
+vec3 view_ray(vec2 ndc)
+{
+    vec4 p = cluster_inverse_projection * vec4(ndc, -1.0, 1.0);
+    return p.xyz / p.w;
+}
+
+bool sphere_intersects(vec4 sphere, vec3 box_min, vec3 box_max)
+{
+    vec3 d = max(box_min - sphere.xyz, 0.0) + max(sphere.xyz - box_max, 0.0);
+    return dot(d, d) <= sphere.w * sphere.w;
+}
+
+void main()
+{
+    uvec3 grid = cluster_grid.xyz;
+    uint light_count = cluster_grid.w;
+    uint cluster = gl_GlobalInvocationID.x;
+    bool valid = cluster < grid.x * grid.y * grid.z;
+
+    uint cx = cluster % grid.x;
+    uint cy = (cluster / grid.x) % grid.y;
+    uint cz = cluster / (grid.x * grid.y);
+
+    float near = cluster_screen.z;
+    float far = cluster_screen.w;
+    float z0 = near * pow(far / near, float(cz) / float(grid.z));
+    float z1 = near * pow(far / near, float(cz + 1u) / float(grid.z));
+
+    vec2 ndc0 = vec2(cx, cy) / vec2(grid.xy) * 2.0 - 1.0;
+    vec2 ndc1 = vec2(cx + 1u, cy + 1u) / vec2(grid.xy) * 2.0 - 1.0;
+
+    vec3 box_min = vec3(1e30);
+    vec3 box_max = vec3(-1e30);
+
+    for (int corner = 0; corner < 4; corner++)
+    {
+        vec3 ray = view_ray(vec2((corner & 1) != 0 ? ndc1.x : ndc0.x, (corner & 2) != 0 ? ndc1.y : ndc0.y));
+        vec3 p0 = ray * (-z0 / ray.z);
+        vec3 p1 = ray * (-z1 / ray.z);
+        box_min = min(box_min, min(p0, p1));
+        box_max = max(box_max, max(p0, p1));
+    }
+
+    uint count = 0u;
+
+    for (uint base = 0u; base < light_count; base += 128u)
+    {
+        uint index = base + gl_LocalInvocationID.x;
+        tile_lights[gl_LocalInvocationID.x] = index < light_count ? cluster_lights[index].position_range : vec4(0.0, 0.0, 0.0, -1.0);
+        barrier();
+
+        uint tile_count = min(128u, light_count - base);
+        for (uint j = 0u; j < tile_count; j++)
+        {
+            if (valid && sphere_intersects(tile_lights[j], box_min, box_max))
+            {
+                count++;
+            }
+        }
+
+        barrier();
+    }
+
+    uint offset = 0u;
+    if (valid && count > 0u)
+    {
+        offset = atomicAdd(cluster_index_count, count);
+    }
+
+    // Clusters past the index capacity keep the lights that still fit
+    uint capacity = offset < cluster_limits.x ? min(count, cluster_limits.x - offset) : 0u;
+    uint written = 0u;
+
+    for (uint base = 0u; base < light_count; base += 128u)
+    {
+        uint index = base + gl_LocalInvocationID.x;
+        tile_lights[gl_LocalInvocationID.x] = index < light_count ? cluster_lights[index].position_range : vec4(0.0, 0.0, 0.0, -1.0);
+        barrier();
+
+        uint tile_count = min(128u, light_count - base);
+        for (uint j = 0u; j < tile_count; j++)
+        {
+            if (valid && written < capacity && sphere_intersects(tile_lights[j], box_min, box_max))
+            {
+                cluster_indices[offset + written] = base + j;
+                written++;
+            }
+        }
+
+        barrier();
+    }
+
+    if (valid)
+    {
+        cluster_ranges[cluster] = uvec2(offset, written);
+    }
+}
+)";
+
+    static void invert_matrix(const float *m, float *out)
+    {
+        float inv[16];
+
+        inv[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+        inv[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+        inv[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+        inv[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+        inv[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+        inv[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+        inv[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+        inv[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+        inv[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+        inv[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+        inv[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+        inv[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+        inv[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+        inv[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+        inv[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] - m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+        inv[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] + m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+        float det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+        float scale = det != 0.0f ? 1.0f / det : 0.0f;
+
+        for (int i = 0; i < 16; i++)
+        {
+            out[i] = inv[i] * scale;
+        }
+    }
+
+    ClusteredLighting::ClusteredLighting(uint32_t grid_x, uint32_t grid_y, uint32_t grid_z, size_t max_lights, size_t max_indices)
+        : use_compute(capabilities().compute),
+          _grid{grid_x, grid_y, grid_z},
+          _max_lights(max_lights),
+          _max_indices(max_indices),
+          _params_buffer(BufferType::Uniform),
+          _lights_buffer(BufferType::ShaderStorage),
+          _ranges_buffer(BufferType::ShaderStorage),
+          _indices_buffer(BufferType::ShaderStorage),
+          _counter_buffer(BufferType::ShaderStorage)
+    {
+        size_t clusters = (size_t)grid_x * grid_y * grid_z;
+
+        // The cluster lists live in storage blocks, which every detected context only has alongside compute
+        if (!capabilities().compute)
+        {
+            debug::log("Clustered lighting needs storage buffers, OpenGL 4.3 or OpenGL ES 3.1, this context has {}.{}", capabilities().major, capabilities().minor);
+            return;
+        }
+
+        _params_buffer.set_data(nullptr, sizeof(ClusterParams), BufferUsage::DynamicDraw);
+        _lights_buffer.set_data(nullptr, max_lights * sizeof(GpuLight), BufferUsage::DynamicDraw);
+        _ranges_buffer.set_data(nullptr, clusters * 2 * sizeof(uint32_t), BufferUsage::DynamicDraw);
+        _indices_buffer.set_data(nullptr, max_indices * sizeof(uint32_t), BufferUsage::DynamicDraw);
+        _counter_buffer.set_data(nullptr, sizeof(uint32_t), BufferUsage::DynamicDraw);
+
+        if (use_compute)
+        {
+            std::string source = std::string("#version 430 core\n#define CLUSTER_CULL\n") + shader_source + cull_source;
+            build_compute_pipeline(_cull, source.c_str());
+        }
+
+        for (auto &bounds : _bounds)
+        {
+            bounds.resize(clusters);
+        }
+    }
+
+    void ClusteredLighting::_cluster_bounds(uint32_t cluster, float *min, float *max)
+    {
+        uint32_t cx = cluster % _grid[0];
+        uint32_t cy = (cluster / _grid[0]) % _grid[1];
+        uint32_t cz = cluster / (_grid[0] * _grid[1]);
+
+        float near = _params.screen[2];
+        float far = _params.screen[3];
+        float z0 = near * std::pow(far / near, (float)cz / _grid[2]);
+        float z1 = near * std::pow(far / near, (float)(cz + 1) / _grid[2]);
+        const float *m = _params.inverse_projection;
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            min[axis] = 1e30f;
+            max[axis] = -1e30f;
+        }
+
+        for (int corner = 0; corner < 4; corner++)
+        {
+            float ndc_x = (float)(cx + (corner & 1)) / _grid[0] * 2.0f - 1.0f;
+            float ndc_y = (float)(cy + ((corner >> 1) & 1)) / _grid[1] * 2.0f - 1.0f;
+            float ray[4];
+
+            for (int row = 0; row < 4; row++)
+            {
+                ray[row] = m[row] * ndc_x + m[4 + row] * ndc_y - m[8 + row] + m[12 + row];
+            }
+
+            for (float z : {z0, z1})
+            {
+                float t = -z / (ray[2] / ray[3]);
+
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    float p = ray[axis] / ray[3] * t;
+                    min[axis] = std::min(min[axis], p);
+                    max[axis] = std::max(max[axis], p);
+                }
+            }
+        }
+    }
+
+    void ClusteredLighting::_cull_cpu()
+    {
+        size_t clusters = _bounds[0].size();
+        uint32_t light_count = _params.grid[3];
+
+        for (uint32_t cluster = 0; cluster < clusters; cluster++)
+        {
+            float min[3];
+            float max[3];
+            _cluster_bounds(cluster, min, max);
+
+            for (int axis = 0; axis < 3; axis++)
+            {
+                _bounds[axis][cluster] = min[axis];
+                _bounds[3 + axis][cluster] = max[axis];
+            }
+        }
+
+        _counts.assign(clusters, 0);
+        _light_clusters.clear();
+
+        const float *min_x = _bounds[0].data();
+        const float *min_y = _bounds[1].data();
+        const float *min_z = _bounds[2].data();
+        const float *max_x = _bounds[3].data();
+        const float *max_y = _bounds[4].data();
+        const float *max_z = _bounds[5].data();
+
+        // Lights on the outside, clusters on the inside: the inner loop is branch-free over flat arrays
+        std::vector<uint8_t> hits(clusters);
+
+        for (uint32_t light = 0; light < light_count; light++)
+        {
+            const float *sphere = _view_lights[light].position_range;
+            float radius_squared = sphere[3] * sphere[3];
+
+            for (size_t cluster = 0; cluster < clusters; cluster++)
+            {
+                float dx = std::max(min_x[cluster] - sphere[0], 0.0f) + std::max(sphere[0] - max_x[cluster], 0.0f);
+                float dy = std::max(min_y[cluster] - sphere[1], 0.0f) + std::max(sphere[1] - max_y[cluster], 0.0f);
+                float dz = std::max(min_z[cluster] - sphere[2], 0.0f) + std::max(sphere[2] - max_z[cluster], 0.0f);
+                hits[cluster] = dx * dx + dy * dy + dz * dz <= radius_squared;
+            }
+
+            for (uint32_t cluster = 0; cluster < clusters; cluster++)
+            {
+                if (hits[cluster])
+                {
+                    _counts[cluster]++;
+                    _light_clusters.push_back(cluster);
+                    _light_clusters.push_back(light);
+                }
+            }
+        }
+
+        // Exclusive prefix sum of the counts gives each cluster its compact range
+        _ranges.resize(clusters * 2);
+        uint32_t offset = 0;
+
+        for (size_t cluster = 0; cluster < clusters; cluster++)
+        {
+            uint32_t count = (uint32_t)std::min<size_t>(_counts[cluster], offset < _max_indices ? _max_indices - offset : 0);
+            _ranges[cluster * 2] = offset;
+            _ranges[cluster * 2 + 1] = 0;
+            offset += count;
+            _counts[cluster] = count;
+        }
+
+        _indices.resize(offset);
+
+        for (size_t i = 0; i < _light_clusters.size(); i += 2)
+        {
+            uint32_t cluster = _light_clusters[i];
+            uint32_t &written = _ranges[cluster * 2 + 1];
+
+            if (written < _counts[cluster])
+            {
+                _indices[_ranges[cluster * 2] + written] = _light_clusters[i + 1];
+                written++;
+            }
+        }
+
+        _ranges_buffer.set_sub_data(_ranges.data(), _ranges.size() * sizeof(uint32_t), 0);
+
+        if (!_indices.empty())
+        {
+            _indices_buffer.set_sub_data(_indices.data(), _indices.size() * sizeof(uint32_t), 0);
+        }
+    }
+
+    void ClusteredLighting::update(const float *view, const float *projection, float near, float far, int width, int height)
+    {
+        if (!capabilities().compute)
+        {
+            return;
+        }
+
+        size_t light_count = std::min(lights.size(), _max_lights);
+
+        if (light_count < lights.size())
+        {
+            debug::log("ClusteredLighting supports {} lights, ignoring {}", _max_lights, lights.size() - light_count);
+        }
+
+        _view_lights.resize(light_count);
+
+        for (size_t i = 0; i < light_count; i++)
+        {
+            const Light &light = lights[i];
+            GpuLight &gpu = _view_lights[i];
+
+            for (int row = 0; row < 3; row++)
+            {
+                gpu.position_range[row] = view[row] * light.position[0] + view[4 + row] * light.position[1] + view[8 + row] * light.position[2] + view[12 + row];
+                gpu.direction_cos[row] = view[row] * light.direction[0] + view[4 + row] * light.direction[1] + view[8 + row] * light.direction[2];
+            }
+
+            gpu.position_range[3] = light.range;
+            std::copy(light.color, light.color + 3, gpu.color_intensity);
+            gpu.color_intensity[3] = light.intensity;
+            gpu.direction_cos[3] = light.spot_cos;
+        }
+
+        _params.grid[0] = _grid[0];
+        _params.grid[1] = _grid[1];
+        _params.grid[2] = _grid[2];
+        _params.grid[3] = (uint32_t)light_count;
+        _params.screen[0] = (float)width;
+        _params.screen[1] = (float)height;
+        _params.screen[2] = near;
+        _params.screen[3] = far;
+        invert_matrix(projection, _params.inverse_projection);
+        _params.limits[0] = (uint32_t)_max_indices;
+        _params.limits[1] = _params.limits[2] = _params.limits[3] = 0;
+
+        _params_buffer.set_sub_data(&_params, sizeof(ClusterParams), 0);
+
+        if (light_count > 0)
+        {
+            _lights_buffer.set_sub_data(_view_lights.data(), light_count * sizeof(GpuLight), 0);
+        }
+
+        if (!use_compute)
+        {
+            _cull_cpu();
+            return;
+        }
+
+        const uint32_t zero = 0;
+        _counter_buffer.set_sub_data(&zero, sizeof(zero), 0);
+
+        bind_buffer("ClusterParams", _params_buffer);
+        bind_buffer("ClusterLights", _lights_buffer);
+        bind_buffer("ClusterRanges", _ranges_buffer);
+        bind_buffer("ClusterIndices", _indices_buffer);
+        bind_buffer("ClusterCounter", _counter_buffer);
+
+        _cull.use();
+        dispatch((uint32_t)((_bounds[0].size() + 127) / 128));
+        memory_barrier(Barrier::ShaderStorage);
+    }
+
+    void ClusteredLighting::bind()
+    {
+        if (!capabilities().compute)
+        {
+            return;
+        }
+
+        bind_buffer("ClusterParams", _params_buffer);
+        bind_buffer("ClusterLights", _lights_buffer);
+        bind_buffer("ClusterRanges", _ranges_buffer);
+        bind_buffer("ClusterIndices", _indices_buffer);
+    }
+}
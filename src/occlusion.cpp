@@ -0,0 +1,212 @@
+#include "occlusion.hpp"
+
+namespace gfx
+{
+    static const char *proxy_vertex_source = R"(#version 330 core
+uniform mat4 u_view_projection;
+uniform vec3 u_min;
+uniform vec3 u_max;
+
+const int corners[36] = int[36](
+    0, 2, 6, 0, 6, 4,
+    1, 5, 7, 1, 7, 3,
+    0, 4, 5, 0, 5, 1,
+    2, 3, 7, 2, 7, 6,
+    0, 1, 3, 0, 3, 2,
+    4, 6, 7, 4, 7, 5);
+
+void main()
+{
+    int c = corners[gl_VertexID];
+    vec3 t = vec3(c & 1, (c >> 1) & 1, (c >> 2) & 1);
+    gl_Position = u_view_projection * vec4(mix(u_min, u_max, t), 1.0);
+}
+)";
+
+    static const char *proxy_fragment_source = R"(#version 330 core
+out vec4 color;
+
+void main()
+{
+    color = vec4(1.0);
+}
+)";
+
+    OcclusionCuller::OcclusionCuller()
+    {
+        ShaderModule vertex(ShaderType::Vertex);
+        vertex.set_source(proxy_vertex_source);
+        vertex.compile();
+
+        ShaderModule fragment(ShaderType::Fragment);
+        fragment.set_source(proxy_fragment_source);
+        fragment.compile();
+
+        _pipeline.attach_shader(vertex);
+        _pipeline.attach_shader(fragment);
+        _pipeline.link();
+
+        _view_projection = _pipeline.get_uniform("u_view_projection");
+        _min = _pipeline.get_uniform("u_min");
+        _max = _pipeline.get_uniform("u_max");
+    }
+
+    size_t OcclusionCuller::add(const float *min, const float *max)
+    {
+        size_t handle;
+
+        if (!_free.empty())
+        {
+            handle = _free.back();
+            _free.pop_back();
+        }
+        else
+        {
+            handle = _proxies.size();
+            _proxies.emplace_back();
+            _proxies[handle].query = std::make_unique<Query>(QueryType::AnySamplesPassed);
+        }
+
+        // A reused proxy starts over, a result still in flight belonged to the removed object
+        _proxies[handle].active = true;
+        _proxies[handle].issued = false;
+        _proxies[handle].pending = false;
+        _proxies[handle].visible = true;
+        set_bounds(handle, min, max);
+        return handle;
+    }
+
+    void OcclusionCuller::remove(size_t handle)
+    {
+        Proxy &proxy = _proxies[handle];
+
+        if (!proxy.active)
+        {
+            return;
+        }
+
+        proxy.active = false;
+        proxy.issued = false;
+        proxy.pending = false; // The result of a query in flight is never read
+        proxy.visible = true;
+        _free.push_back(handle); // The query object is kept for the next add
+    }
+
+    void OcclusionCuller::set_bounds(size_t handle, const float *min, const float *max)
+    {
+        Proxy &proxy = _proxies[handle];
+
+        for (int i = 0; i < 3; i++)
+        {
+            proxy.min[i] = min[i];
+            proxy.max[i] = max[i];
+        }
+    }
+
+    // Whether any corner of the box lies in front of the near plane, z < -w in clip space. Such a proxy
+    // is clipped by the near plane and would report the object occluded.
+    static bool crosses_near_plane(const float *view_projection, const float *min, const float *max)
+    {
+        for (int c = 0; c < 8; c++)
+        {
+            float x = (c & 1) ? max[0] : min[0];
+            float y = (c & 2) ? max[1] : min[1];
+            float z = (c & 4) ? max[2] : min[2];
+
+            float clip_z = view_projection[2] * x + view_projection[6] * y + view_projection[10] * z + view_projection[14];
+            float clip_w = view_projection[3] * x + view_projection[7] * y + view_projection[11] * z + view_projection[15];
+
+            if (clip_z < -clip_w)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void OcclusionCuller::render_proxies(float *view_projection, const float *eye)
+    {
+        bool culling = backface_culling_enabled();
+        bool conditional = capabilities().conditional_render;
+
+        enable_color_write(false);
+        enable_depth_write(false);
+        enable_depth_test(true);
+        enable_backface_culling(false);
+
+        _pipeline.use();
+        _view_projection.set_mat4(view_projection);
+        _vertex_array.bind();
+
+        for (Proxy &proxy : _proxies)
+        {
+            proxy.issued = false;
+
+            if (!proxy.active)
+            {
+                continue;
+            }
+
+            bool inside = true;
+            for (int i = 0; i < 3; i++)
+            {
+                inside = inside && eye[i] >= proxy.min[i] && eye[i] <= proxy.max[i];
+            }
+
+            if (inside || crosses_near_plane(view_projection, proxy.min, proxy.max))
+            {
+                proxy.visible = true;
+                continue;
+            }
+
+            if (!conditional)
+            {
+                if (proxy.pending && !proxy.query->is_available())
+                {
+                    continue; // Keep the last result until the query in flight lands
+                }
+
+                if (proxy.pending)
+                {
+                    proxy.visible = proxy.query->get_result() != 0;
+                }
+            }
+
+            _min.set_vec3(proxy.min[0], proxy.min[1], proxy.min[2]);
+            _max.set_vec3(proxy.max[0], proxy.max[1], proxy.max[2]);
+
+            proxy.query->begin();
+            draw(36);
+            proxy.query->end();
+            proxy.issued = conditional;
+            proxy.pending = !conditional;
+        }
+
+        _vertex_array.unbind();
+
+        enable_color_write(true);
+        enable_depth_write(true);
+        enable_backface_culling(culling);
+    }
+
+    bool OcclusionCuller::begin(size_t handle)
+    {
+        Proxy &proxy = _proxies[handle];
+
+        if (proxy.issued)
+        {
+            begin_conditional_render(*proxy.query, ConditionalRenderMode::NoWait);
+        }
+
+        return proxy.issued || proxy.visible;
+    }
+
+    void OcclusionCuller::end(size_t handle)
+    {
+        if (_proxies[handle].issued)
+        {
+            end_conditional_render();
+        }
+    }
+}
@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <vector>
+
+#include "debug.hpp"
+#include "overdraw.hpp"
+
+namespace gfx
+{
+    static const char *count_fragment_source = R"(#version 330 core
+layout(location = 0) out vec4 color;
+
+void main()
+{
+    color = vec4(1.0, 0.0, 0.0, 1.0);
+}
+)";
+
+    static const char *heatmap_vertex_source = R"(#version 330 core
+void main()
+{
+    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+    static const char *heatmap_fragment_source = R"(#version 330 core
+uniform sampler2D u_counter;
+uniform float u_max_layers;
+out vec4 color;
+
+void main()
+{
+    float layers = texelFetch(u_counter, ivec2(gl_FragCoord.xy), 0).r;
+    float t = clamp(layers / u_max_layers, 0.0, 1.0);
+
+    vec3 cold = mix(vec3(0.0, 0.0, 0.5), vec3(0.0, 1.0, 0.0), clamp(t * 2.0, 0.0, 1.0));
+    vec3 hot = mix(vec3(1.0, 1.0, 0.0), vec3(1.0, 0.0, 0.0), clamp(t * 2.0 - 1.0, 0.0, 1.0));
+    color = vec4(layers > 0.0 ? (t < 0.5 ? cold : hot) : vec3(0.0), 1.0);
+}
+)";
+
+    // Counts stay exact up to 2048 layers in half floats, for contexts that can't blend into R32F
+    static TextureFormat counter_format()
+    {
+        return capabilities().float_blend ? TextureFormat::R32F : TextureFormat::R16F;
+    }
+
+    // 8-bit targets saturate after one layer, so without float color buffers there is nothing to count into
+    static bool counting_supported()
+    {
+        return capabilities().color_buffer_half_float;
+    }
+
+    OverdrawView::OverdrawView(int width, int height)
+        : _width(width),
+          _height(height),
+          _counter(width, height, counter_format()),
+          _depth(width, height, TextureFormat::Depth),
+          _framebuffer(width, height),
+          _count_shader(ShaderType::Fragment)
+    {
+        Sampler sampler(SamplerFilter::Nearest, SamplerFilter::Nearest, SamplerWrap::ClampToEdge, SamplerWrap::ClampToEdge);
+        _counter._apply_sampler(sampler);
+
+        _framebuffer.attach(AttachmentType::Color0, _counter);
+        _framebuffer.attach(AttachmentType::Depth, _depth);
+
+        _count_shader.set_source(count_fragment_source);
+        _count_shader.compile();
+
+        ShaderModule vertex(ShaderType::Vertex);
+        vertex.set_source(heatmap_vertex_source);
+        vertex.compile();
+
+        ShaderModule fragment(ShaderType::Fragment);
+        fragment.set_source(heatmap_fragment_source);
+        fragment.compile();
+
+        _heatmap.attach_shader(vertex);
+        _heatmap.attach_shader(fragment);
+        _heatmap.link();
+
+        _heatmap_counter = _heatmap.get_uniform("u_counter");
+        _heatmap_max_layers = _heatmap.get_uniform("u_max_layers");
+
+        if (!counting_supported())
+        {
+            debug::log("Overdraw view needs float color buffers, this context has {}.{} without them", capabilities().major, capabilities().minor);
+        }
+    }
+
+    OverdrawView::~OverdrawView()
+    {
+        set_fragment_override(nullptr);
+    }
+
+    void OverdrawView::begin_pass()
+    {
+        if (!counting_supported())
+        {
+            return;
+        }
+
+        _framebuffer.bind();
+        viewport(0, 0, _width, _height);
+        clear_color(0.0f, 0.0f, 0.0f, 0.0f);
+        clear();
+
+        set_fragment_override(&_count_shader);
+        enable_blending(true);
+    }
+
+    void OverdrawView::end_pass()
+    {
+        if (!counting_supported())
+        {
+            return;
+        }
+
+        set_fragment_override(nullptr);
+        enable_blending(false);
+        _framebuffer.unbind();
+    }
+
+    void OverdrawView::draw_heatmap(float max_layers)
+    {
+        enable_depth_test(false);
+
+        _heatmap.use();
+        _counter.bind(0);
+        _heatmap_counter.set_int(0);
+        _heatmap_max_layers.set_float(max_layers);
+
+        _vertex_array.bind();
+        draw(3);
+        _vertex_array.unbind();
+
+        _counter.unbind(0);
+    }
+
+    OverdrawStats OverdrawView::read_stats()
+    {
+        if (!counting_supported())
+        {
+            return OverdrawStats();
+        }
+
+        std::vector<float> counters((size_t)_width * _height);
+        _framebuffer.read_pixels(0, 0, _width, _height, TextureFormat::R32F, counters.data());
+
+        OverdrawStats stats;
+        double total = 0.0;
+        size_t covered = 0;
+
+        for (float layers : counters)
+        {
+            if (layers > 0.0f)
+            {
+                total += layers;
+                covered++;
+                stats.max_layers = std::max(stats.max_layers, layers);
+            }
+        }
+
+        if (covered > 0)
+        {
+            stats.average_layers = (float)(total / covered);
+            stats.coverage = (float)covered / counters.size();
+        }
+
+        return stats;
+    }
+}
@@ -0,0 +1,478 @@
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "particles.hpp"
+
+namespace gfx
+{
+    static const char *particle_common = R"(#version 430 core
+layout(local_size_x = 256) in;
+
+struct Particle
+{
+    vec4 position_age;
+    vec4 velocity_lifetime;
+    vec4 color;
+};
+
+layout(std430) buffer ParticlesIn
+{
+    Particle particles_in[];
+};
+
+layout(std430) buffer ParticlesOut
+{
+    Particle particles_out[];
+};
+
+layout(std430) buffer AliveFlags
+{
+    uint alive_flags[];
+};
+
+layout(std430) buffer ParticleCounter
+{
+    uint alive_count;
+    uint draw_vertex_count;
+    uint draw_instance_count;
+    uint draw_first_vertex;
+    uint draw_base_instance;
+};
+
+uniform uint u_capacity;
+)";
+
+    static const char *simulate_source = R"(
+uniform float u_delta_time;
+uniform vec3 u_gravity;
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+
+    if (i >= u_capacity)
+    {
+        return;
+    }
+
+    uint alive = 0u;
+
+    if (i < alive_count)
+    {
+        Particle p = particles_in[i];
+        p.position_age.w += u_delta_time;
+        p.velocity_lifetime.xyz += u_gravity * u_delta_time;
+        p.position_age.xyz += p.velocity_lifetime.xyz * u_delta_time;
+        particles_in[i] = p;
+        alive = p.position_age.w < p.velocity_lifetime.w ? 1u : 0u;
+    }
+
+    alive_flags[i] = alive;
+}
+)";
+
+    static const char *compact_source = R"(
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+
+    if (i >= alive_count)
+    {
+        return;
+    }
+
+    Particle p = particles_in[i];
+
+    if (p.position_age.w < p.velocity_lifetime.w)
+    {
+        particles_out[alive_flags[i]] = p;
+    }
+}
+)";
+
+    static const char *particle_random = R"(
+uint hash(uint x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+float random(inout uint state)
+{
+    state = hash(state);
+    return float(state) / 4294967295.0;
+}
+
+)";
+
+    static const char *emit_source = R"(
+layout(std430) buffer ScanTotal
+{
+    uint scan_total;
+};
+
+uniform uint u_emit_count;
+uniform uint u_seed;
+uniform vec3 u_origin;
+uniform vec3 u_velocity;
+uniform float u_spread;
+uniform float u_lifetime;
+uniform vec4 u_color;
+
+void main()
+{
+    uint j = gl_GlobalInvocationID.x;
+    uint total = scan_total;
+    uint slot = total + j;
+
+    if (j < u_emit_count && slot < u_capacity)
+    {
+        uint state = hash(u_seed ^ hash(j));
+        vec3 jitter = vec3(random(state), random(state), random(state)) * 2.0 - 1.0;
+
+        Particle p;
+        p.position_age = vec4(u_origin, 0.0);
+        p.velocity_lifetime = vec4(u_velocity + jitter * u_spread, u_lifetime * (0.75 + 0.5 * random(state)));
+        p.color = u_color;
+        particles_out[slot] = p;
+    }
+
+    if (j == 0u)
+    {
+        uint count = min(total + u_emit_count, u_capacity);
+        alive_count = count;
+        draw_vertex_count = 6u;
+        draw_instance_count = count;
+        draw_first_vertex = 0u;
+        draw_base_instance = 0u;
+    }
+}
+)";
+
+    // Transform feedback backend: one vertex per slot, the outputs are the slot's next state
+    static const char *feedback_vertex_source = R"(#version 330 core
+layout(location = 0) in vec4 a_position_age;
+layout(location = 1) in vec4 a_velocity_lifetime;
+layout(location = 2) in vec4 a_color;
+
+uniform float u_delta_time;
+uniform vec3 u_gravity;
+uniform uint u_capacity;
+uniform uint u_emit_offset;
+uniform uint u_emit_count;
+uniform uint u_seed;
+uniform vec3 u_origin;
+uniform vec3 u_velocity;
+uniform float u_spread;
+uniform float u_lifetime;
+uniform vec4 u_color;
+
+out vec4 f_position_age;
+out vec4 f_velocity_lifetime;
+out vec4 f_color;
+)";
+
+    static const char *feedback_main_source = R"(
+void main()
+{
+    uint i = uint(gl_VertexID);
+    vec4 position_age = a_position_age;
+    vec4 velocity_lifetime = a_velocity_lifetime;
+    vec4 color = a_color;
+
+    if (position_age.w < velocity_lifetime.w)
+    {
+        position_age.w += u_delta_time;
+        velocity_lifetime.xyz += u_gravity * u_delta_time;
+        position_age.xyz += velocity_lifetime.xyz * u_delta_time;
+    }
+    else if ((i + u_capacity - u_emit_offset) % u_capacity < u_emit_count)
+    {
+        uint state = hash(u_seed ^ hash(i));
+        vec3 jitter = vec3(random(state), random(state), random(state)) * 2.0 - 1.0;
+
+        position_age = vec4(u_origin, 0.0);
+        velocity_lifetime = vec4(u_velocity + jitter * u_spread, u_lifetime * (0.75 + 0.5 * random(state)));
+        color = u_color;
+    }
+
+    f_position_age = position_age;
+    f_velocity_lifetime = velocity_lifetime;
+    f_color = color;
+}
+)";
+
+    static const char *feedback_fragment_source = R"(#version 330 core
+out vec4 color;
+
+void main()
+{
+    color = vec4(0.0);
+}
+)";
+
+    static const char *render_vertex_source = R"(#version 330 core
+layout(location = 0) in vec4 a_position_age;
+layout(location = 1) in vec4 a_velocity_lifetime;
+layout(location = 2) in vec4 a_color;
+
+uniform mat4 u_view_projection;
+uniform vec3 u_camera_right;
+uniform vec3 u_camera_up;
+uniform float u_size;
+
+out vec2 v_offset;
+out vec4 v_color;
+
+const int corners[6] = int[6](0, 1, 2, 2, 1, 3);
+
+void main()
+{
+    // Dead slots only reach the renderer on the transform feedback backend, place them outside the clip volume
+    if (a_position_age.w >= a_velocity_lifetime.w)
+    {
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+        v_offset = vec2(0.0);
+        v_color = vec4(0.0);
+        return;
+    }
+
+    int corner = corners[gl_VertexID];
+    vec2 t = vec2(corner & 1, corner >> 1);
+    vec2 local = (t - 0.5) * u_size;
+
+    vec3 position = a_position_age.xyz + u_camera_right * local.x + u_camera_up * local.y;
+    gl_Position = u_view_projection * vec4(position, 1.0);
+
+    float life = clamp(a_position_age.w / a_velocity_lifetime.w, 0.0, 1.0);
+    v_offset = t * 2.0 - 1.0;
+    v_color = vec4(a_color.rgb, a_color.a * (1.0 - life));
+}
+)";
+
+    static const char *render_fragment_source = R"(#version 330 core
+in vec2 v_offset;
+in vec4 v_color;
+out vec4 color;
+
+void main()
+{
+    float falloff = 1.0 - smoothstep(0.5, 1.0, length(v_offset));
+    color = vec4(v_color.rgb, v_color.a * falloff);
+}
+)";
+
+    static uint32_t groups_for(size_t count)
+    {
+        return (uint32_t)std::max<size_t>((count + 255) / 256, 1);
+    }
+
+    ParticleSystem::ParticleSystem(size_t capacity)
+        : capacity(capacity),
+          backend(simulation_backend()),
+          _alive_flags(BufferType::ShaderStorage),
+          _counter(BufferType::ShaderStorage)
+    {
+        bool compute = backend == SimulationBackend::Compute;
+
+        // Feedback slots start out dead, age past lifetime
+        std::vector<ParticleData> dead(compute ? 0 : capacity, ParticleData{{0.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 0.0f}});
+
+        for (int i = 0; i < 2; i++)
+        {
+            _particles[i] = std::make_unique<Buffer>(compute ? BufferType::ShaderStorage : BufferType::Array);
+            _particles[i]->set_data(compute ? nullptr : dead.data(), capacity * sizeof(ParticleData), BufferUsage::DynamicDraw);
+
+            _vertex_arrays[i] = std::make_unique<VertexArray>();
+            _vertex_arrays[i]->set_attribute(0, *_particles[i], 4, DataType::Float, sizeof(ParticleData), offsetof(ParticleData, position_age));
+            _vertex_arrays[i]->set_attribute(1, *_particles[i], 4, DataType::Float, sizeof(ParticleData), offsetof(ParticleData, velocity_lifetime));
+            _vertex_arrays[i]->set_attribute(2, *_particles[i], 4, DataType::Float, sizeof(ParticleData), offsetof(ParticleData, color));
+
+            for (size_t index = 0; index < 3; index++)
+            {
+                _vertex_arrays[i]->set_attribute_divisor(index, 1);
+            }
+        }
+
+        if (compute)
+        {
+            _scan = std::make_unique<PrefixScan>(capacity);
+            _alive_flags.set_data(nullptr, capacity * sizeof(uint32_t), BufferUsage::DynamicDraw);
+
+            const uint32_t counter[5] = {0, 6, 0, 0, 0};
+            _counter.set_data(counter, sizeof(counter), BufferUsage::DynamicDraw);
+
+            build_compute_pipeline(_simulate, (std::string(particle_common) + simulate_source).c_str());
+            build_compute_pipeline(_compact, (std::string(particle_common) + compact_source).c_str());
+            build_compute_pipeline(_emit, (std::string(particle_common) + particle_random + emit_source).c_str());
+
+            _get_uniforms(_simulate, _emit);
+            _compact_capacity = _compact.get_uniform("u_capacity");
+        }
+        else
+        {
+            for (int i = 0; i < 2; i++)
+            {
+                _feedback_arrays[i] = std::make_unique<VertexArray>();
+                _feedback_arrays[i]->set_attribute(0, *_particles[i], 4, DataType::Float, sizeof(ParticleData), offsetof(ParticleData, position_age));
+                _feedback_arrays[i]->set_attribute(1, *_particles[i], 4, DataType::Float, sizeof(ParticleData), offsetof(ParticleData, velocity_lifetime));
+                _feedback_arrays[i]->set_attribute(2, *_particles[i], 4, DataType::Float, sizeof(ParticleData), offsetof(ParticleData, color));
+
+                _feedbacks[i] = std::make_unique<TransformFeedback>();
+                _feedbacks[i]->attach(0, *_particles[1 - i]);
+            }
+
+            std::string source = std::string(feedback_vertex_source) + particle_random + feedback_main_source;
+            ShaderModule feedback_vertex(ShaderType::Vertex);
+            feedback_vertex.set_source(source.c_str());
+            feedback_vertex.compile();
+
+            ShaderModule feedback_fragment(ShaderType::Fragment);
+            feedback_fragment.set_source(feedback_fragment_source);
+            feedback_fragment.compile();
+
+            _feedback_simulate.attach_shader(feedback_vertex);
+            _feedback_simulate.attach_shader(feedback_fragment);
+            _feedback_simulate.set_feedback_varyings({"f_position_age", "f_velocity_lifetime", "f_color"});
+            _feedback_simulate.link();
+
+            _get_uniforms(_feedback_simulate, _feedback_simulate);
+            _feedback_emit_offset = _feedback_simulate.get_uniform("u_emit_offset");
+        }
+
+        ShaderModule vertex(ShaderType::Vertex);
+        vertex.set_source(render_vertex_source);
+        vertex.compile();
+
+        ShaderModule fragment(ShaderType::Fragment);
+        fragment.set_source(render_fragment_source);
+        fragment.compile();
+
+        _render.attach_shader(vertex);
+        _render.attach_shader(fragment);
+        _render.link();
+
+        _render_view_projection = _render.get_uniform("u_view_projection");
+        _render_camera_right = _render.get_uniform("u_camera_right");
+        _render_camera_up = _render.get_uniform("u_camera_up");
+        _render_size = _render.get_uniform("u_size");
+    }
+
+    void ParticleSystem::_get_uniforms(Pipeline &simulate, Pipeline &emit)
+    {
+        _simulate_capacity = simulate.get_uniform("u_capacity");
+        _simulate_delta_time = simulate.get_uniform("u_delta_time");
+        _simulate_gravity = simulate.get_uniform("u_gravity");
+
+        _emit_capacity = emit.get_uniform("u_capacity");
+        _emit_count = emit.get_uniform("u_emit_count");
+        _emit_seed = emit.get_uniform("u_seed");
+        _emit_origin = emit.get_uniform("u_origin");
+        _emit_velocity = emit.get_uniform("u_velocity");
+        _emit_spread = emit.get_uniform("u_spread");
+        _emit_lifetime = emit.get_uniform("u_lifetime");
+        _emit_color = emit.get_uniform("u_color");
+    }
+
+    void ParticleSystem::_set_emitter(uint32_t emit_count)
+    {
+        _emit_capacity.set_uint((uint32_t)capacity);
+        _emit_count.set_uint(emit_count);
+        _emit_seed.set_uint(_seed++ * 2654435761u);
+        _emit_origin.set_vec3(emitter.origin[0], emitter.origin[1], emitter.origin[2]);
+        _emit_velocity.set_vec3(emitter.velocity[0], emitter.velocity[1], emitter.velocity[2]);
+        _emit_spread.set_float(emitter.spread);
+        _emit_lifetime.set_float(emitter.lifetime);
+        _emit_color.set_vec4(emitter.color[0], emitter.color[1], emitter.color[2], emitter.color[3]);
+    }
+
+    void ParticleSystem::_bind_particles(int input)
+    {
+        // Blocks are bound by name, every particle pipeline sees the same binding points
+        bind_buffer("ParticlesIn", *_particles[input]);
+        bind_buffer("ParticlesOut", *_particles[1 - input]);
+        bind_buffer("AliveFlags", _alive_flags);
+        bind_buffer("ParticleCounter", _counter);
+    }
+
+    void ParticleSystem::_update_feedback(float delta_time, uint32_t emit_count)
+    {
+        _feedback_simulate.use();
+        _simulate_delta_time.set_float(delta_time);
+        _simulate_gravity.set_vec3(gravity[0], gravity[1], gravity[2]);
+        _feedback_emit_offset.set_uint(_emit_offset);
+        _set_emitter(emit_count);
+
+        enable_rasterizer_discard(true);
+        _feedback_arrays[_current]->bind();
+        _feedbacks[_current]->begin(PrimitiveType::Points);
+        draw(capacity, 1, 0, 0, PrimitiveType::Points);
+        _feedbacks[_current]->end();
+        _feedback_arrays[_current]->unbind();
+        enable_rasterizer_discard(false);
+
+        _emit_offset = (uint32_t)((_emit_offset + emit_count) % capacity);
+        _current = 1 - _current;
+    }
+
+    void ParticleSystem::update(float delta_time, uint32_t emit_count)
+    {
+        if (backend == SimulationBackend::TransformFeedback)
+        {
+            _update_feedback(delta_time, emit_count);
+            return;
+        }
+
+        _bind_particles(_current);
+
+        _simulate.use();
+        _simulate_capacity.set_uint((uint32_t)capacity);
+        _simulate_delta_time.set_float(delta_time);
+        _simulate_gravity.set_vec3(gravity[0], gravity[1], gravity[2]);
+        dispatch(groups_for(capacity));
+        memory_barrier(Barrier::ShaderStorage);
+
+        _scan->exclusive(_alive_flags, capacity);
+
+        _compact.use();
+        _compact_capacity.set_uint((uint32_t)capacity);
+        dispatch(groups_for(capacity));
+        memory_barrier(Barrier::ShaderStorage);
+
+        bind_buffer("ScanTotal", _scan->total());
+        _emit.use();
+        _set_emitter(emit_count);
+        dispatch(groups_for(emit_count));
+        memory_barrier(Barrier::ShaderStorage | Barrier::VertexAttribArray | Barrier::Command);
+
+        _current = 1 - _current;
+    }
+
+    void ParticleSystem::render(float *view_projection, const float *camera_right, const float *camera_up)
+    {
+        _render.use();
+        _render_view_projection.set_mat4(view_projection);
+        _render_camera_right.set_vec3(camera_right[0], camera_right[1], camera_right[2]);
+        _render_camera_up.set_vec3(camera_up[0], camera_up[1], camera_up[2]);
+        _render_size.set_float(size);
+
+        _vertex_arrays[_current]->bind();
+
+        if (backend == SimulationBackend::Compute)
+        {
+            draw_indirect(_counter, sizeof(uint32_t));
+        }
+        else
+        {
+            draw(6, capacity);
+        }
+
+        _vertex_arrays[_current]->unbind();
+    }
+}
@@ -0,0 +1,429 @@
+#include <algorithm>
+#include <cmath>
+
+#include "debug.hpp"
+#include "postprocess.hpp"
+
+namespace gfx
+{
+    static const char *post_vertex_source = R"(#version 330 core
+out vec2 v_uv;
+
+void main()
+{
+    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    v_uv = position;
+    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
+)";
+
+    // Dual filter taps: the centre and four half-texel diagonals, each bilinear fetch averaging four texels
+    static std::string downsample_code(const std::string &input)
+    {
+        std::string t = "u_" + input + "_texel";
+        std::string s = "u_" + input;
+
+        return "vec2 t = " + t + " * 0.5;\n"
+               "color = color * 4.0 + texture(" + s + ", uv + vec2(-t.x, -t.y)) + texture(" + s + ", uv + vec2(t.x, -t.y))\n"
+               "    + texture(" + s + ", uv + vec2(-t.x, t.y)) + texture(" + s + ", uv + vec2(t.x, t.y));\n"
+               "color *= 0.125;\n";
+    }
+
+    PostChain::PostChain(RenderTargetPool &pool) : _pool(pool)
+    {
+    }
+
+    void PostChain::add(const PostPass &pass)
+    {
+        passes.push_back(pass);
+        _dirty = true;
+    }
+
+    void PostChain::set_input(const std::string &name, Image &image, int width, int height)
+    {
+        _external[name] = {&image, width, height};
+    }
+
+    void PostChain::add_bloom(const std::string &input, const std::string &output, int levels)
+    {
+        levels = std::max(levels, 1);
+        std::string previous = input;
+
+        for (int level = 0; level < levels; level++)
+        {
+            PostPass down;
+            down.inputs = {previous};
+            down.output = output + "_down" + std::to_string(level);
+            down.scale = 1.0f / (float)(2 << level);
+            down.code = downsample_code(previous);
+
+            if (level == 0)
+            {
+                down.declarations = "uniform float u_bloom_threshold;\n";
+                down.code += "float brightness = max(color.r, max(color.g, color.b));\n"
+                             "color.rgb *= max(brightness - u_bloom_threshold, 0.0) / max(brightness, 1e-4);\n";
+                down.uniforms = {"u_bloom_threshold"};
+                down.set_uniforms = [this](std::vector<Uniform> &uniforms)
+                {
+                    uniforms[0].set_float(settings.bloom_threshold);
+                };
+            }
+
+            add(down);
+            previous = down.output;
+        }
+
+        for (int level = levels - 2; level >= 0; level--)
+        {
+            std::string current = output + "_down" + std::to_string(level);
+            std::string s = "u_" + previous;
+
+            PostPass up;
+            up.inputs = {current, previous};
+            up.output = level == 0 ? output : output + "_up" + std::to_string(level);
+            up.scale = 1.0f / (float)(2 << level);
+            up.code = "vec2 t = " + s + "_texel * 0.5;\n"
+                      "vec4 sum = texture(" + s + ", uv + vec2(-t.x * 2.0, 0.0)) + texture(" + s + ", uv + vec2(t.x * 2.0, 0.0))\n"
+                      "    + texture(" + s + ", uv + vec2(0.0, -t.y * 2.0)) + texture(" + s + ", uv + vec2(0.0, t.y * 2.0));\n"
+                      "sum += (texture(" + s + ", uv + vec2(-t.x, t.y)) + texture(" + s + ", uv + vec2(t.x, t.y))\n"
+                      "    + texture(" + s + ", uv + vec2(-t.x, -t.y)) + texture(" + s + ", uv + vec2(t.x, -t.y))) * 2.0;\n"
+                      "color += sum / 12.0;\n";
+
+            add(up);
+            previous = up.output;
+        }
+
+        if (levels == 1)
+        {
+            passes.back().output = output;
+        }
+    }
+
+    void PostChain::add_tonemap(const std::string &input, const std::string &output, const std::string &bloom)
+    {
+        PostPass pass;
+        pass.inputs = {input};
+        pass.output = output;
+        pass.per_pixel = true;
+        pass.declarations = "uniform float u_exposure;\nuniform float u_bloom_intensity;\n";
+
+        if (!bloom.empty())
+        {
+            pass.inputs.push_back(bloom);
+            pass.code = "color.rgb += texture(u_" + bloom + ", uv).rgb * u_bloom_intensity;\n";
+        }
+
+        // Narkowicz's ACES fit
+        pass.code += "vec3 c = color.rgb * u_exposure;\n"
+                     "color.rgb = clamp((c * (2.51 * c + 0.03)) / (c * (2.43 * c + 0.59) + 0.14), 0.0, 1.0);\n";
+        pass.uniforms = {"u_exposure", "u_bloom_intensity"};
+        pass.set_uniforms = [this](std::vector<Uniform> &uniforms)
+        {
+            uniforms[0].set_float(settings.exposure);
+            uniforms[1].set_float(settings.bloom_intensity);
+        };
+
+        add(pass);
+    }
+
+    void PostChain::add_color_grade(const std::string &input, const std::string &output)
+    {
+        PostPass pass;
+        pass.inputs = {input};
+        pass.output = output;
+        pass.per_pixel = true;
+        pass.declarations = "uniform float u_grade_saturation;\nuniform float u_grade_contrast;\nuniform vec3 u_grade_tint;\n";
+        pass.code = "float luma = dot(color.rgb, vec3(0.2126, 0.7152, 0.0722));\n"
+                    "color.rgb = mix(vec3(luma), color.rgb, u_grade_saturation);\n"
+                    "color.rgb = (color.rgb - 0.5) * u_grade_contrast + 0.5;\n"
+                    "color.rgb = clamp(color.rgb * u_grade_tint, 0.0, 1.0);\n";
+        pass.uniforms = {"u_grade_saturation", "u_grade_contrast", "u_grade_tint"};
+        pass.set_uniforms = [this](std::vector<Uniform> &uniforms)
+        {
+            uniforms[0].set_float(settings.saturation);
+            uniforms[1].set_float(settings.contrast);
+            uniforms[2].set_vec3(settings.tint[0], settings.tint[1], settings.tint[2]);
+        };
+
+        add(pass);
+    }
+
+    void PostChain::add_vignette(const std::string &input, const std::string &output)
+    {
+        PostPass pass;
+        pass.inputs = {input};
+        pass.output = output;
+        pass.per_pixel = true;
+        pass.declarations = "uniform float u_vignette;\n";
+        pass.code = "vec2 d = uv - 0.5;\n"
+                    "color.rgb *= clamp(1.0 - u_vignette * dot(d, d) * 2.0, 0.0, 1.0);\n";
+        pass.uniforms = {"u_vignette"};
+        pass.set_uniforms = [this](std::vector<Uniform> &uniforms)
+        {
+            uniforms[0].set_float(settings.vignette);
+        };
+
+        add(pass);
+    }
+
+    void PostChain::add_dither(const std::string &input, const std::string &output)
+    {
+        PostPass pass;
+        pass.inputs = {input};
+        pass.output = output;
+        pass.per_pixel = true;
+        pass.code = "float noise = fract(sin(dot(gl_FragCoord.xy, vec2(12.9898, 78.233))) * 43758.5453)\n"
+                    "    + fract(sin(dot(gl_FragCoord.xy, vec2(39.3468, 11.1351))) * 24634.6345) - 1.0;\n"
+                    "color.rgb += noise / 255.0;\n";
+
+        add(pass);
+    }
+
+    void PostChain::compile()
+    {
+        _groups.clear();
+
+        // How many passes read each name, a per-pixel pass only absorbs its predecessor's sole reader
+        std::unordered_map<std::string, int> readers;
+        for (auto &pass : passes)
+        {
+            for (auto &input : pass.inputs)
+            {
+                readers[input]++;
+            }
+        }
+
+        for (size_t i = 0; i < passes.size(); i++)
+        {
+            const PostPass &pass = passes[i];
+
+            if (pass.inputs.empty())
+            {
+                debug::log("Post pass writing '{}' has no inputs, skipped", pass.output);
+                continue;
+            }
+
+            if (!_groups.empty())
+            {
+                Group &group = _groups.back();
+                const PostPass &last = passes[group.passes.back()];
+
+                if (pass.per_pixel && last.per_pixel && pass.inputs[0] == group.output && !group.output.empty() && readers[group.output] == 1 && pass.scale == group.scale)
+                {
+                    group.passes.push_back(i);
+                    group.output = pass.output;
+                    group.format = pass.format;
+
+                    for (size_t k = 1; k < pass.inputs.size(); k++)
+                    {
+                        if (std::find(group.inputs.begin(), group.inputs.end(), pass.inputs[k]) == group.inputs.end())
+                        {
+                            group.inputs.push_back(pass.inputs[k]);
+                        }
+                    }
+
+                    continue;
+                }
+            }
+
+            Group group;
+            group.passes = {i};
+            group.output = pass.output;
+            group.scale = pass.scale;
+            group.format = pass.format;
+
+            for (auto &input : pass.inputs)
+            {
+                if (std::find(group.inputs.begin(), group.inputs.end(), input) == group.inputs.end())
+                {
+                    group.inputs.push_back(input);
+                }
+            }
+
+            _groups.push_back(std::move(group));
+        }
+
+        ShaderModule vertex(ShaderType::Vertex);
+        vertex.set_source(post_vertex_source);
+        vertex.compile();
+
+        for (auto &group : _groups)
+        {
+            std::string source = "#version 330 core\nin vec2 v_uv;\nout vec4 out_color;\n";
+
+            for (auto &input : group.inputs)
+            {
+                source += "uniform sampler2D u_" + input + ";\nuniform vec2 u_" + input + "_texel;\n";
+            }
+
+            for (size_t index : group.passes)
+            {
+                source += passes[index].declarations;
+            }
+
+            source += "\nvoid main()\n{\n    vec2 uv = v_uv;\n    vec4 color = texture(u_" + group.inputs[0] + ", uv);\n";
+
+            for (size_t index : group.passes)
+            {
+                source += "    {\n" + passes[index].code + "    }\n";
+            }
+
+            source += "    out_color = color;\n}\n";
+
+            ShaderModule fragment(ShaderType::Fragment);
+            fragment.set_source(source.c_str());
+            fragment.compile();
+
+            group.pipeline = std::make_unique<Pipeline>();
+            group.pipeline->attach_shader(vertex);
+            group.pipeline->attach_shader(fragment);
+            group.pipeline->link();
+
+            for (auto &input : group.inputs)
+            {
+                group.samplers.push_back(group.pipeline->get_uniform(("u_" + input).c_str()));
+                group.texels.push_back(group.pipeline->get_uniform(("u_" + input + "_texel").c_str()));
+            }
+
+            for (size_t index : group.passes)
+            {
+                std::vector<Uniform> &uniforms = group.uniforms.emplace_back();
+
+                for (auto &name : passes[index].uniforms)
+                {
+                    uniforms.push_back(group.pipeline->get_uniform(name.c_str()));
+                }
+            }
+        }
+
+        _dirty = false;
+    }
+
+    void PostChain::render(int width, int height, Framebuffer *target)
+    {
+        if (_dirty)
+        {
+            compile();
+        }
+
+        std::unordered_map<std::string, size_t> last_reader;
+        for (size_t i = 0; i < _groups.size(); i++)
+        {
+            for (auto &input : _groups[i].inputs)
+            {
+                last_reader[input] = i;
+            }
+        }
+
+        std::unordered_map<std::string, RenderTarget *> produced;
+
+        enable_depth_test(false);
+        enable_blending(false);
+        _vertex_array.bind();
+
+        for (size_t i = 0; i < _groups.size(); i++)
+        {
+            Group &group = _groups[i];
+            int output_width = std::max((int)std::lround(width * group.scale), 1);
+            int output_height = std::max((int)std::lround(height * group.scale), 1);
+
+            if (group.output.empty())
+            {
+                if (target != nullptr)
+                {
+                    target->bind();
+                }
+                else
+                {
+                    unbind_framebuffer();
+                }
+            }
+            else
+            {
+                RenderTarget *output = _pool.acquire(output_width, output_height, group.format);
+                produced[group.output] = output;
+                output->framebuffer.bind();
+            }
+
+            viewport(0.0f, 0.0f, (float)output_width, (float)output_height);
+            group.pipeline->use();
+
+            for (size_t k = 0; k < group.inputs.size(); k++)
+            {
+                const std::string &name = group.inputs[k];
+                Image *image = nullptr;
+                int input_width = 1;
+                int input_height = 1;
+
+                if (auto it = produced.find(name); it != produced.end())
+                {
+                    image = &it->second->color;
+                    input_width = it->second->width;
+                    input_height = it->second->height;
+                }
+                else if (auto it = _external.find(name); it != _external.end())
+                {
+                    image = it->second.image;
+                    input_width = it->second.width;
+                    input_height = it->second.height;
+                }
+                else
+                {
+                    debug::log("Post input '{}' is neither set nor produced by an earlier pass", name);
+                    continue;
+                }
+
+                image->bind((int)k);
+                group.samplers[k].set_int((int)k);
+                group.texels[k].set_vec2(1.0f / input_width, 1.0f / input_height);
+            }
+
+            for (size_t k = 0; k < group.passes.size(); k++)
+            {
+                const PostPass &pass = passes[group.passes[k]];
+
+                if (pass.set_uniforms)
+                {
+                    pass.set_uniforms(group.uniforms[k]);
+                }
+
+                if (pass.setup)
+                {
+                    pass.setup(*group.pipeline);
+                }
+            }
+
+            draw(3);
+
+            for (auto &input : group.inputs)
+            {
+                auto it = produced.find(input);
+
+                if (it != produced.end() && last_reader[input] == i)
+                {
+                    _pool.release(it->second);
+                    produced.erase(it);
+                }
+            }
+        }
+
+        // Outputs nobody read go back to the pool as well
+        for (auto &[name, output] : produced)
+        {
+            _pool.release(output);
+        }
+
+        _vertex_array.unbind();
+        unbind_framebuffer();
+    }
+
+    size_t PostChain::draw_count()
+    {
+        if (_dirty)
+        {
+            compile();
+        }
+
+        return _groups.size();
+    }
+}
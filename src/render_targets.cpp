@@ -0,0 +1,65 @@
+#include <algorithm>
+
+#include "render_targets.hpp"
+
+namespace gfx
+{
+    RenderTarget::RenderTarget(int width, int height, TextureFormat format, bool with_depth)
+        : width(width),
+          height(height),
+          format(format),
+          color(width, height, format),
+          framebuffer(width, height)
+    {
+        Sampler sampler(SamplerFilter::Linear, SamplerFilter::Linear, SamplerWrap::ClampToEdge, SamplerWrap::ClampToEdge);
+        color._apply_sampler(sampler);
+        framebuffer.attach(AttachmentType::Color0, color);
+
+        if (with_depth)
+        {
+            depth = std::make_unique<Image>(width, height, TextureFormat::Depth);
+            framebuffer.attach(AttachmentType::Depth, *depth);
+        }
+    }
+
+    RenderTarget *RenderTargetPool::acquire(int width, int height, TextureFormat format, bool with_depth)
+    {
+        width = std::max(width, 1);
+        height = std::max(height, 1);
+        format = renderable_format(format);
+
+        for (auto &target : _targets)
+        {
+            if (!target->_in_use && target->width == width && target->height == height && target->format == format && (target->depth != nullptr) == with_depth)
+            {
+                target->_in_use = true;
+                target->_last_used = _frame;
+                return target.get();
+            }
+        }
+
+        _targets.push_back(std::make_unique<RenderTarget>(width, height, format, with_depth));
+        RenderTarget *target = _targets.back().get();
+        target->_in_use = true;
+        target->_last_used = _frame;
+        return target;
+    }
+
+    void RenderTargetPool::release(RenderTarget *target)
+    {
+        target->_in_use = false;
+        target->_last_used = _frame;
+    }
+
+    void RenderTargetPool::end_frame()
+    {
+        _targets.erase(std::remove_if(_targets.begin(), _targets.end(),
+                                      [&](const std::unique_ptr<RenderTarget> &target)
+                                      {
+                                          return !target->_in_use && _frame - target->_last_used > max_idle_frames;
+                                      }),
+                       _targets.end());
+
+        _frame++;
+    }
+}
@@ -0,0 +1,329 @@
+#include <algorithm>
+
+#include "debug.hpp"
+#include "scan.hpp"
+
+namespace gfx
+{
+    static const char *scan_blocks_source = R"(#version 430 core
+layout(local_size_x = 256) in;
+
+layout(std430) buffer ScanData
+{
+    uint scan_data[];
+};
+
+layout(std430) buffer ScanSums
+{
+    uint scan_sums[];
+};
+
+uniform uint u_count;
+uniform uint u_inclusive;
+
+shared uint temp[512];
+
+void main()
+{
+    uint local = gl_LocalInvocationID.x;
+    uint a = gl_WorkGroupID.x * 512u + local;
+    uint b = a + 256u;
+
+    uint value_a = a < u_count ? scan_data[a] : 0u;
+    uint value_b = b < u_count ? scan_data[b] : 0u;
+    temp[local] = value_a;
+    temp[local + 256u] = value_b;
+
+    uint offset = 1u;
+    for (uint d = 256u; d > 0u; d >>= 1)
+    {
+        barrier();
+        if (local < d)
+        {
+            uint ai = offset * (2u * local + 1u) - 1u;
+            uint bi = offset * (2u * local + 2u) - 1u;
+            temp[bi] += temp[ai];
+        }
+        offset <<= 1;
+    }
+
+    if (local == 0u)
+    {
+        scan_sums[gl_WorkGroupID.x] = temp[511];
+        temp[511] = 0u;
+    }
+
+    for (uint d = 1u; d < 512u; d <<= 1)
+    {
+        offset >>= 1;
+        barrier();
+        if (local < d)
+        {
+            uint ai = offset * (2u * local + 1u) - 1u;
+            uint bi = offset * (2u * local + 2u) - 1u;
+            uint t = temp[ai];
+            temp[ai] = temp[bi];
+            temp[bi] += t;
+        }
+    }
+
+    barrier();
+
+    if (a < u_count)
+    {
+        scan_data[a] = temp[local] + (u_inclusive != 0u ? value_a : 0u);
+    }
+
+    if (b < u_count)
+    {
+        scan_data[b] = temp[local + 256u] + (u_inclusive != 0u ? value_b : 0u);
+    }
+}
+)";
+
+    static const char *add_offsets_source = R"(#version 430 core
+layout(local_size_x = 256) in;
+
+layout(std430) buffer ScanData
+{
+    uint scan_data[];
+};
+
+layout(std430) buffer ScanSums
+{
+    uint scan_sums[];
+};
+
+uniform uint u_count;
+
+void main()
+{
+    uint offset = scan_sums[gl_WorkGroupID.x];
+    uint a = gl_WorkGroupID.x * 512u + gl_LocalInvocationID.x;
+    uint b = a + 256u;
+
+    if (a < u_count)
+    {
+        scan_data[a] += offset;
+    }
+
+    if (b < u_count)
+    {
+        scan_data[b] += offset;
+    }
+}
+)";
+
+    void build_compute_pipeline(Pipeline &pipeline, const char *source)
+    {
+        if (!capabilities().compute)
+        {
+            debug::log("Compute shaders need OpenGL 4.3 or OpenGL ES 3.1, this context has {}.{}", capabilities().major, capabilities().minor);
+            return;
+        }
+
+        ShaderModule compute(ShaderType::Compute);
+        compute.set_source(source);
+        compute.compile();
+
+        pipeline.attach_shader(compute);
+        pipeline.link();
+    }
+
+    static uint32_t storage_binding(Pipeline &pipeline, const char *name)
+    {
+        const ShaderResource *resource = pipeline.reflection.find_resource(name);
+
+        if (resource == nullptr)
+        {
+            debug::panic("Compute pipeline is missing the storage block {}", name);
+        }
+
+        return resource->binding;
+    }
+
+    PrefixScan::PrefixScan(size_t capacity) : capacity(capacity)
+    {
+        build_compute_pipeline(_scan_blocks, scan_blocks_source);
+        build_compute_pipeline(_add_offsets, add_offsets_source);
+
+        _scan_count = _scan_blocks.get_uniform("u_count");
+        _scan_inclusive = _scan_blocks.get_uniform("u_inclusive");
+        _add_count = _add_offsets.get_uniform("u_count");
+
+        // Both pipelines name the blocks the same, so they share binding points
+        _data_binding = storage_binding(_scan_blocks, "ScanData");
+        _sums_binding = storage_binding(_scan_blocks, "ScanSums");
+
+        size_t size = capacity;
+
+        do
+        {
+            _sizes.push_back(size);
+            size = (size + block_size - 1) / block_size;
+
+            auto sums = std::make_unique<Buffer>(BufferType::ShaderStorage);
+            sums->set_data(nullptr, size * sizeof(uint32_t), BufferUsage::DynamicDraw);
+            _sums.push_back(std::move(sums));
+        } while (size > 1);
+    }
+
+    void PrefixScan::exclusive(Buffer &data, size_t count)
+    {
+        _scan(data, count, false);
+    }
+
+    void PrefixScan::inclusive(Buffer &data, size_t count)
+    {
+        _scan(data, count, true);
+    }
+
+    void PrefixScan::_scan(Buffer &data, size_t count, bool inclusive)
+    {
+        // Level sizes follow the actual count, the buffers were sized for the capacity
+        std::vector<size_t> sizes;
+        size_t size = count;
+
+        for (size_t level = 0; level < _sums.size(); level++)
+        {
+            sizes.push_back(size);
+            size = (size + block_size - 1) / block_size;
+        }
+
+        _scan_blocks.use();
+
+        for (size_t level = 0; level < _sums.size(); level++)
+        {
+            Buffer &input = level == 0 ? data : *_sums[level - 1];
+            size_t groups = (sizes[level] + block_size - 1) / block_size;
+
+            input.bind_range(_data_binding, 0, std::max<size_t>(sizes[level], 1) * sizeof(uint32_t));
+            _sums[level]->bind_base(_sums_binding);
+            _scan_count.set_uint((uint32_t)sizes[level]);
+            _scan_inclusive.set_uint(inclusive && level == 0 ? 1 : 0); // Block sums are always scanned exclusively
+            dispatch((uint32_t)std::max<size_t>(groups, 1));
+            memory_barrier(Barrier::ShaderStorage);
+        }
+
+        _add_offsets.use();
+
+        for (size_t level = _sums.size() - 1; level-- > 0;)
+        {
+            Buffer &input = level == 0 ? data : *_sums[level - 1];
+            size_t groups = (sizes[level] + block_size - 1) / block_size;
+
+            if (groups <= 1)
+            {
+                continue; // A single block is already complete
+            }
+
+            input.bind_range(_data_binding, 0, sizes[level] * sizeof(uint32_t));
+            _sums[level]->bind_base(_sums_binding);
+            _add_count.set_uint((uint32_t)sizes[level]);
+            dispatch((uint32_t)groups);
+            memory_barrier(Barrier::ShaderStorage);
+        }
+    }
+
+    Buffer &PrefixScan::total()
+    {
+        return *_sums.back();
+    }
+
+    static const char *compact_flags_source = R"(#version 430 core
+layout(local_size_x = 256) in;
+
+layout(std430) buffer CompactFlags
+{
+    uint compact_flags[];
+};
+
+layout(std430) buffer CompactOffsets
+{
+    uint compact_offsets[];
+};
+
+uniform uint u_count;
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+
+    if (i < u_count)
+    {
+        compact_offsets[i] = compact_flags[i] != 0u ? 1u : 0u;
+    }
+}
+)";
+
+    static const char *compact_scatter_source = R"(#version 430 core
+layout(local_size_x = 256) in;
+
+layout(std430) buffer CompactFlags
+{
+    uint compact_flags[];
+};
+
+layout(std430) buffer CompactOffsets
+{
+    uint compact_offsets[];
+};
+
+layout(std430) buffer CompactInput
+{
+    uint compact_input[];
+};
+
+layout(std430) buffer CompactOutput
+{
+    uint compact_output[];
+};
+
+uniform uint u_count;
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+
+    if (i < u_count && compact_flags[i] != 0u)
+    {
+        compact_output[compact_offsets[i]] = compact_input[i];
+    }
+}
+)";
+
+    StreamCompaction::StreamCompaction(size_t capacity) : _scan(capacity), _offsets(BufferType::ShaderStorage)
+    {
+        build_compute_pipeline(_flags, compact_flags_source);
+        build_compute_pipeline(_scatter, compact_scatter_source);
+        _flags_count = _flags.get_uniform("u_count");
+        _scatter_count = _scatter.get_uniform("u_count");
+        _offsets.set_data(nullptr, std::max<size_t>(capacity, 1) * sizeof(uint32_t), BufferUsage::DynamicDraw);
+    }
+
+    void StreamCompaction::compact(Buffer &flags, Buffer &input, Buffer &output, size_t count)
+    {
+        uint32_t groups = (uint32_t)std::max<size_t>((count + 255) / 256, 1);
+
+        bind_buffer("CompactFlags", flags);
+        bind_buffer("CompactOffsets", _offsets);
+        _flags.use();
+        _flags_count.set_uint((uint32_t)count);
+        dispatch(groups);
+        memory_barrier(Barrier::ShaderStorage);
+
+        _scan.exclusive(_offsets, count);
+
+        bind_buffer("CompactInput", input);
+        bind_buffer("CompactOutput", output);
+        _scatter.use();
+        _scatter_count.set_uint((uint32_t)count);
+        dispatch(groups);
+        memory_barrier(Barrier::ShaderStorage);
+    }
+
+    Buffer &StreamCompaction::count()
+    {
+        return _scan.total();
+    }
+}
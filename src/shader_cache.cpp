@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <functional>
+#include <sstream>
+#include <utility>
+
+#include "debug.hpp"
+#include "shader_cache.hpp"
+
+namespace gfx
+{
+    static std::string trim(const std::string &text)
+    {
+        size_t begin = text.find_first_not_of(" \t\r");
+        if (begin == std::string::npos)
+        {
+            return "";
+        }
+
+        size_t end = text.find_last_not_of(" \t\r");
+        return text.substr(begin, end - begin + 1);
+    }
+
+    static std::vector<std::string> normalize_defines(const std::vector<std::string> &defines)
+    {
+        std::vector<std::string> sorted = defines;
+        std::sort(sorted.begin(), sorted.end());
+        sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+        return sorted;
+    }
+
+    void ShaderCache::add_file(const std::string &path, const std::string &source)
+    {
+        auto it = _files.find(path);
+
+        if (it != _files.end() && it->second != source)
+        {
+            clear(); // Cached variants may have been expanded from the old content
+        }
+
+        _files[path] = source;
+    }
+
+    bool ShaderCache::_expand(const std::string &source, const std::string &path, std::unordered_set<std::string> &included, std::string &out)
+    {
+        std::istringstream stream(source);
+        std::string line;
+
+        while (std::getline(stream, line))
+        {
+            std::string directive = trim(line);
+
+            if (!directive.starts_with("#include"))
+            {
+                out += line;
+                out += '\n';
+                continue;
+            }
+
+            size_t open = directive.find_first_of("\"<");
+            size_t close = open == std::string::npos ? std::string::npos : directive.find_first_of("\">", open + 1);
+
+            if (close == std::string::npos)
+            {
+                debug::log("Malformed include in {}: {}", path, directive);
+                return false;
+            }
+
+            std::string include = directive.substr(open + 1, close - open - 1);
+
+            if (!included.insert(include).second)
+            {
+                continue; // Every file is included once per variant, which also breaks cycles
+            }
+
+            auto file = _files.find(include);
+
+            if (file == _files.end())
+            {
+                debug::log("Shader include not found in {}: {}", path, include);
+                return false;
+            }
+
+            if (!_expand(file->second, include, included, out))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    std::string ShaderCache::preprocess(const std::string &source, const std::vector<std::string> &defines)
+    {
+        std::string out;
+        return _preprocess(source, defines, out) ? out : "";
+    }
+
+    bool ShaderCache::_preprocess(const std::string &source, const std::vector<std::string> &defines, std::string &out)
+    {
+        std::string header;
+
+        for (const std::string &define : normalize_defines(defines))
+        {
+            size_t equals = define.find('=');
+
+            if (equals == std::string::npos)
+            {
+                header += "#define " + define + "\n";
+            }
+            else
+            {
+                header += "#define " + define.substr(0, equals) + " " + define.substr(equals + 1) + "\n";
+            }
+        }
+
+        std::unordered_set<std::string> included;
+        std::string expanded;
+
+        if (!_expand(source, "<source>", included, expanded))
+        {
+            return false;
+        }
+
+        // #version has to stay the first statement, the defines go right after it
+        size_t version = expanded.find("#version");
+
+        if (version == std::string::npos)
+        {
+            out = header + expanded;
+            return true;
+        }
+
+        size_t line_end = expanded.find('\n', version);
+        size_t insert = line_end == std::string::npos ? expanded.size() : line_end + 1;
+
+        if (line_end == std::string::npos)
+        {
+            expanded += '\n';
+        }
+
+        expanded.insert(insert, header);
+        out = std::move(expanded);
+        return true;
+    }
+
+    std::shared_ptr<ShaderModule> ShaderCache::get(ShaderType type, const std::string &source, const std::vector<std::string> &defines)
+    {
+        std::string key = std::to_string((uint32_t)type) + ":" + std::to_string(std::hash<std::string>{}(source));
+
+        for (const std::string &define : normalize_defines(defines))
+        {
+            key += ":" + define;
+        }
+
+        auto it = _modules.find(key);
+
+        if (it != _modules.end())
+        {
+            return it->second;
+        }
+
+        std::string preprocessed;
+
+        if (!_preprocess(source, defines, preprocessed))
+        {
+            debug::log("Shader variant {} not compiled, preprocessing failed", key);
+            return nullptr;
+        }
+
+        auto module = std::make_shared<ShaderModule>(type);
+        module->set_source(preprocessed.c_str());
+        module->compile();
+        compile_count++;
+
+        _modules.emplace(key, module);
+        return module;
+    }
+
+    void ShaderCache::clear()
+    {
+        _modules.clear();
+    }
+}
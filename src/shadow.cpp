@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <cstring>
+
+#include "debug.hpp"
+#include "shadow.hpp"
+
+namespace gfx
+{
+    ShadowSystem::ShadowSystem(int atlas_size, int tile_size)
+        : _atlas_size(atlas_size),
+          _tile_size(tile_size),
+          _depth(atlas_size, atlas_size, TextureFormat::Depth32F),
+          _static_depth(atlas_size, atlas_size, TextureFormat::Depth32F),
+          _framebuffer(atlas_size, atlas_size),
+          _static_framebuffer(atlas_size, atlas_size)
+    {
+        _framebuffer.attach(AttachmentType::Depth, _depth);
+        _static_framebuffer.attach(AttachmentType::Depth, _static_depth);
+        _framebuffer.disable_color();
+        _static_framebuffer.disable_color();
+
+        Sampler sampler(SamplerFilter::Linear, SamplerFilter::Linear, SamplerWrap::ClampToEdge, SamplerWrap::ClampToEdge);
+        _depth._apply_sampler(sampler);
+        _depth.set_depth_compare(true);
+
+        int tiles_per_row = atlas_size / tile_size;
+
+        for (int tile = tiles_per_row * tiles_per_row - 1; tile >= 0; tile--)
+        {
+            _free_tiles.push_back(tile);
+        }
+    }
+
+    size_t ShadowSystem::add(uint32_t update_interval, uint32_t phase)
+    {
+        if (_free_tiles.empty())
+        {
+            debug::log("Shadow atlas is full");
+            return SIZE_MAX;
+        }
+
+        size_t handle;
+
+        if (!_free.empty())
+        {
+            handle = _free.back();
+            _free.pop_back();
+        }
+        else
+        {
+            handle = _shadows.size();
+            _shadows.emplace_back();
+        }
+
+        Shadow &shadow = _shadows[handle];
+        shadow = Shadow();
+        shadow.tile = _free_tiles.back();
+        shadow.update_interval = std::max(update_interval, 1u);
+        shadow.phase = phase % shadow.update_interval;
+        shadow.active = true;
+        _free_tiles.pop_back();
+
+        std::fill(shadow.view_projection, shadow.view_projection + 16, 0.0f);
+        std::fill(shadow._pending, shadow._pending + 16, 0.0f);
+
+        return handle;
+    }
+
+    std::vector<size_t> ShadowSystem::add_cascades(uint32_t count)
+    {
+        std::vector<size_t> handles;
+
+        // All or nothing, a partial set of cascades would leave the far splits without a tile
+        if (_free_tiles.size() < count)
+        {
+            debug::log("Shadow atlas has {} free tiles, {} cascades don't fit", _free_tiles.size(), count);
+            return handles;
+        }
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t interval = i < 2 ? 1 : 1u << (i - 1);
+            handles.push_back(add(interval, i));
+        }
+
+        return handles;
+    }
+
+    void ShadowSystem::remove(size_t handle)
+    {
+        Shadow &shadow = _shadows[handle];
+
+        if (!shadow.active)
+        {
+            return;
+        }
+
+        _free_tiles.push_back(shadow.tile);
+        shadow.active = false;
+        shadow.tile = -1;
+        _free.push_back(handle);
+    }
+
+    void ShadowSystem::set_view_projection(size_t handle, const float *view_projection)
+    {
+        std::memcpy(_shadows[handle]._pending, view_projection, sizeof(float) * 16);
+    }
+
+    void ShadowSystem::invalidate_static()
+    {
+        for (auto &shadow : _shadows)
+        {
+            shadow._static_dirty = true;
+        }
+    }
+
+    void ShadowSystem::invalidate_static(size_t handle)
+    {
+        _shadows[handle]._static_dirty = true;
+    }
+
+    void ShadowSystem::_update(Shadow &shadow, const ShadowDrawCallback &draw)
+    {
+        int tiles_per_row = _atlas_size / _tile_size;
+        int x = (shadow.tile % tiles_per_row) * _tile_size;
+        int y = (shadow.tile / tiles_per_row) * _tile_size;
+
+        if (std::memcmp(shadow.view_projection, shadow._pending, sizeof(float) * 16) != 0)
+        {
+            std::memcpy(shadow.view_projection, shadow._pending, sizeof(float) * 16);
+            shadow._static_dirty = true;
+        }
+
+        bool static_updated = shadow._static_dirty;
+
+        if (!static_updated && !shadow.dynamic_casters && shadow._rendered)
+        {
+            return;
+        }
+
+        viewport((float)x, (float)y, (float)_tile_size, (float)_tile_size);
+        scissor(x, y, _tile_size, _tile_size);
+
+        if (shadow._static_dirty)
+        {
+            _static_framebuffer.bind();
+            clear();
+            draw(shadow.view_projection, ShadowCasters::Static);
+            shadow._static_dirty = false;
+        }
+
+        // The cached static depth is the starting point, dynamic casters are depth tested against it
+        _static_framebuffer.blit_depth(_framebuffer, x, y, _tile_size, _tile_size);
+
+        if (shadow.dynamic_casters)
+        {
+            _framebuffer.bind();
+            draw(shadow.view_projection, ShadowCasters::Dynamic);
+        }
+
+        shadow._rendered = true;
+    }
+
+    void ShadowSystem::render(const ShadowDrawCallback &draw)
+    {
+        enable_color_write(false);
+        enable_depth_test(true);
+        enable_depth_write(true);
+        enable_scissor_test(true);
+        depth_bias(bias_factor, bias_units);
+
+        for (auto &shadow : _shadows)
+        {
+            if (!shadow.active)
+            {
+                continue;
+            }
+
+            bool due = (_frame + shadow.phase) % shadow.update_interval == 0;
+
+            if (due || !shadow._rendered)
+            {
+                _update(shadow, draw);
+            }
+        }
+
+        depth_bias(0.0f, 0.0f);
+        enable_scissor_test(false);
+        enable_color_write(true);
+        unbind_framebuffer();
+
+        _frame++;
+    }
+
+    void ShadowSystem::tile_transform(size_t handle, float *scale_offset)
+    {
+        int tiles_per_row = _atlas_size / _tile_size;
+        int tile = _shadows[handle].tile;
+        float scale = (float)_tile_size / _atlas_size;
+
+        scale_offset[0] = scale;
+        scale_offset[1] = scale;
+        scale_offset[2] = (tile % tiles_per_row) * scale;
+        scale_offset[3] = (tile / tiles_per_row) * scale;
+    }
+
+    void ShadowSystem::bind(int slot)
+    {
+        _depth.bind(slot);
+    }
+}
@@ -0,0 +1,229 @@
+#include <cstddef>
+
+#include "debug.hpp"
+#include "scan.hpp"
+#include "skinning.hpp"
+
+namespace gfx
+{
+    // Vertices are read as raw words, SkinnedVertex packs the joints and weights into one word each
+    static const char *skin_compute_source = R"(#version 430 core
+layout(local_size_x = 64) in;
+
+layout(std430) readonly buffer SkinSource
+{
+    uint source[];
+};
+
+layout(std430) writeonly buffer SkinOutput
+{
+    float outputs[];
+};
+
+layout(std430) readonly buffer BonePalette
+{
+    mat4 bones[];
+};
+
+uniform uint u_base_bone;
+uniform uint u_vertex_count;
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+
+    if (i >= u_vertex_count)
+    {
+        return;
+    }
+
+    uint s = i * 8u;
+    vec3 position = uintBitsToFloat(uvec3(source[s], source[s + 1u], source[s + 2u]));
+    vec3 normal = uintBitsToFloat(uvec3(source[s + 3u], source[s + 4u], source[s + 5u]));
+    uvec4 joints = (uvec4(source[s + 6u]) >> uvec4(0u, 8u, 16u, 24u)) & 0xFFu;
+    vec4 weights = unpackUnorm4x8(source[s + 7u]);
+    joints += u_base_bone;
+
+    mat4 skin = bones[joints.x] * weights.x +
+                bones[joints.y] * weights.y +
+                bones[joints.z] * weights.z +
+                bones[joints.w] * weights.w;
+
+    position = (skin * vec4(position, 1.0)).xyz;
+    normal = normalize(mat3(skin) * normal);
+
+    uint o = i * 6u;
+    outputs[o] = position.x;
+    outputs[o + 1u] = position.y;
+    outputs[o + 2u] = position.z;
+    outputs[o + 3u] = normal.x;
+    outputs[o + 4u] = normal.y;
+    outputs[o + 5u] = normal.z;
+}
+)";
+
+    static const char *skin_vertex_source = R"(#version 330 core
+layout(location = 0) in vec3 a_position;
+layout(location = 1) in vec3 a_normal;
+layout(location = 2) in vec4 a_joints;
+layout(location = 3) in vec4 a_weights;
+
+layout(std140) uniform BonePalette
+{
+    mat4 bones[256];
+};
+
+out vec3 f_position;
+out vec3 f_normal;
+
+void main()
+{
+    mat4 skin = bones[int(a_joints.x)] * a_weights.x +
+                bones[int(a_joints.y)] * a_weights.y +
+                bones[int(a_joints.z)] * a_weights.z +
+                bones[int(a_joints.w)] * a_weights.w;
+
+    f_position = (skin * vec4(a_position, 1.0)).xyz;
+    f_normal = normalize(mat3(skin) * a_normal);
+}
+)";
+
+    static const char *skin_fragment_source = R"(#version 330 core
+out vec4 color;
+
+void main()
+{
+    color = vec4(0.0);
+}
+)";
+
+    SkinnedMesh::SkinnedMesh(const SkinnedVertex *vertices, size_t vertex_count, size_t bone_count)
+        : vertex_count(vertex_count),
+          bone_count(bone_count),
+          backend(simulation_backend()),
+          source(backend == SimulationBackend::Compute ? BufferType::ShaderStorage : BufferType::Array),
+          output(backend == SimulationBackend::Compute ? BufferType::ShaderStorage : BufferType::Array)
+    {
+        if (bone_count > Skinning::max_bones)
+        {
+            debug::panic("Skinned mesh has {} bones, at most {} are supported", bone_count, Skinning::max_bones);
+        }
+
+        source.set_data(vertices, vertex_count * sizeof(SkinnedVertex), BufferUsage::StaticDraw);
+        output.set_data(nullptr, vertex_count * sizeof(SkinnedOutput), BufferUsage::DynamicDraw);
+
+        if (backend == SimulationBackend::Compute)
+        {
+            return;
+        }
+
+        _source_layout = std::make_unique<VertexArray>();
+        _source_layout->set_attribute(0, source, 3, DataType::Float, sizeof(SkinnedVertex), offsetof(SkinnedVertex, position));
+        _source_layout->set_attribute(1, source, 3, DataType::Float, sizeof(SkinnedVertex), offsetof(SkinnedVertex, normal));
+        _source_layout->set_attribute(2, source, 4, DataType::UnsignedByte, sizeof(SkinnedVertex), offsetof(SkinnedVertex, joints));
+        _source_layout->set_attribute(3, source, 4, DataType::UnsignedByte, sizeof(SkinnedVertex), offsetof(SkinnedVertex, weights), true);
+
+        _feedback = std::make_unique<TransformFeedback>();
+        _feedback->attach(0, output);
+    }
+
+    void SkinnedMesh::bind_output(VertexArray &vertex_array, size_t position_index, size_t normal_index)
+    {
+        vertex_array.set_attribute(position_index, output, 3, DataType::Float, sizeof(SkinnedOutput), offsetof(SkinnedOutput, position));
+        vertex_array.set_attribute(normal_index, output, 3, DataType::Float, sizeof(SkinnedOutput), offsetof(SkinnedOutput, normal));
+    }
+
+    Skinning::Skinning()
+        : backend(simulation_backend()),
+          palette(backend == SimulationBackend::Compute ? BufferType::ShaderStorage : BufferType::Uniform)
+    {
+        if (backend == SimulationBackend::Compute)
+        {
+            build_compute_pipeline(_compute_skin, skin_compute_source);
+            _base_bone = _compute_skin.get_uniform("u_base_bone");
+            _vertex_count = _compute_skin.get_uniform("u_vertex_count");
+            return;
+        }
+
+        palette.set_data(nullptr, max_bones * 16 * sizeof(float), BufferUsage::StreamDraw);
+
+        ShaderModule vertex(ShaderType::Vertex);
+        vertex.set_source(skin_vertex_source);
+        vertex.compile();
+
+        ShaderModule fragment(ShaderType::Fragment);
+        fragment.set_source(skin_fragment_source);
+        fragment.compile();
+
+        _feedback_skin.attach_shader(vertex);
+        _feedback_skin.attach_shader(fragment);
+        _feedback_skin.set_feedback_varyings({"f_position", "f_normal"});
+        _feedback_skin.link();
+    }
+
+    void Skinning::begin_frame()
+    {
+        _palette_data.clear();
+    }
+
+    uint32_t Skinning::add_palette(const float *bones, size_t bone_count)
+    {
+        uint32_t base = (uint32_t)(_palette_data.size() / 16);
+        _palette_data.insert(_palette_data.end(), bones, bones + bone_count * 16);
+        return base;
+    }
+
+    void Skinning::upload()
+    {
+        if (backend != SimulationBackend::Compute || _palette_data.empty())
+        {
+            return;
+        }
+
+        size_t bones = _palette_data.size() / 16;
+
+        if (bones > _palette_capacity)
+        {
+            _palette_capacity = bones + bones / 2;
+            palette.set_data(nullptr, _palette_capacity * 16 * sizeof(float), BufferUsage::StreamDraw);
+        }
+
+        palette.set_sub_data(_palette_data.data(), _palette_data.size() * sizeof(float), 0);
+    }
+
+    void Skinning::skin(SkinnedMesh &mesh, uint32_t base_bone)
+    {
+        if (backend == SimulationBackend::Compute)
+        {
+            _compute_skin.use();
+            _base_bone.set_uint(base_bone);
+            _vertex_count.set_uint((uint32_t)mesh.vertex_count);
+            bind_buffer("SkinSource", mesh.source);
+            bind_buffer("SkinOutput", mesh.output);
+            bind_buffer("BonePalette", palette);
+            dispatch((uint32_t)((mesh.vertex_count + group_size - 1) / group_size));
+            return;
+        }
+
+        palette.set_sub_data(_palette_data.data() + (size_t)base_bone * 16, mesh.bone_count * 16 * sizeof(float), 0);
+
+        _feedback_skin.use();
+        bind_buffer("BonePalette", palette);
+
+        enable_rasterizer_discard(true);
+        mesh._source_layout->bind();
+        mesh._feedback->begin(PrimitiveType::Points);
+        draw(mesh.vertex_count, 1, 0, 0, PrimitiveType::Points);
+        mesh._feedback->end();
+        mesh._source_layout->unbind();
+        enable_rasterizer_discard(false);
+    }
+
+    void Skinning::finish()
+    {
+        if (backend == SimulationBackend::Compute)
+        {
+            memory_barrier(Barrier::VertexAttribArray);
+        }
+    }
+}
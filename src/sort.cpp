@@ -0,0 +1,285 @@
+#include <algorithm>
+#include <random>
+
+#include "debug.hpp"
+#include "sort.hpp"
+
+namespace gfx
+{
+    static const char *sort_count_source = R"(#version 430 core
+layout(local_size_x = 128) in;
+
+layout(std430) buffer SortKeysIn
+{
+    uint keys_in[];
+};
+
+layout(std430) buffer SortCounts
+{
+    uint counts[];
+};
+
+uniform uint u_count;
+uniform uint u_shift;
+uniform uint u_blocks;
+
+shared uint histogram[16];
+
+void main()
+{
+    uint local = gl_LocalInvocationID.x;
+
+    if (local < 16u)
+    {
+        histogram[local] = 0u;
+    }
+
+    barrier();
+
+    uint i = gl_GlobalInvocationID.x;
+
+    if (i < u_count)
+    {
+        atomicAdd(histogram[(keys_in[i] >> u_shift) & 15u], 1u);
+    }
+
+    barrier();
+
+    if (local < 16u)
+    {
+        counts[local * u_blocks + gl_WorkGroupID.x] = histogram[local];
+    }
+}
+)";
+
+    static const char *sort_scatter_source = R"(#version 430 core
+layout(local_size_x = 128) in;
+
+layout(std430) buffer SortKeysIn
+{
+    uint keys_in[];
+};
+
+layout(std430) buffer SortValuesIn
+{
+    uint values_in[];
+};
+
+layout(std430) buffer SortKeysOut
+{
+    uint keys_out[];
+};
+
+layout(std430) buffer SortValuesOut
+{
+    uint values_out[];
+};
+
+layout(std430) buffer SortCounts
+{
+    uint counts[];
+};
+
+uniform uint u_count;
+uniform uint u_shift;
+uniform uint u_blocks;
+
+// One byte per digit, a block of 128 keys cannot overflow it
+shared uvec4 ranks[128];
+
+void main()
+{
+    uint local = gl_LocalInvocationID.x;
+    uint i = gl_GlobalInvocationID.x;
+    bool valid = i < u_count;
+
+    uint key = valid ? keys_in[i] : 0u;
+    uint digit = (key >> u_shift) & 15u;
+
+    uvec4 one_hot = uvec4(0u);
+    if (valid)
+    {
+        one_hot[digit >> 2] = 1u << ((digit & 3u) * 8u);
+    }
+
+    ranks[local] = one_hot;
+    barrier();
+
+    for (uint offset = 1u; offset < 128u; offset <<= 1)
+    {
+        uvec4 add = local >= offset ? ranks[local - offset] : uvec4(0u);
+        barrier();
+        ranks[local] += add;
+        barrier();
+    }
+
+    if (valid)
+    {
+        uvec4 before = ranks[local] - one_hot;
+        uint rank = (before[digit >> 2] >> ((digit & 3u) * 8u)) & 255u;
+        uint destination = counts[digit * u_blocks + gl_WorkGroupID.x] + rank;
+
+        keys_out[destination] = key;
+        values_out[destination] = values_in[i];
+    }
+}
+)";
+
+    static size_t block_count(size_t count)
+    {
+        return std::max<size_t>((count + RadixSort::block_size - 1) / RadixSort::block_size, 1);
+    }
+
+    RadixSort::RadixSort(size_t capacity)
+        : capacity(capacity),
+          _scan(16 * block_count(capacity)),
+          _counts(BufferType::ShaderStorage),
+          _keys(BufferType::ShaderStorage),
+          _values(BufferType::ShaderStorage)
+    {
+        build_compute_pipeline(_count, sort_count_source);
+        build_compute_pipeline(_scatter, sort_scatter_source);
+
+        _count_count = _count.get_uniform("u_count");
+        _count_shift = _count.get_uniform("u_shift");
+        _count_blocks = _count.get_uniform("u_blocks");
+        _scatter_count = _scatter.get_uniform("u_count");
+        _scatter_shift = _scatter.get_uniform("u_shift");
+        _scatter_blocks = _scatter.get_uniform("u_blocks");
+
+        _counts.set_data(nullptr, 16 * block_count(capacity) * sizeof(uint32_t), BufferUsage::DynamicDraw);
+        _keys.set_data(nullptr, std::max<size_t>(capacity, 1) * sizeof(uint32_t), BufferUsage::DynamicDraw);
+        _values.set_data(nullptr, std::max<size_t>(capacity, 1) * sizeof(uint32_t), BufferUsage::DynamicDraw);
+    }
+
+    void RadixSort::sort(Buffer &keys, Buffer &values, size_t count, uint32_t bits)
+    {
+        if (count < 2)
+        {
+            return;
+        }
+
+        uint32_t blocks = (uint32_t)block_count(count);
+        uint32_t passes = (std::min<uint32_t>(bits, 32) + 3) / 4;
+
+        Buffer *keys_in = &keys;
+        Buffer *values_in = &values;
+        Buffer *keys_out = &_keys;
+        Buffer *values_out = &_values;
+
+        bind_buffer("SortCounts", _counts);
+
+        for (uint32_t pass = 0; pass < passes; pass++)
+        {
+            uint32_t shift = pass * 4;
+
+            bind_buffer("SortKeysIn", *keys_in);
+            _count.use();
+            _count_count.set_uint((uint32_t)count);
+            _count_shift.set_uint(shift);
+            _count_blocks.set_uint(blocks);
+            dispatch(blocks);
+            memory_barrier(Barrier::ShaderStorage);
+
+            _scan.exclusive(_counts, 16 * blocks);
+
+            bind_buffer("SortValuesIn", *values_in);
+            bind_buffer("SortKeysOut", *keys_out);
+            bind_buffer("SortValuesOut", *values_out);
+            _scatter.use();
+            _scatter_count.set_uint((uint32_t)count);
+            _scatter_shift.set_uint(shift);
+            _scatter_blocks.set_uint(blocks);
+            dispatch(blocks);
+            memory_barrier(Barrier::ShaderStorage);
+
+            std::swap(keys_in, keys_out);
+            std::swap(values_in, values_out);
+        }
+
+        // After an odd number of passes the result sits in the scratch buffers
+        if (keys_in != &keys)
+        {
+            keys.copy_from(*keys_in, count * sizeof(uint32_t));
+            values.copy_from(*values_in, count * sizeof(uint32_t));
+            memory_barrier(Barrier::ShaderStorage | Barrier::BufferUpdate);
+        }
+    }
+
+    template <typename F>
+    static double time_gpu(int iterations, F &&work)
+    {
+        Query query(QueryType::TimeElapsed);
+        uint64_t total = 0;
+
+        for (int i = 0; i < iterations; i++)
+        {
+            query.begin();
+            work(i);
+            query.end();
+            total += query.get_result();
+        }
+
+        return (double)total / iterations / 1e6;
+    }
+
+    std::vector<ComputeBenchmark> benchmark_compute_primitives(const std::vector<size_t> &counts, int iterations)
+    {
+        std::vector<ComputeBenchmark> results;
+
+        if (!capabilities().compute || !capabilities().timer_query)
+        {
+            debug::log("Compute benchmarks need compute shaders and timer queries, this context has {}.{}", capabilities().major, capabilities().minor);
+            return results;
+        }
+
+        std::mt19937 random(1234);
+
+        for (size_t count : counts)
+        {
+            std::vector<uint32_t> keys(count);
+            std::vector<uint32_t> flags(count);
+            std::vector<uint32_t> indices(count);
+
+            for (size_t i = 0; i < count; i++)
+            {
+                keys[i] = random();
+                flags[i] = keys[i] & 1;
+                indices[i] = (uint32_t)i;
+            }
+
+            Buffer data(BufferType::ShaderStorage);
+            Buffer values(BufferType::ShaderStorage);
+            Buffer flag_buffer(BufferType::ShaderStorage);
+            Buffer output(BufferType::ShaderStorage);
+            flag_buffer.set_data(flags.data(), count * sizeof(uint32_t), BufferUsage::StaticDraw);
+            output.set_data(nullptr, count * sizeof(uint32_t), BufferUsage::DynamicDraw);
+
+            PrefixScan scan(count);
+            StreamCompaction compaction(count);
+            RadixSort sorter(count);
+
+            ComputeBenchmark result;
+            result.count = count;
+
+            data.set_data(flags.data(), count * sizeof(uint32_t), BufferUsage::DynamicDraw);
+            result.scan_ms = time_gpu(iterations, [&](int) { scan.exclusive(data, count); });
+
+            values.set_data(indices.data(), count * sizeof(uint32_t), BufferUsage::DynamicDraw);
+            result.compact_ms = time_gpu(iterations, [&](int) { compaction.compact(flag_buffer, values, output, count); });
+
+            result.sort_ms = 0.0;
+            for (int i = 0; i < iterations; i++)
+            {
+                data.set_data(keys.data(), count * sizeof(uint32_t), BufferUsage::DynamicDraw);
+                values.set_data(indices.data(), count * sizeof(uint32_t), BufferUsage::DynamicDraw);
+                result.sort_ms += time_gpu(1, [&](int) { sorter.sort(data, values, count); }) / iterations;
+            }
+
+            debug::log("Compute primitives, {} elements: scan {:.3f} ms, compact {:.3f} ms, sort {:.3f} ms", count, result.scan_ms, result.compact_ms, result.sort_ms);
+            results.push_back(result);
+        }
+
+        return results;
+    }
+}
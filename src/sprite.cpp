@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <numbers>
+
+#include "debug.hpp"
+#include "sprite.hpp"
+
+namespace gfx
+{
+    const char *SpriteBatch::vertex_source = R"(#version 330 core
+layout(location = 0) in vec4 a_rect;
+layout(location = 1) in vec4 a_uv;
+layout(location = 2) in vec4 a_color;
+layout(location = 3) in float a_rotation;
+layout(location = 4) in float a_layer;
+
+uniform mat4 u_view_projection;
+
+out vec3 v_uv;
+out vec4 v_color;
+
+const int corners[6] = int[6](0, 1, 2, 2, 1, 3);
+
+void main()
+{
+    int corner = corners[gl_VertexID];
+    vec2 t = vec2(corner & 1, corner >> 1);
+    vec2 local = (t - 0.5) * a_rect.zw;
+
+    float angle = a_rotation * 6.28318530718;
+    float s = sin(angle);
+    float c = cos(angle);
+    vec2 position = a_rect.xy + vec2(local.x * c - local.y * s, local.x * s + local.y * c);
+
+    gl_Position = u_view_projection * vec4(position, 0.0, 1.0);
+    v_uv = vec3(mix(a_uv.xy, a_uv.zw, t), a_layer);
+    v_color = a_color;
+}
+)";
+
+    static const char *sprite_fragment_source = R"(#version 330 core
+uniform sampler2DArray u_texture;
+
+in vec3 v_uv;
+in vec4 v_color;
+out vec4 color;
+
+void main()
+{
+    color = texture(u_texture, v_uv) * v_color;
+}
+)";
+
+    static uint16_t unorm16(float value)
+    {
+        return (uint16_t)std::lround(std::clamp(value, 0.0f, 1.0f) * 65535.0f);
+    }
+
+    SpriteInstance pack_sprite(const Sprite &sprite)
+    {
+        float turns = sprite.rotation / (2.0f * std::numbers::pi_v<float>);
+        turns -= std::floor(turns);
+
+        SpriteInstance instance;
+        instance.x = sprite.x;
+        instance.y = sprite.y;
+        instance.width = sprite.width;
+        instance.height = sprite.height;
+        instance.uv[0] = unorm16(sprite.u0);
+        instance.uv[1] = unorm16(sprite.v0);
+        instance.uv[2] = unorm16(sprite.u1);
+        instance.uv[3] = unorm16(sprite.v1);
+        instance.color = sprite.color;
+        instance.rotation = unorm16(turns); // Same scale the normalized attribute decodes with, a full turn clamps to 65535
+        instance.layer = (uint16_t)sprite.layer;
+        return instance;
+    }
+
+    SpriteBatch::SpriteBatch(size_t capacity, size_t batch_size)
+        : _ring(BufferType::Array, capacity * sizeof(SpriteInstance)), _batch_size(batch_size)
+    {
+        ShaderModule vertex(ShaderType::Vertex);
+        vertex.set_source(vertex_source);
+        vertex.compile();
+
+        ShaderModule fragment(ShaderType::Fragment);
+        fragment.set_source(sprite_fragment_source);
+        fragment.compile();
+
+        _default_pipeline.attach_shader(vertex);
+        _default_pipeline.attach_shader(fragment);
+        _default_pipeline.link();
+
+        for (size_t index = 0; index < 5; index++)
+        {
+            _vertex_array.set_attribute_divisor(index, 1);
+        }
+
+        _instances.reserve(batch_size);
+        set_pipeline(nullptr);
+    }
+
+    void SpriteBatch::begin(float *view_projection)
+    {
+        std::copy(view_projection, view_projection + 16, _view_projection);
+        _ring.begin_frame();
+        draw_calls = 0;
+        sprite_count = 0;
+    }
+
+    void SpriteBatch::set_texture(ImageArray &texture)
+    {
+        if (_texture != &texture)
+        {
+            flush();
+            _texture = &texture;
+        }
+    }
+
+    void SpriteBatch::set_pipeline(Pipeline *pipeline)
+    {
+        Pipeline *next = pipeline != nullptr ? pipeline : &_default_pipeline;
+
+        if (_pipeline != next)
+        {
+            flush();
+            _pipeline = next;
+            _view_projection_uniform = next->get_uniform("u_view_projection");
+            _texture_uniform = next->get_uniform("u_texture");
+        }
+    }
+
+    void SpriteBatch::draw(const Sprite &sprite)
+    {
+        _instances.push_back(pack_sprite(sprite));
+
+        if (_instances.size() >= _batch_size)
+        {
+            flush();
+        }
+    }
+
+    void SpriteBatch::draw(const SpriteInstance *instances, size_t count)
+    {
+        while (count > 0)
+        {
+            size_t take = std::min(count, _batch_size - _instances.size());
+            _instances.insert(_instances.end(), instances, instances + take);
+            instances += take;
+            count -= take;
+
+            if (_instances.size() >= _batch_size)
+            {
+                flush();
+            }
+        }
+    }
+
+    void SpriteBatch::end()
+    {
+        flush();
+        _ring.end_frame();
+    }
+
+    void SpriteBatch::flush()
+    {
+        if (_instances.empty())
+        {
+            return;
+        }
+
+        size_t size = _instances.size() * sizeof(SpriteInstance);
+        size_t offset = _ring.write(_instances.data(), size, sizeof(SpriteInstance));
+
+        if (offset == SIZE_MAX)
+        {
+            debug::log("SpriteBatch frame capacity exceeded, dropping {} sprites", _instances.size());
+            _instances.clear();
+            return;
+        }
+
+        _draw_instances(_ring.buffer, offset, _instances.size());
+        _instances.clear();
+    }
+
+    void SpriteBatch::draw_range(Buffer &buffer, size_t first, size_t count)
+    {
+        flush();
+
+        if (count > 0)
+        {
+            _draw_instances(buffer, first * sizeof(SpriteInstance), count);
+        }
+    }
+
+    void SpriteBatch::_draw_instances(Buffer &buffer, size_t offset, size_t count)
+    {
+        const size_t stride = sizeof(SpriteInstance);
+        _vertex_array.set_attribute(0, buffer, 4, DataType::Float, stride, offset + offsetof(SpriteInstance, x));
+        _vertex_array.set_attribute(1, buffer, 4, DataType::UnsignedShort, stride, offset + offsetof(SpriteInstance, uv), true);
+        _vertex_array.set_attribute(2, buffer, 4, DataType::UnsignedByte, stride, offset + offsetof(SpriteInstance, color), true);
+        _vertex_array.set_attribute(3, buffer, 1, DataType::UnsignedShort, stride, offset + offsetof(SpriteInstance, rotation), true);
+        _vertex_array.set_attribute(4, buffer, 1, DataType::UnsignedShort, stride, offset + offsetof(SpriteInstance, layer));
+
+        _pipeline->use();
+        _view_projection_uniform.set_mat4(_view_projection);
+
+        if (_texture != nullptr)
+        {
+            _texture->bind(0);
+            _texture_uniform.set_int(0);
+        }
+
+        _vertex_array.bind();
+        draw_instanced(6, count);
+        _vertex_array.unbind();
+
+        draw_calls++;
+        sprite_count += count;
+    }
+}
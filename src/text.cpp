@@ -0,0 +1,411 @@
+#include <algorithm>
+#include <cmath>
+
+#include "debug.hpp"
+#include "text.hpp"
+
+namespace gfx
+{
+    static const char *text_fragment_source = R"(#version 330 core
+uniform sampler2DArray u_texture;
+
+in vec3 v_uv;
+in vec4 v_color;
+out vec4 color;
+
+void main()
+{
+    float distance = texture(u_texture, v_uv).r;
+    float width = fwidth(distance);
+    float alpha = smoothstep(0.5 - width, 0.5 + width, distance);
+    color = vec4(v_color.rgb, v_color.a * alpha);
+}
+)";
+
+    static const float far_distance = 1e20f;
+
+    // Felzenszwalb-Huttenlocher squared distance transform of a sampled function
+    static void distance_transform(const float *f, float *d, int n, int *v, float *z)
+    {
+        int k = 0;
+        v[0] = 0;
+        z[0] = -far_distance;
+        z[1] = far_distance;
+
+        for (int q = 1; q < n; q++)
+        {
+            float s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * q - 2 * v[k]);
+
+            while (s <= z[k])
+            {
+                k--;
+                s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * q - 2 * v[k]);
+            }
+
+            k++;
+            v[k] = q;
+            z[k] = s;
+            z[k + 1] = far_distance;
+        }
+
+        k = 0;
+        for (int q = 0; q < n; q++)
+        {
+            while (z[k + 1] < q)
+            {
+                k++;
+            }
+
+            d[q] = (float)((q - v[k]) * (q - v[k])) + f[v[k]];
+        }
+    }
+
+    static void distance_transform_2d(std::vector<float> &grid, int width, int height)
+    {
+        int n = std::max(width, height);
+        std::vector<float> f(n);
+        std::vector<float> d(n);
+        std::vector<int> v(n);
+        std::vector<float> z(n + 1);
+
+        for (int x = 0; x < width; x++)
+        {
+            for (int y = 0; y < height; y++)
+            {
+                f[y] = grid[y * width + x];
+            }
+
+            distance_transform(f.data(), d.data(), height, v.data(), z.data());
+
+            for (int y = 0; y < height; y++)
+            {
+                grid[y * width + x] = d[y];
+            }
+        }
+
+        for (int y = 0; y < height; y++)
+        {
+            distance_transform(&grid[y * width], d.data(), width, v.data(), z.data());
+            std::copy(d.begin(), d.begin() + width, grid.begin() + y * width);
+        }
+    }
+
+    std::vector<uint8_t> generate_sdf(const GlyphBitmap &bitmap, int spread)
+    {
+        int width = bitmap.width + spread * 2;
+        int height = bitmap.height + spread * 2;
+        std::vector<float> outside(width * height, far_distance);
+        std::vector<float> inside(width * height, 0.0f);
+
+        for (int y = 0; y < bitmap.height; y++)
+        {
+            for (int x = 0; x < bitmap.width; x++)
+            {
+                if (bitmap.coverage[y * bitmap.width + x] >= 128)
+                {
+                    size_t index = (y + spread) * width + x + spread;
+                    outside[index] = 0.0f;
+                    inside[index] = far_distance;
+                }
+            }
+        }
+
+        distance_transform_2d(outside, width, height);
+        distance_transform_2d(inside, width, height);
+
+        std::vector<uint8_t> sdf(width * height);
+
+        for (size_t i = 0; i < sdf.size(); i++)
+        {
+            float distance = std::sqrt(outside[i]) - std::sqrt(inside[i]); // Positive outside the glyph
+            float value = 0.5f - distance / (2.0f * spread);
+            sdf[i] = (uint8_t)std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f);
+        }
+
+        return sdf;
+    }
+
+    static uint32_t next_codepoint(const std::string &text, size_t &i)
+    {
+        uint8_t c = text[i++];
+
+        if (c < 0x80)
+        {
+            return c;
+        }
+
+        int extra = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+        uint32_t codepoint = c & (0x3F >> extra);
+
+        for (int j = 0; j < extra && i < text.size(); j++)
+        {
+            codepoint = (codepoint << 6) | (text[i++] & 0x3F);
+        }
+
+        return codepoint;
+    }
+
+    static uint64_t hash_text(const std::string &text)
+    {
+        uint64_t hash = 14695981039346656037ull; // FNV-1a
+
+        for (char c : text)
+        {
+            hash = (hash ^ (uint8_t)c) * 1099511628211ull;
+        }
+
+        return hash;
+    }
+
+    TextRenderer::TextRenderer(GlyphLoader loader, float font_size, int atlas_size, int atlas_layers, int spread)
+        : _loader(loader),
+          _font_size(font_size),
+          _spread(spread),
+          _line_height(std::ceil(font_size * 1.2f)),
+          _atlas(atlas_size, atlas_size, atlas_layers, TextureFormat::R8),
+          _static_buffer(BufferType::Array)
+    {
+        Sampler sampler(SamplerFilter::Linear, SamplerFilter::Linear, SamplerWrap::ClampToEdge, SamplerWrap::ClampToEdge);
+        _atlas._apply_sampler(sampler);
+
+        ShaderModule vertex(ShaderType::Vertex);
+        vertex.set_source(SpriteBatch::vertex_source);
+        vertex.compile();
+
+        ShaderModule fragment(ShaderType::Fragment);
+        fragment.set_source(text_fragment_source);
+        fragment.compile();
+
+        _pipeline.attach_shader(vertex);
+        _pipeline.attach_shader(fragment);
+        _pipeline.link();
+    }
+
+    const Glyph *TextRenderer::_glyph(uint32_t codepoint)
+    {
+        auto it = _glyphs.find(codepoint);
+
+        if (it != _glyphs.end())
+        {
+            return &it->second;
+        }
+
+        GlyphBitmap bitmap;
+
+        if (!_loader(codepoint, bitmap))
+        {
+            return nullptr;
+        }
+
+        int width = bitmap.width + _spread * 2;
+        int height = bitmap.height + _spread * 2;
+        int size = _atlas._width;
+
+        // Checked before packing, a glyph larger than a layer must not move the shelf or open a layer
+        if (width > size || height > size)
+        {
+            debug::log("Glyph {} is {}x{} with its spread, larger than the {}x{} atlas", codepoint, width, height, size, size);
+            return nullptr;
+        }
+
+        // Shelf packing, a new layer starts when the current one is full
+        if (_shelf_x + width > size)
+        {
+            _shelf_x = 0;
+            _shelf_y += _shelf_height;
+            _shelf_height = 0;
+        }
+
+        if (_shelf_y + height > size)
+        {
+            _shelf_x = 0;
+            _shelf_y = 0;
+            _shelf_height = 0;
+            _layer++;
+        }
+
+        if (_layer >= _atlas._layers)
+        {
+            debug::log("Glyph atlas full, skipping codepoint {}", codepoint);
+            _atlas_full = true;
+            return nullptr;
+        }
+
+        std::vector<uint8_t> sdf = generate_sdf(bitmap, _spread);
+        _atlas.set_sub_data(sdf.data(), _shelf_x, _shelf_y, width, height, _layer);
+
+        Glyph glyph;
+        glyph.layer = (uint16_t)_layer;
+        glyph.u0 = (float)_shelf_x / size;
+        glyph.v0 = (float)_shelf_y / size;
+        glyph.u1 = (float)(_shelf_x + width) / size;
+        glyph.v1 = (float)(_shelf_y + height) / size;
+        glyph.width = (float)width;
+        glyph.height = (float)height;
+        glyph.offset_x = bitmap.bearing_x - _spread;
+        glyph.offset_y = -bitmap.bearing_y - _spread;
+        glyph.advance = bitmap.advance;
+
+        _shelf_x += width;
+        _shelf_height = std::max(_shelf_height, height);
+
+        return &_glyphs.emplace(codepoint, glyph).first->second;
+    }
+
+    const TextRenderer::ShapedText &TextRenderer::shape(const std::string &text)
+    {
+        uint64_t hash = hash_text(text);
+        auto it = _shaped.find(hash);
+
+        if (it != _shaped.end() && it->second.text == text)
+        {
+            it->second.last_used = ++_shape_calls;
+            return it->second;
+        }
+
+        ShapedText shaped;
+        shaped.text = text;
+        _atlas_full = false;
+
+        float pen_x = 0.0f;
+        float pen_y = 0.0f;
+
+        for (size_t i = 0; i < text.size();)
+        {
+            uint32_t codepoint = next_codepoint(text, i);
+
+            if (codepoint == '\n')
+            {
+                pen_x = 0.0f;
+                pen_y += _line_height;
+                continue;
+            }
+
+            const Glyph *glyph = _glyph(codepoint);
+
+            if (glyph == nullptr)
+            {
+                continue;
+            }
+
+            Sprite sprite;
+            sprite.x = pen_x + glyph->offset_x + glyph->width * 0.5f;
+            sprite.y = pen_y + glyph->offset_y + glyph->height * 0.5f;
+            sprite.width = glyph->width;
+            sprite.height = glyph->height;
+            sprite.u0 = glyph->u0;
+            sprite.v0 = glyph->v0;
+            sprite.u1 = glyph->u1;
+            sprite.v1 = glyph->v1;
+            sprite.layer = glyph->layer;
+            shaped.instances.push_back(pack_sprite(sprite));
+
+            pen_x += glyph->advance;
+            shaped.width = std::max(shaped.width, pen_x);
+        }
+
+        // A glyph that did not fit may fit once the atlas is cleared, shape again next time
+        if (_atlas_full)
+        {
+            _uncached = std::move(shaped);
+            return _uncached;
+        }
+
+        // Beyond the cap the least recently used string makes room, unless this one replaces a colliding hash
+        if (_shaped.size() >= max_shaped && it == _shaped.end())
+        {
+            auto oldest = std::min_element(_shaped.begin(), _shaped.end(), [](auto &a, auto &b)
+                                           { return a.second.last_used < b.second.last_used; });
+
+            if (oldest != _shaped.end())
+            {
+                _shaped.erase(oldest);
+            }
+        }
+
+        ShapedText &entry = _shaped[hash];
+        entry = std::move(shaped);
+        entry.last_used = ++_shape_calls;
+        return entry;
+    }
+
+    float TextRenderer::measure(const std::string &text, float size)
+    {
+        return shape(text).width * size / _font_size;
+    }
+
+    void TextRenderer::_transform(const ShapedText &shaped, float x, float y, float size, uint32_t color, std::vector<SpriteInstance> &out)
+    {
+        float scale = size / _font_size;
+
+        for (SpriteInstance instance : shaped.instances)
+        {
+            instance.x = x + instance.x * scale;
+            instance.y = y + instance.y * scale;
+            instance.width *= scale;
+            instance.height *= scale;
+            instance.color = color;
+            out.push_back(instance);
+        }
+    }
+
+    void TextRenderer::_bind(SpriteBatch &batch)
+    {
+        batch.set_texture(_atlas);
+        batch.set_pipeline(&_pipeline);
+    }
+
+    void TextRenderer::draw(SpriteBatch &batch, const std::string &text, float x, float y, float size, uint32_t color)
+    {
+        const ShapedText &shaped = shape(text);
+
+        _scratch.clear();
+        _transform(shaped, x, y, size, color, _scratch);
+
+        _bind(batch);
+        batch.draw(_scratch.data(), _scratch.size());
+    }
+
+    TextRange TextRenderer::add_static(const std::string &text, float x, float y, float size, uint32_t color)
+    {
+        TextRange range;
+        range.first = _static_instances.size();
+        _transform(shape(text), x, y, size, color, _static_instances);
+        range.count = _static_instances.size() - range.first;
+        return range;
+    }
+
+    void TextRenderer::draw_static(SpriteBatch &batch, TextRange range)
+    {
+        // Static text added since the last draw is uploaded once, in a single call
+        if (_static_uploaded != _static_instances.size())
+        {
+            _static_buffer.set_data(_static_instances.data(), _static_instances.size() * sizeof(SpriteInstance), BufferUsage::StaticDraw);
+            _static_uploaded = _static_instances.size();
+        }
+
+        _bind(batch);
+        batch.draw_range(_static_buffer, range.first, range.count);
+    }
+
+    void TextRenderer::clear_static()
+    {
+        _static_instances.clear();
+        _static_uploaded = 0;
+    }
+
+    void TextRenderer::clear_cache()
+    {
+        _shaped.clear();
+    }
+
+    void TextRenderer::clear_atlas()
+    {
+        _glyphs.clear();
+        _shaped.clear(); // Shaped instances hold atlas coordinates
+        _shelf_x = 0;
+        _shelf_y = 0;
+        _shelf_height = 0;
+        _layer = 0;
+    }
+}
@@ -0,0 +1,309 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#include "ui.hpp"
+
+namespace gfx
+{
+    static const char *ui_vertex_source = R"(#version 330 core
+layout(location = 0) in vec2 a_position;
+layout(location = 1) in vec4 a_color;
+
+uniform vec2 u_screen_size;
+
+out vec4 v_color;
+
+void main()
+{
+    vec2 ndc = a_position / u_screen_size * 2.0 - 1.0;
+    gl_Position = vec4(ndc.x, -ndc.y, 0.0, 1.0);
+    v_color = a_color;
+}
+)";
+
+    static const char *ui_fragment_source = R"(#version 330 core
+in vec4 v_color;
+out vec4 color;
+
+void main()
+{
+    color = v_color;
+}
+)";
+
+    bool UIRect::intersects(const UIRect &other) const
+    {
+        return x < other.x + other.width && other.x < x + width && y < other.y + other.height && other.y < y + height;
+    }
+
+    UIRect UIRect::united(const UIRect &other) const
+    {
+        if (empty())
+        {
+            return other;
+        }
+
+        if (other.empty())
+        {
+            return *this;
+        }
+
+        float left = std::min(x, other.x);
+        float top = std::min(y, other.y);
+        float right = std::max(x + width, other.x + other.width);
+        float bottom = std::max(y + height, other.y + other.height);
+        return UIRect{left, top, right - left, bottom - top};
+    }
+
+    void ui_quad(std::vector<UIVertex> &out, const UIRect &rect, uint32_t color)
+    {
+        UIVertex a = {rect.x, rect.y, color};
+        UIVertex b = {rect.x + rect.width, rect.y, color};
+        UIVertex c = {rect.x, rect.y + rect.height, color};
+        UIVertex d = {rect.x + rect.width, rect.y + rect.height, color};
+        out.insert(out.end(), {a, b, c, c, b, d});
+    }
+
+    void Widget::mark_dirty()
+    {
+        _dirty = true;
+    }
+
+    void Panel::tessellate(std::vector<UIVertex> &out)
+    {
+        ui_quad(out, bounds, border_color);
+
+        UIRect inner = {bounds.x + border_width, bounds.y + border_width, bounds.width - border_width * 2.0f, bounds.height - border_width * 2.0f};
+        if (!inner.empty())
+        {
+            ui_quad(out, inner, color);
+        }
+    }
+
+    UIRenderer::UIRenderer(int width, int height, size_t initial_vertices)
+        : _width(width),
+          _height(height),
+          _color(width, height, TextureFormat::RGBA),
+          _framebuffer(width, height),
+          _buffer(BufferType::Array)
+    {
+        _framebuffer.attach(AttachmentType::Color0, _color);
+
+        ShaderModule vertex(ShaderType::Vertex);
+        vertex.set_source(ui_vertex_source);
+        vertex.compile();
+
+        ShaderModule fragment(ShaderType::Fragment);
+        fragment.set_source(ui_fragment_source);
+        fragment.compile();
+
+        _pipeline.attach_shader(vertex);
+        _pipeline.attach_shader(fragment);
+        _pipeline.link();
+        _screen_size = _pipeline.get_uniform("u_screen_size");
+
+        _buffer_capacity = initial_vertices;
+        _buffer.set_data(nullptr, _buffer_capacity * sizeof(UIVertex), BufferUsage::DynamicDraw);
+
+        _vertex_array.set_attribute(0, _buffer, 2, DataType::Float, sizeof(UIVertex), offsetof(UIVertex, x));
+        _vertex_array.set_attribute(1, _buffer, 4, DataType::UnsignedByte, sizeof(UIVertex), offsetof(UIVertex, color), true);
+
+        invalidate_all();
+    }
+
+    void UIRenderer::add(Widget &widget)
+    {
+        _widgets.push_back(&widget);
+        widget._dirty = true;
+        widget._count = 0;
+        widget._capacity = 0;
+        widget._drawn_bounds = UIRect();
+    }
+
+    void UIRenderer::remove(Widget &widget)
+    {
+        auto it = std::find(_widgets.begin(), _widgets.end(), &widget);
+
+        if (it != _widgets.end())
+        {
+            invalidate(widget._drawn_bounds);
+            _widgets.erase(it); // Its buffer range is reclaimed on the next rebuild
+        }
+    }
+
+    void UIRenderer::invalidate(const UIRect &rect)
+    {
+        if (!rect.empty())
+        {
+            _damage.push_back(rect);
+        }
+    }
+
+    void UIRenderer::invalidate_all()
+    {
+        _damage.clear();
+        _damage.push_back(UIRect{0.0f, 0.0f, (float)_width, (float)_height});
+    }
+
+    void UIRenderer::_rebuild_buffer(size_t min_capacity)
+    {
+        // Re-tessellate every widget into a larger buffer, packing their ranges again
+        while (_buffer_capacity < min_capacity)
+        {
+            _buffer_capacity *= 2;
+        }
+
+        _scratch.clear();
+
+        for (Widget *widget : _widgets)
+        {
+            size_t first = _scratch.size();
+            widget->tessellate(_scratch);
+            widget->_first = first;
+            widget->_count = _scratch.size() - first;
+            widget->_capacity = widget->_count;
+
+            if (widget->_dirty)
+            {
+                invalidate(widget->_drawn_bounds);
+                invalidate(widget->bounds);
+                widget->_drawn_bounds = widget->bounds;
+                widget->_dirty = false;
+                tessellated_widgets++;
+            }
+        }
+
+        _buffer.set_data(nullptr, _buffer_capacity * sizeof(UIVertex), BufferUsage::DynamicDraw);
+        _buffer.set_sub_data(_scratch.data(), _scratch.size() * sizeof(UIVertex), 0);
+        _buffer_used = _scratch.size();
+    }
+
+    void UIRenderer::_upload(Widget &widget)
+    {
+        _scratch.clear();
+        widget.tessellate(_scratch);
+
+        invalidate(widget._drawn_bounds);
+        invalidate(widget.bounds);
+        widget._drawn_bounds = widget.bounds;
+        widget._dirty = false;
+        tessellated_widgets++;
+
+        if (_scratch.size() > widget._capacity)
+        {
+            if (_buffer_used + _scratch.size() > _buffer_capacity)
+            {
+                _rebuild_buffer(_buffer_used + _scratch.size()); // Also uploads this widget
+                return;
+            }
+
+            widget._first = _buffer_used;
+            widget._capacity = _scratch.size();
+            _buffer_used += _scratch.size();
+        }
+
+        widget._count = _scratch.size();
+
+        if (!_scratch.empty())
+        {
+            _buffer.set_sub_data(_scratch.data(), _scratch.size() * sizeof(UIVertex), widget._first * sizeof(UIVertex));
+        }
+    }
+
+    void UIRenderer::_merge_damage()
+    {
+        // Merge overlapping regions until they are disjoint, keeps the number of scissored passes small
+        bool merged = true;
+
+        while (merged)
+        {
+            merged = false;
+
+            for (size_t i = 0; i < _damage.size() && !merged; i++)
+            {
+                for (size_t j = i + 1; j < _damage.size(); j++)
+                {
+                    if (_damage[i].intersects(_damage[j]))
+                    {
+                        _damage[i] = _damage[i].united(_damage[j]);
+                        _damage.erase(_damage.begin() + j);
+                        merged = true;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    bool UIRenderer::render()
+    {
+        tessellated_widgets = 0;
+        redrawn_regions = 0;
+
+        for (Widget *widget : _widgets)
+        {
+            if (widget->_dirty)
+            {
+                _upload(*widget);
+            }
+        }
+
+        if (_damage.empty())
+        {
+            return false;
+        }
+
+        _merge_damage();
+
+        _framebuffer.bind();
+        viewport(0, 0, _width, _height);
+        enable_depth_test(false);
+        enable_blending(true);
+        enable_scissor_test(true);
+
+        _pipeline.use();
+        _screen_size.set_vec2((float)_width, (float)_height);
+        _vertex_array.bind();
+
+        for (const UIRect &region : _damage)
+        {
+            int left = std::max(0, (int)std::floor(region.x));
+            int top = std::max(0, (int)std::floor(region.y));
+            int right = std::min(_width, (int)std::ceil(region.x + region.width));
+            int bottom = std::min(_height, (int)std::ceil(region.y + region.height));
+
+            if (right <= left || bottom <= top)
+            {
+                continue;
+            }
+
+            scissor(left, _height - bottom, right - left, bottom - top);
+            clear_color(background[0], background[1], background[2], background[3]);
+            clear();
+
+            for (Widget *widget : _widgets)
+            {
+                if (widget->visible && widget->_count > 0 && widget->bounds.intersects(region))
+                {
+                    draw(widget->_count, 1, widget->_first);
+                }
+            }
+
+            redrawn_regions++;
+        }
+
+        _vertex_array.unbind();
+        enable_scissor_test(false);
+        enable_blending(false);
+        _framebuffer.unbind();
+
+        _damage.clear();
+        return true;
+    }
+
+    void UIRenderer::composite()
+    {
+        _framebuffer.blit(nullptr, _width, _height);
+    }
+}
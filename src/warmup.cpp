@@ -0,0 +1,275 @@
+#include <algorithm>
+#include <fstream>
+#include <memory>
+
+#include "debug.hpp"
+#include "warmup.hpp"
+
+namespace gfx
+{
+    // Keys store formats as indices into this table so they stay small, append only to keep saved sets valid
+    static const TextureFormat target_formats[] = {
+        TextureFormat::RGBA,
+        TextureFormat::RGB,
+        TextureFormat::RGBA8,
+        TextureFormat::RGBA16F,
+        TextureFormat::R11FG11FB10F,
+        TextureFormat::R8,
+        TextureFormat::R16F,
+        TextureFormat::R32F,
+        TextureFormat::R32UI,
+        TextureFormat::Depth,
+        TextureFormat::Depth32F,
+    };
+
+    static const uint32_t format_count = sizeof(target_formats) / sizeof(target_formats[0]);
+
+    static uint32_t format_index(TextureFormat format)
+    {
+        for (uint32_t i = 0; i < format_count; i++)
+        {
+            if (target_formats[i] == format)
+            {
+                return i;
+            }
+        }
+
+        debug::log("Unknown warm target format {}, warming against RGBA", (uint32_t)format);
+        return 0;
+    }
+
+    static TextureFormat format_at(uint32_t index)
+    {
+        return index < format_count ? target_formats[index] : TextureFormat::RGBA;
+    }
+
+    void RenderState::apply() const
+    {
+        enable_depth_test(depth_test);
+        enable_backface_culling(backface_culling);
+        enable_blending(blending);
+    }
+
+    uint32_t RenderState::key() const
+    {
+        return (depth_test ? 1u : 0u) | (backface_culling ? 2u : 0u) | (blending ? 4u : 0u) | (has_depth ? 8u : 0u) |
+               ((uint32_t)primitive_type << 8) | (format_index(color_format) << 16) | (format_index(depth_format) << 24);
+    }
+
+    RenderState RenderState::from_key(uint32_t key)
+    {
+        RenderState state;
+        state.depth_test = (key & 1u) != 0;
+        state.backface_culling = (key & 2u) != 0;
+        state.blending = (key & 4u) != 0;
+        state.has_depth = (key & 8u) != 0;
+        state.primitive_type = (PrimitiveType)((key >> 8) & 0xFF);
+        state.color_format = format_at((key >> 16) & 0xFF);
+        state.depth_format = format_at((key >> 24) & 0xFF);
+        return state;
+    }
+
+    uint64_t PipelineWarmer::_pack(size_t pipeline, size_t layout, uint32_t state)
+    {
+        return ((uint64_t)(pipeline & 0xFFFF) << 48) | ((uint64_t)(layout & 0xFFFF) << 32) | state;
+    }
+
+    static size_t find_or_add(std::vector<std::string> &names, const std::string &name)
+    {
+        for (size_t i = 0; i < names.size(); i++)
+        {
+            if (names[i] == name)
+            {
+                return i;
+            }
+        }
+
+        names.push_back(name);
+        return names.size() - 1;
+    }
+
+    size_t PipelineWarmer::register_pipeline(const std::string &name, Pipeline &pipeline)
+    {
+        size_t handle = find_or_add(_pipeline_names, name);
+        _pipelines.resize(_pipeline_names.size(), nullptr);
+        _pipelines[handle] = &pipeline;
+        return handle;
+    }
+
+    size_t PipelineWarmer::register_layout(const std::string &name, VertexArray &vertex_array)
+    {
+        size_t handle = find_or_add(_layout_names, name);
+        _layouts.resize(_layout_names.size(), nullptr);
+        _layouts[handle] = &vertex_array;
+        return handle;
+    }
+
+    void PipelineWarmer::record(size_t pipeline, size_t layout, const RenderState &state)
+    {
+        _seen.insert(_pack(pipeline, layout, state.key()));
+    }
+
+    std::vector<PipelineWarmer::Combination> PipelineWarmer::combinations() const
+    {
+        std::vector<Combination> result;
+        result.reserve(_seen.size());
+
+        for (uint64_t packed : _seen)
+        {
+            Combination combination;
+            combination.pipeline = (size_t)(packed >> 48);
+            combination.layout = (size_t)((packed >> 32) & 0xFFFF);
+            combination.state = RenderState::from_key((uint32_t)packed);
+            result.push_back(combination);
+        }
+
+        return result;
+    }
+
+    bool PipelineWarmer::save(const std::string &path) const
+    {
+        std::ofstream file(path, std::ios::binary);
+
+        if (!file)
+        {
+            debug::log("Failed to write pipeline warm set: {}", path);
+            return false;
+        }
+
+        // One line per combination: state key, name lengths, then both names verbatim, so names may hold spaces
+        for (const Combination &combination : combinations())
+        {
+            const std::string &pipeline = _pipeline_names[combination.pipeline];
+            const std::string &layout = _layout_names[combination.layout];
+            file << combination.state.key() << ' ' << pipeline.size() << ' ' << layout.size() << ' ' << pipeline << layout << '\n';
+        }
+
+        return true;
+    }
+
+    bool PipelineWarmer::load(const std::string &path)
+    {
+        std::ifstream file(path, std::ios::binary);
+
+        if (!file)
+        {
+            return false; // No previous session recorded anything yet
+        }
+
+        uint32_t state;
+        size_t pipeline_length;
+        size_t layout_length;
+
+        // Unknown names are kept so the combination is warmed once they get registered
+        while (file >> state >> pipeline_length >> layout_length)
+        {
+            std::string pipeline(pipeline_length, '\0');
+            std::string layout(layout_length, '\0');
+            file.get(); // Separator
+
+            if (!file.read(pipeline.data(), pipeline_length) || !file.read(layout.data(), layout_length))
+            {
+                debug::log("Truncated pipeline warm set: {}", path);
+                return false;
+            }
+
+            file.get(); // Newline
+
+            size_t pipeline_handle = find_or_add(_pipeline_names, pipeline);
+            size_t layout_handle = find_or_add(_layout_names, layout);
+            _pipelines.resize(_pipeline_names.size(), nullptr);
+            _layouts.resize(_layout_names.size(), nullptr);
+            _seen.insert(_pack(pipeline_handle, layout_handle, state));
+        }
+
+        return true;
+    }
+
+    size_t PipelineWarmer::warm()
+    {
+        std::vector<Combination> pending = combinations();
+
+        // Group by target so each set of formats gets one 1x1 framebuffer
+        auto target = [](const RenderState &state)
+        {
+            return state.key() & 0xFFFF0008u;
+        };
+
+        std::sort(pending.begin(), pending.end(), [&](const Combination &a, const Combination &b)
+                  { return target(a.state) < target(b.state); });
+
+        std::unique_ptr<Image> color;
+        std::unique_ptr<Image> depth;
+        std::unique_ptr<Framebuffer> framebuffer;
+        uint32_t bound_target = 0;
+
+        size_t count = 0;
+        VertexArray *bound = nullptr;
+
+        for (const Combination &combination : pending)
+        {
+            Pipeline *pipeline = _pipelines[combination.pipeline];
+            VertexArray *layout = _layouts[combination.layout];
+
+            if (pipeline == nullptr || layout == nullptr)
+            {
+                continue;
+            }
+
+            if (framebuffer == nullptr || target(combination.state) != bound_target)
+            {
+                if (framebuffer != nullptr)
+                {
+                    framebuffer->unbind();
+                }
+
+                bound_target = target(combination.state);
+                color = std::make_unique<Image>(1, 1, renderable_format(combination.state.color_format));
+                depth = combination.state.has_depth ? std::make_unique<Image>(1, 1, combination.state.depth_format) : nullptr;
+                framebuffer = std::make_unique<Framebuffer>(1, 1);
+                framebuffer->attach(AttachmentType::Color0, *color);
+
+                if (depth != nullptr)
+                {
+                    framebuffer->attach(AttachmentType::Depth, *depth);
+                }
+
+                framebuffer->bind();
+                viewport(0, 0, 1, 1);
+            }
+
+            combination.state.apply();
+            pipeline->use();
+            layout->bind();
+            bound = layout;
+
+            size_t vertex_count = 3;
+            if (combination.state.primitive_type == PrimitiveType::Points)
+            {
+                vertex_count = 1;
+            }
+            else if (combination.state.primitive_type == PrimitiveType::Lines || combination.state.primitive_type == PrimitiveType::LineStrip || combination.state.primitive_type == PrimitiveType::LineLoop)
+            {
+                vertex_count = 2;
+            }
+
+            draw(vertex_count, 1, 0, 0, combination.state.primitive_type);
+            count++;
+        }
+
+        if (bound != nullptr)
+        {
+            bound->unbind();
+        }
+
+        if (framebuffer != nullptr)
+        {
+            framebuffer->unbind();
+        }
+
+        finish(); // Make sure the driver compiled everything before the first real frame
+
+        debug::log("Warmed {} pipeline combinations", count);
+        return count;
+    }
+}